@@ -38,12 +38,19 @@ def main():
                   engine_dir / "texture.cpp",
                   engine_dir / "ui.cpp",
                   engine_dir / "menu.cpp",
-                  engine_dir / "events.cpp"]
+                  engine_dir / "events.cpp",
+                  engine_dir / "stats.cpp",
+                  engine_dir / "atlas.cpp",
+                  engine_dir / "glyphs.cpp",
+                  engine_dir / "console.cpp",
+                  engine_dir / "jobs.cpp"]
 
     src = ["src/main.cpp", "src/game.cpp", "src/editbox.cpp",
            "src/editlines.cpp", "src/maze.cpp", "src/language.cpp",
            "src/parser.cpp", "src/slime.cpp", "src/equipment.cpp",
-           "src/parse.cpp", "src/player.cpp", "src/utils.cpp"]
+           "src/parse.cpp", "src/player.cpp", "src/utils.cpp",
+           "src/entities.cpp", "src/spatial.cpp", "src/ai.cpp",
+           "src/combat.cpp", "src/trace.cpp", "src/robots.cpp"]
 
     with Context(namespace="engine"):
         engine = [Object(p.with_suffix(".obj").name, p,
@@ -0,0 +1,198 @@
+#include "ai.h"
+#include "config.h"
+#include <algorithm>
+#include <limits>
+
+
+constexpr uint16_t UNREACHABLE = std::numeric_limits<uint16_t>::max();
+
+// Steps tried when moving, straight ones first. Diagonal steps are only
+// used by entities moving with MANHATTAN_DIAG.
+static const vec2i STEPS[] = {{0, -1}, {1, 0},  {0, 1},  {-1, 0},
+                              {1, -1}, {1, 1}, {-1, 1}, {-1, -1}};
+
+uint16_t EnemyAI::distance_at(vec2i pos) const {
+    if (pos.x < 0 || pos.x >= MAZE_WIDTH || pos.y < 0 || pos.y >= MAZE_HEIGHT) {
+        return UNREACHABLE;
+    }
+    return distances[pos.y * MAZE_WIDTH + pos.x];
+}
+
+void EnemyAI::update_distances(const World &world, const Maze &maze) {
+    distances.assign(MAZE_WIDTH * MAZE_HEIGHT, UNREACHABLE);
+    frontier.clear();
+    for (std::size_t i = 0; i < world.size(); ++i) {
+        vec2i pos = world.positions[i];
+        if (world.factions[i] == FACTIONS::ROBOTS &&
+            distance_at(pos) == UNREACHABLE && maze.is_open(pos.x, pos.y)) {
+            distances[pos.y * MAZE_WIDTH + pos.x] = 0;
+            frontier.push_back(pos);
+        }
+    }
+    // Breadth first search, stopping at the sight range
+    for (std::size_t ix = 0; ix < frontier.size(); ++ix) {
+        vec2i pos = frontier[ix];
+        uint16_t dist = distances[pos.y * MAZE_WIDTH + pos.x];
+        if (dist >= AI_SIGHT_RANGE) {
+            continue;
+        }
+        for (int s = 0; s < 4; ++s) {
+            vec2i next{pos.x + STEPS[s].x, pos.y + STEPS[s].y};
+            if (maze.is_open(next.x, next.y) &&
+                distance_at(next) == UNREACHABLE) {
+                distances[next.y * MAZE_WIDTH + next.x] = dist + 1;
+                frontier.push_back(next);
+            }
+        }
+    }
+}
+
+void EnemyAI::plan(World &world, std::size_t begin, std::size_t end) {
+    // Reused between calls on the same thread
+    thread_local std::vector<entity_t> in_range;
+    for (std::size_t i = begin; i < end; ++i) {
+        Intent &intent = intents[i];
+        intent = {Intent::NONE, {}, NULL_ENTITY};
+        AIState &state = world.ai[i];
+        // Robots are run by their programs
+        if (world.factions[i] == FACTIONS::ROBOTS) {
+            continue;
+        }
+        if (state.stun_time > 0) {
+            --state.stun_time;
+            continue;
+        } else if (state.wait_time > 0) {
+            --state.wait_time;
+            continue;
+        }
+        vec2i pos = world.positions[i];
+        const CombatStats &stats = world.combat[i];
+        // Enemies only act on robots they can reach within the sight range
+        uint16_t dist = distance_at(pos);
+        if (dist == UNREACHABLE) {
+            state.state = IDLE;
+            continue;
+        }
+        state.state = COMBAT;
+
+        // Attack the closest hostile in range, ties broken by handle
+        in_range.clear();
+        world.query_range(pos, stats.range, stats.attack_dist_type, in_range);
+        int32_t best_dist = std::numeric_limits<int32_t>::max();
+        for (entity_t other : in_range) {
+            std::size_t j = world.index_of(other);
+            if (world.factions[j] == world.factions[i]) {
+                continue;
+            }
+            int32_t d = world.positions[j].dist_sqrd_to(pos);
+            if (d < best_dist || (d == best_dist && other < intent.target)) {
+                best_dist = d;
+                intent = {Intent::ATTACK, {}, other};
+            }
+        }
+        if (intent.type == Intent::ATTACK) {
+            continue;
+        }
+
+        // Otherwise step towards the closest robot
+        int steps = stats.move_dist_type == DIST_TYPES::MANHATTAN_DIAG ? 8 : 4;
+        for (int s = 0; s < steps; ++s) {
+            vec2i next{pos.x + STEPS[s].x, pos.y + STEPS[s].y};
+            uint16_t next_dist = distance_at(next);
+            if (next_dist < dist) {
+                dist = next_dist;
+                intent = {Intent::MOVE, next, NULL_ENTITY};
+            }
+        }
+    }
+}
+
+void EnemyAI::commit(World &world, const Maze &maze, Combat &combat) {
+    for (std::size_t i = 0; i < intents.size(); ++i) {
+        const Intent &intent = intents[i];
+        switch (intent.type) {
+        case Intent::NONE:
+            break;
+        case Intent::MOVE:
+            // Another entity may have moved there earlier in the commit,
+            // in which case the move is lost.
+            if (maze.is_open(intent.pos.x, intent.pos.y) &&
+                !world.is_occupied(intent.pos)) {
+                world.move_entity(world.ids[i], intent.pos);
+            }
+            world.ai[i].wait_time = AI_MOVE_DELAY;
+            break;
+        case Intent::ATTACK:
+            if (world.alive(intent.target)) {
+                combat.queue_attack(world.ids[i], intent.target);
+                world.ai[i].wait_time = AI_ATTACK_DELAY;
+            }
+            break;
+        }
+    }
+}
+
+void EnemyAI::tick(World &world, const Maze &maze, JobSystem &jobs,
+                   Combat &combat) {
+    update_distances(world, maze);
+    intents.resize(world.size());
+    jobs.parallel_for(world.size(), AI_JOB_SIZE,
+                      [this, &world](std::size_t begin, std::size_t end) {
+                          plan(world, begin, end);
+                      });
+    commit(world, maze, combat);
+}
+
+#ifdef AI_BENCH
+#include "slime.h"
+#include "engine/engine.h"
+#include <chrono>
+#include <iostream>
+
+// Runs ticks AI ticks on count slimes, returning a hash of the end state.
+static uint64_t run(unsigned workers, int count, int ticks, bool report) {
+    engine::seed_world(1);
+    Maze maze;
+    World world;
+    world.reserve(count + 1);
+    world.spawn(EntityKind::PLAYER, vec2i{maze.start.first, maze.start.second},
+                Health{1 << 30, 1 << 30},
+                CombatStats{0, 1, 1, MANHATTAN, MANHATTAN}, FACTIONS::ROBOTS);
+    for (int i = 0; i < count; ++i) {
+        entity_t e = spawn_slime(world, engine::random(0, MAZE_WIDTH),
+                                 engine::random(0, MAZE_HEIGHT), 1 + i % 5);
+        world.ai[world.index_of(e)].wait_time = i % AI_MOVE_DELAY;
+    }
+    JobSystem jobs{workers};
+    EnemyAI ai;
+    Combat combat;
+    auto start = std::chrono::steady_clock::now();
+    for (int tick = 0; tick < ticks; ++tick) {
+        ai.tick(world, maze, jobs, combat);
+        combat.resolve(world);
+    }
+    auto end = std::chrono::steady_clock::now();
+    if (report) {
+        std::cout << count << " entities, " << jobs.thread_count()
+                  << " threads: "
+                  << std::chrono::duration_cast<std::chrono::microseconds>(
+                         end - start)
+                             .count() /
+                         ticks
+                  << " us per tick" << std::endl;
+    }
+    return world.hash();
+}
+
+int main() {
+    bool ok = true;
+    for (int count : {10000, 100000}) {
+        ok = JobSystem::same_on_any_threads([count](unsigned workers) {
+                 return run(workers, count, 200, true);
+             }) &&
+             ok;
+    }
+    std::cout << (ok ? "ok" : "Result depends on thread count") << std::endl;
+    return ok ? 0 : 1;
+}
+#endif
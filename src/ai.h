@@ -0,0 +1,52 @@
+#pragma once
+#include "entities.h"
+#include "combat.h"
+#include "maze.h"
+#include "engine/jobs.h"
+#include <vector>
+
+
+
+/**
+ * Action an entity decided on during planning.
+ */
+struct Intent {
+    enum Type : uint8_t { NONE, MOVE, ATTACK } type;
+    // Tile to move to, for MOVE
+    vec2i pos;
+    // Entity to attack, for ATTACK
+    entity_t target;
+};
+
+/**
+ * Enemy AI, run in two phases every tick. Every enemy first plans an
+ * intent, in parallel, looking only at the state from the last tick.
+ * The intents are then committed serially in entity order, resolving
+ * conflicts such as two enemies moving to the same tile. The result
+ * does not depend on the number of threads. Attacks are queued on combat,
+ * to be resolved by the caller.
+ */
+class EnemyAI {
+public:
+    void tick(World &world, const Maze &maze, JobSystem &jobs, Combat &combat);
+
+private:
+    /**
+     * Computes the number of steps from every tile to the closest robot.
+     */
+    void update_distances(const World &world, const Maze &maze);
+
+    /**
+     * Plans the intents of entities [begin, end). Only writes the AI state
+     * and intent of those entities.
+     */
+    void plan(World &world, std::size_t begin, std::size_t end);
+
+    void commit(World &world, const Maze &maze, Combat &combat);
+
+    [[nodiscard]] uint16_t distance_at(vec2i pos) const;
+
+    std::vector<uint16_t> distances;
+    std::vector<vec2i> frontier;
+    std::vector<Intent> intents;
+};
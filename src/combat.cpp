@@ -0,0 +1,181 @@
+#include "combat.h"
+#include <algorithm>
+
+
+uint8_t attack_effects(WEAPON_MELEE_SPECIAL special) {
+    switch (special) {
+    case LIFE_STEAL:
+        return ATTACK_LIFE_STEAL;
+    case MELEE_ARMOUR_SHRED:
+        return ATTACK_ARMOUR_SHRED;
+    case SPIN:
+        return ATTACK_SPIN;
+    case MELEE_NOTHING:
+    default:
+        return 0;
+    }
+}
+
+uint8_t attack_effects(WEAPON_RANGED_SPECIAL special) {
+    switch (special) {
+    case RANGED_ARMOUR_SHRED:
+        return ATTACK_ARMOUR_SHRED;
+    case EXPLOSIVE:
+        return ATTACK_EXPLOSIVE;
+    case PIERCING:
+        return ATTACK_PIERCING;
+    case RANGED_NOTHING:
+    default:
+        return 0;
+    }
+}
+
+uint8_t defence_effects(ARMOUR_SPECIAL special) {
+    return special == THORNS ? DEFENCE_THORNS : 0;
+}
+
+void Combat::queue_attack(entity_t attacker, entity_t target) {
+    attacks.push_back({attacker, target});
+}
+
+const std::vector<entity_t> &Combat::get_dead() const { return dead; }
+
+void Combat::add_area_hits(const World &world, uint32_t attacker,
+                           vec2i center, int32_t amount, uint8_t effects) {
+    in_range.clear();
+    world.query_range(center, 1, DIST_TYPES::MANHATTAN_DIAG, in_range);
+    // Sorted, so hits do not depend on the layout of the spatial index
+    std::sort(in_range.begin(), in_range.end());
+    for (entity_t other : in_range) {
+        auto ix = static_cast<uint32_t>(world.index_of(other));
+        if (world.factions[ix] != world.factions[attacker]) {
+            hits.push_back({attacker, ix, amount, effects});
+        }
+    }
+}
+
+void Combat::add_damage(uint32_t ix, int32_t amount) {
+    // Damage can sum to 0, so whether ix was hit is kept apart from it
+    if (!touched[ix]) {
+        touched[ix] = true;
+        damaged.push_back(ix);
+    }
+    damage[ix] += amount;
+}
+
+void Combat::resolve(World &world) {
+    dead.clear();
+    if (attacks.empty()) {
+        return;
+    }
+
+    // Expand attacks into hits
+    hits.clear();
+    for (const Attack &attack : attacks) {
+        if (!world.alive(attack.attacker) || !world.alive(attack.target)) {
+            continue;
+        }
+        auto a = static_cast<uint32_t>(world.index_of(attack.attacker));
+        auto t = static_cast<uint32_t>(world.index_of(attack.target));
+        const CombatStats &stats = world.combat[a];
+        // Area effects are not applied again to the area hits
+        uint8_t effects =
+            stats.attack_effects & ~(ATTACK_SPIN | ATTACK_EXPLOSIVE);
+        hits.push_back({a, t, stats.damage, effects});
+        if (stats.attack_effects & ATTACK_SPIN) {
+            add_area_hits(world, a, world.positions[a], stats.damage, effects);
+        }
+        if (stats.attack_effects & ATTACK_EXPLOSIVE) {
+            add_area_hits(world, a, world.positions[t], stats.damage / 2,
+                          effects);
+        }
+    }
+    attacks.clear();
+
+    // Sum up damage per entity
+    damage.assign(world.size(), 0);
+    touched.assign(world.size(), false);
+    damaged.clear();
+    for (const Hit &hit : hits) {
+        CombatStats &target = world.combat[hit.target];
+        int32_t armour = (hit.effects & ATTACK_PIERCING) ? 0 : target.armour;
+        int32_t dealt = std::max(hit.damage - armour, 1);
+        if (hit.effects & ATTACK_ARMOUR_SHRED) {
+            target.armour = std::max(target.armour - 1, 0);
+        }
+        add_damage(hit.target, dealt);
+        if (hit.effects & ATTACK_LIFE_STEAL) {
+            add_damage(hit.attacker, -dealt / 2);
+        }
+        if (target.defence_effects & DEFENCE_THORNS) {
+            add_damage(hit.attacker, std::max(dealt / 4, 1));
+        }
+    }
+
+    // Apply, in the order entities were first hit
+    for (uint32_t ix : damaged) {
+        Health &hp = world.health[ix];
+        if (hp.hp == 0) {
+            continue;
+        }
+        hp.hp = std::clamp(hp.hp - damage[ix], 0, hp.max_hp);
+        if (hp.hp == 0) {
+            dead.push_back(world.ids[ix]);
+        }
+    }
+}
+
+#ifdef COMBAT_BENCH
+#include <chrono>
+#include <iostream>
+
+// Runs a fight on a grid of count entities, returning a hash of the result.
+static uint64_t run(int count, int ticks) {
+    constexpr int32_t SIZE = 512;
+    World world{SIZE, SIZE};
+    world.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        vec2i pos{i % SIZE, i / SIZE};
+        auto faction = static_cast<FACTIONS>((pos.x + pos.y) % 2);
+        CombatStats stats{i % 4, 3 + i % 5, 1, MANHATTAN, MANHATTAN,
+                          static_cast<uint8_t>(1 << (i % 6)),
+                          static_cast<uint8_t>(i % 3 == 0 ? DEFENCE_THORNS : 0)};
+        world.spawn(EntityKind::SLIME, pos, Health{1000, 1000}, stats,
+                    faction);
+    }
+    Combat combat;
+    std::size_t deaths = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int tick = 0; tick < ticks; ++tick) {
+        // Everyone attacks the neighbour to the right
+        for (std::size_t i = 0; i < world.size(); ++i) {
+            vec2i pos = world.positions[i];
+            entity_t target = world.entity_at(vec2i{pos.x + 1, pos.y});
+            if (target != NULL_ENTITY) {
+                combat.queue_attack(world.ids[i], target);
+            }
+        }
+        combat.resolve(world);
+        deaths += combat.get_dead().size();
+        for (entity_t e : combat.get_dead()) {
+            world.despawn(e);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::cout << count << " entities: "
+              << std::chrono::duration_cast<std::chrono::microseconds>(end -
+                                                                       start)
+                         .count() / ticks
+              << " us per tick, " << deaths << " deaths" << std::endl;
+    return world.hash();
+}
+
+int main() {
+    bool ok = true;
+    for (int count : {10000, 100000}) {
+        ok = ok && run(count, 100) == run(count, 100);
+    }
+    std::cout << (ok ? "ok" : "Results differ between runs") << std::endl;
+    return ok ? 0 : 1;
+}
+#endif
@@ -0,0 +1,89 @@
+#pragma once
+#include "entities.h"
+#include "equipment.h"
+#include <vector>
+
+
+
+/**
+ * Effects of an attack, combined as flags in CombatStats::attack_effects.
+ */
+enum ATTACK_EFFECTS : uint8_t {
+    // Attacker heals half of the damage dealt
+    ATTACK_LIFE_STEAL = 1 << 0,
+    // Every hit lowers the armour of the target by one
+    ATTACK_ARMOUR_SHRED = 1 << 1,
+    // Also hits every hostile next to the attacker
+    ATTACK_SPIN = 1 << 2,
+    // Also hits every hostile next to the target, for half damage
+    ATTACK_EXPLOSIVE = 1 << 3,
+    // Ignores armour
+    ATTACK_PIERCING = 1 << 4,
+};
+
+/**
+ * Effects when being hit, combined as flags in CombatStats::defence_effects.
+ */
+enum DEFENCE_EFFECTS : uint8_t {
+    // Attackers take a quarter of the damage they deal, at least 1
+    DEFENCE_THORNS = 1 << 0,
+};
+
+uint8_t attack_effects(WEAPON_MELEE_SPECIAL special);
+
+uint8_t attack_effects(WEAPON_RANGED_SPECIAL special);
+
+uint8_t defence_effects(ARMOUR_SPECIAL special);
+
+/**
+ * Buffer of the attacks made during a tick, resolved together. Attacks
+ * are first expanded into single hits, including area effects, which are
+ * then applied to per-entity damage totals in the order the attacks were
+ * queued. Health is only changed once all hits are counted, so the result
+ * only depends on the order of queue_attack calls.
+ */
+class Combat {
+public:
+    /**
+     * Queues an attack, using the stats of attacker when resolving.
+     */
+    void queue_attack(entity_t attacker, entity_t target);
+
+    /**
+     * Resolves all queued attacks. Entities killed are listed in dead, but
+     * not despawned.
+     */
+    void resolve(World &world);
+
+    /**
+     * Returns the entities killed in the last resolve, in order.
+     */
+    [[nodiscard]] const std::vector<entity_t> &get_dead() const;
+
+private:
+    struct Attack {
+        entity_t attacker, target;
+    };
+
+    // A single hit, entities given as dense indices
+    struct Hit {
+        uint32_t attacker, target;
+        int32_t damage;
+        uint8_t effects;
+    };
+
+    void add_area_hits(const World &world, uint32_t attacker, vec2i center,
+                       int32_t damage, uint8_t effects);
+
+    void add_damage(uint32_t ix, int32_t amount);
+
+    std::vector<Attack> attacks;
+    std::vector<Hit> hits;
+    // Damage taken this resolve, by dense index, negative for healing
+    std::vector<int32_t> damage;
+    // Set for the entities in damaged, by dense index
+    std::vector<uint8_t> touched;
+    std::vector<uint32_t> damaged;
+    std::vector<entity_t> in_range;
+    std::vector<entity_t> dead;
+};
@@ -1,9 +1,17 @@
 #ifndef PROCASM_CONFIG_H
 #define PROCASM_CONFIG_H
+#include <cstddef>
+#include <cstdint>
 
 // Milliseconds per clock cycle.
 constexpr int TICK_DELAY = 2;
 
+// Simulation ticks per second, and max ticks run per frame to catch up.
+constexpr int TICKS_PER_SECOND = 60;
+constexpr int MAX_CATCH_UP_TICKS = 5;
+// Max fast forward factor, toggled in steps of 10x.
+constexpr int MAX_TIME_SCALE = 1000;
+
 #define TEXT_COLOR 0xf0, 0xf0, 0xf0, 0xff
 
 constexpr int WIDTH = 1920, HEIGHT = 1080;
@@ -19,8 +27,37 @@ constexpr int BOX_W = 2 * BOX_TEXT_MARGIN + MAX_LINE_WIDTH * BOX_CHAR_WIDTH;
 constexpr int BOX_H = 2* BOX_TEXT_MARGIN + MAX_LINES * BOX_LINE_HEIGHT;
 constexpr int BOX_X = WIDTH - BOX_W - 50;
 constexpr int BOX_Y = HEIGHT / 2 - BOX_H / 2;
-constexpr int BOX_UNDO_BUFFER_SIZE = 1024;
+// Bytes of memory used by each of the undo and redo stacks.
+constexpr std::size_t BOX_UNDO_BUFFER_SIZE = 1 << 18;
 
 constexpr int SPACES_PER_TAB = 4;
 
+constexpr int PLAYER_HP = 10;
+
+// Distance in steps from which enemies notice the player.
+constexpr int AI_SIGHT_RANGE = 8;
+// Ticks an enemy waits after moving and after attacking.
+constexpr int AI_MOVE_DELAY = 30;
+constexpr int AI_ATTACK_DELAY = 60;
+// Entities planned per job in the AI tick.
+constexpr int AI_JOB_SIZE = 256;
+
+// Instructions the player's program may run per tick. Prints and reading
+// tiles do not end the tick, moving and turning do.
+constexpr uint32_t PROGRAM_STEP_BUDGET = 10000;
+
+// Program and world states kept for rewinding, one per robot action.
+constexpr std::size_t REWIND_HISTORY = 64;
+
+// Instructions a robot program may run per tick, and ticks a robot waits
+// after moving or turning.
+constexpr int ROBOT_STEP_BUDGET = 1000;
+constexpr int ROBOT_ACTION_DELAY = 30;
+// Robots run per job in the robot tick.
+constexpr int ROBOT_JOB_SIZE = 16;
+
+// Visible rows and total rows of history in the output log.
+constexpr int LOG_ROWS = 8;
+constexpr int LOG_CAPACITY = 10000;
+
 #endif // PROCASM_CONFIG_H
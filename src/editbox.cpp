@@ -2,6 +2,8 @@
 #include "config.h"
 #include "engine/log.h"
 #include "engine/style.h"
+#include "engine/stats.h"
+#include <algorithm>
 
 bool valid_char(unsigned char c) { return c >= 0x20 && c <= 0xef; }
 
@@ -10,17 +12,16 @@ Editbox::Editbox(int x, int y, const WindowState &window_state)
 
 TextPosition Editbox::find_pos(int mouse_x, int mouse_y) const {
     int row = (mouse_y - (y + BOX_TEXT_MARGIN)) / BOX_LINE_HEIGHT;
-    const std::vector<std::string> &text = lines.get_lines();
     if (row < 0) {
         row = 0;
-    } else if (row >= text.size()) {
-        row = static_cast<int>(text.size() - 1);
+    } else if (row >= lines.line_count()) {
+        row = static_cast<int>(lines.line_count() - 1);
     }
     int col = (mouse_x - (x + BOX_TEXT_MARGIN)) / BOX_CHAR_WIDTH;
     if (col < 0) {
         col = 0;
-    } else if (col > text[row].size()) {
-        col = static_cast<int>(text[row].size());
+    } else if (col > lines.line_size(row)) {
+        col = static_cast<int>(lines.line_size(row));
     }
     return {row, col};
 }
@@ -310,43 +311,97 @@ void Editbox::handle_keypress(SDL_Keycode key) {
     }
 }
 
-void Editbox::render() {
-    SDL_SetRenderDrawColor(gRenderer, UI_BORDER_COLOR);
-    SDL_FRect rect = {(float)x, (float)y, (float)BOX_W, (float)BOX_H};
-    SDL_RenderFillRect(gRenderer, &rect);
-    SDL_SetRenderDrawColor(gRenderer, UI_BACKGROUND_COLOR);
-    rect = {rect.x + 2, rect.y + 2, rect.w - 4, rect.h - 4};
-    SDL_RenderFillRect(gRenderer, &rect);
-
-    if (lines.has_selection()) {
-        SDL_SetRenderDrawColor(gRenderer, 0x50, 0x50, 0x50, 0xff);
-        int start = lines.get_selection_start().col;
-        for (int row = lines.get_selection_start().row;
-             row < lines.get_selection_end().row; ++row) {
-            int size = lines.line_size(row);
-            SDL_FRect r = {(float)(x + BOX_TEXT_MARGIN + 
-                                   BOX_CHAR_WIDTH * start),
-                          (float)(y + BOX_LINE_HEIGHT * row +
-                                  BOX_TEXT_MARGIN),
-                          (float)(BOX_CHAR_WIDTH * (size + 1 - start)),
-                          (float)(BOX_LINE_HEIGHT)};
-            SDL_RenderFillRect(gRenderer, &r);
-            start = 0;
+void Editbox::invalidate_rows(int64_t first, int64_t last) {
+    if (first < 0) {
+        first = 0;
+    }
+    for (int64_t row = first;
+         row <= last && row < static_cast<int64_t>(dirty_rows.size()); ++row) {
+        dirty_rows[row] = true;
+    }
+}
+
+void Editbox::invalidate_selection(TextPosition start, TextPosition end) {
+    if (start != end) {
+        invalidate_rows(start.row, end.row);
+    }
+}
+
+void Editbox::invalidate() {
+    canvas_dirty = true;
+    std::fill(dirty_rows.begin(), dirty_rows.end(), true);
+}
+
+void Editbox::render_dirty_rows() {
+    if (canvas.get_width() == 0) {
+        canvas.create_target(BOX_W, BOX_H);
+        canvas_dirty = true;
+    }
+    Texture::set_render_target(&canvas);
+    if (canvas_dirty) {
+        SDL_SetRenderDrawColor(gRenderer, UI_BORDER_COLOR);
+        SDL_RenderClear(gRenderer);
+        SDL_SetRenderDrawColor(gRenderer, UI_BACKGROUND_COLOR);
+        SDL_FRect rect = {2.0f, 2.0f, (float)(BOX_W - 4), (float)(BOX_H - 4)};
+        SDL_RenderFillRect(gRenderer, &rect);
+        gFrameStats.add_draw_calls(2);
+        std::fill(dirty_rows.begin(), dirty_rows.end(), true);
+        canvas_dirty = false;
+    }
+
+    TextPosition sel_start = lines.get_selection_start();
+    TextPosition sel_end = lines.get_selection_end();
+    for (int64_t row = 0; row < static_cast<int64_t>(dirty_rows.size());
+         ++row) {
+        if (!dirty_rows[row]) {
+            continue;
         }
-        int col = lines.get_selection_end().col;
-        SDL_FRect r = {(float)(x + BOX_TEXT_MARGIN + 
-                               BOX_CHAR_WIDTH * start),
-                      (float)(y + BOX_LINE_HEIGHT * 
-                              lines.get_selection_end().row + 
-                              BOX_TEXT_MARGIN),
-                      (float)(BOX_CHAR_WIDTH * (col - start)),
-                      (float)(BOX_LINE_HEIGHT)};
+        dirty_rows[row] = false;
+        SDL_SetRenderDrawColor(gRenderer, UI_BACKGROUND_COLOR);
+        SDL_FRect r = {2.0f,
+                       (float)(BOX_LINE_HEIGHT * row + BOX_TEXT_MARGIN),
+                       (float)(BOX_W - 4), (float)BOX_LINE_HEIGHT};
         SDL_RenderFillRect(gRenderer, &r);
+        gFrameStats.add_draw_calls();
+
+        if (sel_start != sel_end && row >= sel_start.row &&
+            row <= sel_end.row) {
+            int64_t start = row == sel_start.row ? sel_start.col : 0;
+            int64_t end = row == sel_end.row ? sel_end.col
+                                             : lines.line_size(row) + 1;
+            SDL_SetRenderDrawColor(gRenderer, 0x50, 0x50, 0x50, 0xff);
+            r.x = (float)(BOX_TEXT_MARGIN + BOX_CHAR_WIDTH * start);
+            r.w = (float)(BOX_CHAR_WIDTH * (end - start));
+            SDL_RenderFillRect(gRenderer, &r);
+            gFrameStats.add_draw_calls();
+        }
+        if (row < static_cast<int64_t>(boxes.size())) {
+            boxes[row].render(BOX_TEXT_MARGIN, BOX_TEXT_MARGIN, *window_state);
+        }
     }
+    painted_start = sel_start;
+    painted_end = sel_end;
+    Texture::set_render_target(nullptr);
+}
 
-    for (auto &box : boxes) {
-        box.render(x + BOX_TEXT_MARGIN, y + BOX_TEXT_MARGIN, *window_state);
+void Editbox::render() {
+    if (glyph_generation != gGlyphs.generation()) {
+        glyph_generation = gGlyphs.generation();
+        invalidate();
+    }
+    if (painted_start != lines.get_selection_start() ||
+        painted_end != lines.get_selection_end()) {
+        invalidate_selection(painted_start, painted_end);
+        invalidate_selection(lines.get_selection_start(),
+                             lines.get_selection_end());
     }
+    if (canvas_dirty || canvas.get_width() == 0 ||
+        std::find(dirty_rows.begin(), dirty_rows.end(), true) !=
+            dirty_rows.end()) {
+        render_dirty_rows();
+    }
+    canvas.render_corner(x, y);
+
     for (auto &box : error_msg) {
         box.render(x, y, *window_state);
     }
@@ -369,6 +424,7 @@ void Editbox::render() {
                 x + BOX_TEXT_MARGIN + BOX_CHAR_WIDTH * (cursor_pos.col + 1),
                 y + BOX_LINE_HEIGHT * (cursor_pos.row + 1) + BOX_TEXT_MARGIN);
         }
+        gFrameStats.add_draw_calls();
     }
 }
 void Editbox::set_dpi_scale(double dpi) {
@@ -378,6 +434,7 @@ void Editbox::set_dpi_scale(double dpi) {
     for (auto &box : error_msg) {
         box.set_dpi_ratio(dpi);
     }
+    canvas_dirty = true;
 }
 bool Editbox::is_pressed(int mouse_x, int mouse_y) const {
     return mouse_x > x && mouse_x < x + BOX_W && mouse_y > y &&
@@ -388,10 +445,13 @@ void Editbox::change_callback(TextPosition start, TextPosition end,
     max_col = lines.get_cursor_pos().col;
     if (boxes.size() == lines.line_count()) {
         for (int i = start.row; i <= end.row; ++i) {
-            boxes[i].set_text(lines.get_lines()[i]);
+            boxes[i].set_text(lines.line(i));
         }
+        invalidate_rows(start.row, end.row);
         return;
     }
+    invalidate_rows(start.row, std::max(static_cast<int64_t>(boxes.size()),
+                                        lines.line_count()) - 1);
     if (boxes.size() < lines.line_count()) {
         for (int i = boxes.size(); i < lines.line_count(); ++i) {
             boxes.emplace_back(0, 0 + BOX_LINE_HEIGHT * i,
@@ -403,8 +463,9 @@ void Editbox::change_callback(TextPosition start, TextPosition end,
         boxes.resize(lines.line_count());
     }
     for (int64_t i = start.row; i < lines.line_count(); ++i) {
-        if (lines.get_lines()[i] != boxes[i].get_text()) {
-            boxes[i].set_text(lines.get_lines()[i]);
+        std::string line = lines.line(i);
+        if (line != boxes[i].get_text()) {
+            boxes[i].set_text(line);
         }
     }
 }
@@ -43,6 +43,12 @@ public:
     void set_text(std::string& text);
 
     void set_errors(std::vector<std::pair<std::string, int32_t>> msgs);
+
+    /**
+     * Marks the whole cached texture as outdated, causing every row to be
+     * repainted on the next render.
+     */
+    void invalidate();
 private:
     friend void change_callback(TextPosition, TextPosition, int64_t, void*);
     void change_callback(TextPosition start, TextPosition end, int64_t removed);
@@ -51,6 +57,21 @@ private:
 
     void reset_cursor_animation();
 
+    /**
+     * Marks rows [first, last] to be repainted in the cached texture.
+     */
+    void invalidate_rows(int64_t first, int64_t last);
+
+    /**
+     * Marks the rows covered by the selection [start, end) to be repainted.
+     */
+    void invalidate_selection(TextPosition start, TextPosition end);
+
+    /**
+     * Repaints all rows marked as dirty into the cached texture.
+     */
+    void render_dirty_rows();
+
     int x{}, y{};
 
     int64_t max_col {0};
@@ -63,6 +84,15 @@ private:
     std::vector<TextBox> boxes {};
     std::vector<TextBox> error_msg {};
 
+    // Border, background, selection and text, repainted one row at a time.
+    Texture canvas {};
+    bool canvas_dirty {true};
+    std::vector<bool> dirty_rows = std::vector<bool>(MAX_LINES, false);
+    // Selection that is currently painted into canvas.
+    TextPosition painted_start {}, painted_end {};
+    // Glyph atlas generation the canvas was painted with.
+    Uint64 glyph_generation {0};
+
     bool show_cursor {false};
     Sint64 ticks_remaining = 0;
 
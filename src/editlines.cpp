@@ -1,5 +1,4 @@
 #include "editlines.h"
-#include <sstream>
 #include <climits>
 #include <algorithm>
 #include "config.h"
@@ -26,140 +25,488 @@ bool TextPosition::operator!=(const TextPosition &other) const {
     return !(*this == other);
 }
 
+EditStack::EditStack(std::size_t budget) : budget{budget} {}
+
 unsigned EditStack::size() const {
-    return data_size;
+    return count;
 }
 
 void EditStack::clear() {
-    data_size = 0;
-    pos = 0;
+    head = 0;
+    tail = 0;
+    used = 0;
+    count = 0;
+}
+
+void EditStack::write(std::size_t pos, const void *data, std::size_t size) {
+    const char *src = static_cast<const char *>(data);
+    std::size_t first = std::min(size, journal.size() - pos);
+    std::copy(src, src + first, journal.begin() + pos);
+    std::copy(src + first, src + size, journal.begin());
+}
+
+void EditStack::read(std::size_t pos, void *data, std::size_t size) const {
+    char *dest = static_cast<char *>(data);
+    std::size_t first = std::min(size, journal.size() - pos);
+    std::copy(journal.begin() + pos, journal.begin() + pos + first, dest);
+    std::copy(journal.begin(), journal.begin() + (size - first), dest + first);
+}
+
+void EditStack::pop_oldest() {
+    Record record;
+    read(head, &record, sizeof(Record));
+    std::size_t entry = sizeof(Record) + record.text_size + sizeof(Footer);
+    head = (head + entry) % journal.size();
+    used -= entry;
+    --count;
 }
 
-void EditStack::push(const EditAction &action) {
-    if (data_size < BOX_UNDO_BUFFER_SIZE) {
-        ++data_size;
+bool EditStack::reserve(std::size_t size) {
+    if (size > budget) {
+        return false;
     }
-    if (pos == data.size()) {
-        data.push_back(action);
+    if (journal.empty()) {
+        journal.resize(budget);
+    }
+    while (used + size > journal.size()) {
+        pop_oldest();
+    }
+    return true;
+}
+
+EditStack::Record EditStack::top_record(std::size_t &entry_start) const {
+    Footer entry;
+    std::size_t n = journal.size();
+    read((tail + n - sizeof(Footer)) % n, &entry, sizeof(Footer));
+    entry_start = (tail + n - entry) % n;
+    Record record;
+    read(entry_start, &record, sizeof(Record));
+    return record;
+}
+
+void EditStack::push(const EditAction &action, std::string_view text) {
+    std::size_t entry = sizeof(Record) + text.size() + sizeof(Footer);
+    if (!reserve(entry)) {
+        // Older actions can not be undone without this one
+        clear();
+        return;
+    }
+    Record record {action.start, action.end, static_cast<uint32_t>(text.size()),
+                   action.chain, false};
+    std::size_t n = journal.size();
+    write(tail, &record, sizeof(Record));
+    write((tail + sizeof(Record)) % n, text.data(), text.size());
+    Footer footer = static_cast<Footer>(entry);
+    write((tail + sizeof(Record) + text.size()) % n, &footer, sizeof(Footer));
+    tail = (tail + entry) % n;
+    used += entry;
+    ++count;
+}
+
+bool EditStack::extend_top(const EditAction &action, std::string_view text) {
+    std::size_t entry_start;
+    Record record = top_record(entry_start);
+    bool forward = record.end == action.start &&
+                   (!record.reversed || text.empty());
+    bool backward = !forward && record.start == record.end &&
+                    action.start == action.end && action.end == record.start &&
+                    text.size() == 1 &&
+                    (record.text_size <= 1 || record.reversed);
+    if (!forward && !backward) {
+        return false;
+    }
+    // The top entry itself must never be removed to make room
+    std::size_t n = journal.size();
+    std::size_t entry = sizeof(Record) + record.text_size + sizeof(Footer);
+    if (entry + text.size() > budget) {
+        return false;
+    }
+    while (used + text.size() > n) {
+        pop_oldest();
+    }
+    std::size_t text_end = (tail + n - sizeof(Footer)) % n;
+    write(text_end, text.data(), text.size());
+    record.text_size += static_cast<uint32_t>(text.size());
+    if (forward) {
+        record.end = action.end;
     } else {
-        data[pos] = action;
+        // Text deleted backwards is appended, so it is stored reversed
+        record.start = action.start;
+        record.end = action.start;
+        record.reversed = true;
     }
-    pos = (pos + 1) % BOX_UNDO_BUFFER_SIZE;
+    entry += text.size();
+    Footer footer = static_cast<Footer>(entry);
+    write((text_end + text.size()) % n, &footer, sizeof(Footer));
+    write(entry_start, &record, sizeof(Record));
+    tail = (entry_start + entry) % n;
+    used += text.size();
+    return true;
 }
 
-EditAction& EditStack::top() {
-    return data[(pos + BOX_UNDO_BUFFER_SIZE - 1) % BOX_UNDO_BUFFER_SIZE];
+EditAction EditStack::pop(std::string &text) {
+    std::size_t entry_start;
+    Record record = top_record(entry_start);
+    text.resize(record.text_size);
+    read((entry_start + sizeof(Record)) % journal.size(), text.data(),
+         record.text_size);
+    if (record.reversed) {
+        std::reverse(text.begin(), text.end());
+    }
+    used -= sizeof(Record) + record.text_size + sizeof(Footer);
+    tail = entry_start;
+    --count;
+    return {record.start, record.end, record.chain};
 }
 
-EditAction EditStack::pop() {
-    --data_size;
-    EditAction res = std::move(top());
-    pos = (pos + BOX_UNDO_BUFFER_SIZE - 1) % BOX_UNDO_BUFFER_SIZE;
-    return res;
+// Max size of a single piece. Splitting a piece counts the newlines in it,
+// so this bounds the cost of a split.
+constexpr std::size_t MAX_PIECE_SIZE = 1024;
+
+constexpr int32_t NIL = -1;
+
+std::size_t TextBuffer::size() const {
+    return root == NIL ? 0 : nodes[root].size;
+}
+
+int64_t TextBuffer::line_count() const {
+    return (root == NIL ? 0 : nodes[root].newlines) + 1;
+}
+
+int64_t TextBuffer::count_newlines(std::size_t start, std::size_t size) const {
+    return static_cast<int64_t>(std::count(buffer.begin() + start,
+                                           buffer.begin() + start + size, '\n'));
 }
 
-EditLines::EditLines(int64_t max_rows, int64_t max_cols, void (*change_callback)(TextPosition start, TextPosition end, int64_t removed, void*), void* aux) : lines(1, ""),
+int32_t TextBuffer::new_node(Piece piece) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    Node node {piece, piece.size, piece.newlines, seed, NIL, NIL};
+    if (!free_nodes.empty()) {
+        int32_t ix = free_nodes.back();
+        free_nodes.pop_back();
+        nodes[ix] = node;
+        return ix;
+    }
+    nodes.push_back(node);
+    return static_cast<int32_t>(nodes.size() - 1);
+}
+
+void TextBuffer::free_tree(int32_t node) {
+    if (node == NIL) {
+        return;
+    }
+    free_tree(nodes[node].left);
+    free_tree(nodes[node].right);
+    free_nodes.push_back(node);
+}
+
+void TextBuffer::update(int32_t node) {
+    Node &n = nodes[node];
+    n.size = n.piece.size;
+    n.newlines = n.piece.newlines;
+    if (n.left != NIL) {
+        n.size += nodes[n.left].size;
+        n.newlines += nodes[n.left].newlines;
+    }
+    if (n.right != NIL) {
+        n.size += nodes[n.right].size;
+        n.newlines += nodes[n.right].newlines;
+    }
+}
+
+int32_t TextBuffer::merge(int32_t a, int32_t b) {
+    if (a == NIL) {
+        return b;
+    }
+    if (b == NIL) {
+        return a;
+    }
+    if (nodes[a].priority > nodes[b].priority) {
+        int32_t right = merge(nodes[a].right, b);
+        nodes[a].right = right;
+        update(a);
+        return a;
+    }
+    int32_t left = merge(a, nodes[b].left);
+    nodes[b].left = left;
+    update(b);
+    return b;
+}
+
+void TextBuffer::split(int32_t node, std::size_t offset, int32_t &left,
+                       int32_t &right) {
+    if (node == NIL) {
+        left = NIL;
+        right = NIL;
+        return;
+    }
+    std::size_t left_size =
+        nodes[node].left == NIL ? 0 : nodes[nodes[node].left].size;
+    std::size_t piece_size = nodes[node].piece.size;
+    int32_t l, r;
+    if (offset <= left_size) {
+        split(nodes[node].left, offset, l, r);
+        nodes[node].left = r;
+        update(node);
+        left = l;
+        right = node;
+    } else if (offset >= left_size + piece_size) {
+        split(nodes[node].right, offset - left_size - piece_size, l, r);
+        nodes[node].right = l;
+        update(node);
+        left = node;
+        right = r;
+    } else {
+        // Split inside the piece, the tail becomes a new node
+        Piece &piece = nodes[node].piece;
+        std::size_t head = offset - left_size;
+        int64_t head_newlines = count_newlines(piece.start, head);
+        Piece tail {piece.start + head, piece.size - head,
+                    piece.newlines - head_newlines};
+        piece.size = head;
+        piece.newlines = head_newlines;
+        int32_t tail_node = new_node(tail);
+        int32_t rest = nodes[node].right;
+        nodes[node].right = NIL;
+        update(node);
+        left = node;
+        right = merge(tail_node, rest);
+    }
+}
+
+bool TextBuffer::extend_last(int32_t node, Piece piece) {
+    if (node == NIL) {
+        return false;
+    }
+    Node &n = nodes[node];
+    bool extended;
+    if (n.right != NIL) {
+        extended = extend_last(n.right, piece);
+    } else if (n.piece.start + n.piece.size == piece.start &&
+               n.piece.size + piece.size <= MAX_PIECE_SIZE) {
+        n.piece.size += piece.size;
+        n.piece.newlines += piece.newlines;
+        extended = true;
+    } else {
+        extended = false;
+    }
+    if (extended) {
+        update(node);
+    }
+    return extended;
+}
+
+std::size_t TextBuffer::row_offset(int64_t row) const {
+    std::size_t base = 0;
+    int32_t node = root;
+    while (row > 0 && node != NIL) {
+        const Node &n = nodes[node];
+        int64_t left_newlines = n.left == NIL ? 0 : nodes[n.left].newlines;
+        if (row <= left_newlines) {
+            node = n.left;
+            continue;
+        }
+        row -= left_newlines;
+        base += n.left == NIL ? 0 : nodes[n.left].size;
+        if (row <= n.piece.newlines) {
+            std::size_t pos = n.piece.start;
+            while (true) {
+                if (buffer[pos] == '\n' && --row == 0) {
+                    return base + (pos - n.piece.start) + 1;
+                }
+                ++pos;
+            }
+        }
+        row -= n.piece.newlines;
+        base += n.piece.size;
+        node = n.right;
+    }
+    return base;
+}
+
+char TextBuffer::at(std::size_t offset) const {
+    int32_t node = root;
+    while (node != NIL) {
+        const Node &n = nodes[node];
+        std::size_t left_size = n.left == NIL ? 0 : nodes[n.left].size;
+        if (offset < left_size) {
+            node = n.left;
+        } else if (offset < left_size + n.piece.size) {
+            return buffer[n.piece.start + offset - left_size];
+        } else {
+            offset -= left_size + n.piece.size;
+            node = n.right;
+        }
+    }
+    return '\0';
+}
+
+TextSpan TextBuffer::append(const std::string &str) {
+    TextSpan span {buffer.size(), str.size()};
+    buffer += str;
+    return span;
+}
+
+void TextBuffer::release(TextSpan span) {
+    if (span.start + span.size == buffer.size()) {
+        buffer.resize(span.start);
+    }
+}
+
+std::string_view TextBuffer::view(TextSpan span) const {
+    return std::string_view{buffer}.substr(span.start, span.size);
+}
+
+void TextBuffer::insert(std::size_t offset, TextSpan span) {
+    if (span.size == 0) {
+        return;
+    }
+    int32_t left, right;
+    split(root, offset, left, right);
+    std::size_t pos = span.start;
+    std::size_t end = span.start + span.size;
+    if (span.size <= MAX_PIECE_SIZE) {
+        Piece piece {pos, span.size, count_newlines(pos, span.size)};
+        if (extend_last(left, piece)) {
+            root = merge(left, right);
+            return;
+        }
+    }
+    while (pos < end) {
+        std::size_t size = std::min(MAX_PIECE_SIZE, end - pos);
+        left = merge(left, new_node({pos, size, count_newlines(pos, size)}));
+        pos += size;
+    }
+    root = merge(left, right);
+}
+
+void TextBuffer::erase(std::size_t offset, std::size_t size) {
+    if (size == 0) {
+        return;
+    }
+    int32_t left, mid, right;
+    split(root, offset, left, right);
+    split(right, size, mid, right);
+    free_tree(mid);
+    root = merge(left, right);
+}
+
+void TextBuffer::extract(int32_t node, std::size_t offset, std::size_t size,
+                         std::string &out) const {
+    if (node == NIL || size == 0) {
+        return;
+    }
+    const Node &n = nodes[node];
+    std::size_t left_size = n.left == NIL ? 0 : nodes[n.left].size;
+    if (offset < left_size) {
+        std::size_t count = std::min(size, left_size - offset);
+        extract(n.left, offset, count, out);
+        size -= count;
+        offset = 0;
+    } else {
+        offset -= left_size;
+    }
+    if (size > 0 && offset < n.piece.size) {
+        std::size_t count = std::min(size, n.piece.size - offset);
+        out.append(buffer, n.piece.start + offset, count);
+        size -= count;
+        offset = 0;
+    } else if (offset >= n.piece.size) {
+        offset -= n.piece.size;
+    }
+    extract(n.right, offset, size, out);
+}
+
+void TextBuffer::extract(std::size_t offset, std::size_t size,
+                         std::string &out) const {
+    extract(root, offset, size, out);
+}
+
+EditLines::EditLines(int64_t max_rows, int64_t max_cols, void (*change_callback)(TextPosition start, TextPosition end, int64_t removed, void*), void* aux) :
+                                                   undo_stack{BOX_UNDO_BUFFER_SIZE},
+                                                   redo_stack{BOX_UNDO_BUFFER_SIZE},
                                                    max_rows{static_cast<std::size_t>(max_rows == -1 ? INT64_MAX : max_rows)},
                                                    max_cols{static_cast<std::size_t>(max_cols == -1 ? INT64_MAX : max_cols)},
                                                    change_callback{change_callback},
                                                    aux_data{aux}{}
 
 int64_t EditLines::line_size(int64_t row) const {
-    return static_cast<int64_t>(lines[row].size());
+    std::size_t start = text.row_offset(row);
+    if (row + 1 >= text.line_count()) {
+        return static_cast<int64_t>(text.size() - start);
+    }
+    return static_cast<int64_t>(text.row_offset(row + 1) - 1 - start);
 }
 
-void EditLines::delete_region(TextPosition start, TextPosition end) {
-    if (start >= end) {
-        return;
-    }
-    std::string first = lines[start.row];
-    first.erase(start.col);
-    std::string last = lines[end.row];
-    last.erase(0, end.col);
-    lines[start.row] = first + last;
-    for (int64_t ix = 0; ix < lines.size() - (end.row + 1); ++ix) {
-        lines[start.row + ix + 1] = lines[end.row + 1 + ix];
-    }
-    int64_t rem_lines = static_cast<int64_t>(lines.size()) - (end.row - start.row);
-    lines.resize(rem_lines);
+std::size_t EditLines::offset_of(TextPosition pos) const {
+    return text.row_offset(pos.row) + pos.col;
 }
 
-bool EditLines::insert_region(const std::string &str, TextPosition start, TextPosition end, EditAction &action) {
+bool EditLines::insert_region(TextSpan span, TextPosition start, TextPosition end, EditAction &action) {
+    // str is invalidated once the buffer grows, all checks are done first
+    std::string_view str = text.view(span);
     int64_t new_rows = static_cast<int64_t>(std::count(str.begin(), str.end(), '\n'));
-    if (lines.size() + new_rows - (end.row - start.row) > max_rows) {
+    if (static_cast<std::size_t>(line_count() + new_rows -
+                                 (end.row - start.row)) > max_rows) {
         // Would add too many lines
         return false;
     }
+    std::size_t start_offset = offset_of(start);
+    std::size_t end_offset = offset_of(end);
     if (new_rows == 0) {
-        std::string old = extract_region(start, end);
         bool split_delete = false;
         if (start.row == end.row) {
             if (str.size() + start.col + line_size(end.row) - end.col > max_cols) {
                 // The first line would become too long
                 return false;
             }
-            delete_region(start, end);
         } else if (str.size() + start.col > max_cols) {
             // The first line would become too long
             return false;
         }  else if (str.size() + start.col + line_size(end.row) - end.col > max_cols) {
-            delete_region(start, {start.row, line_size(start.row)});
-            delete_region({start.row + 1, 0}, end);
             split_delete = true;
-        } else {
-            delete_region(start, end);
         }
-        TextPosition start_pos = start;
-        std::string s = lines[start.row];
-        s.insert(start.col, str);
-        lines[start.row] = s;
-        start.col += static_cast<int64_t>(str.size());
+        removed.clear();
+        text.extract(start_offset, end_offset - start_offset, removed);
         if (split_delete) {
-            action = {start_pos, {start.row + 1, 0}, old};
+            // Keep the line break after the start row
+            std::size_t line_end = start_offset + line_size(start.row) - start.col;
+            text.erase(line_end + 1, end_offset - line_end - 1);
+            text.erase(start_offset, line_end - start_offset);
+            text.insert(start_offset, span);
+            action = {start, {start.row + 1, 0}};
         } else {
-            action = {start_pos, start, old};
+            text.erase(start_offset, end_offset - start_offset);
+            text.insert(start_offset, span);
+            action = {start, {start.row, start.col + static_cast<int64_t>(span.size)}};
         }
     } else {
         size_t ix = str.find('\n');
-        std::string first = str.substr(0, ix);
-        if (start.col + first.size() > max_cols) {
+        if (start.col + ix > max_cols) {
             return false;
         }
         size_t last_ix = str.rfind('\n');
-        std::string last = str.substr(last_ix + 1);
-        if (line_size(end.row) - end.col + last.size() > max_cols) {
+        size_t last_size = str.size() - last_ix - 1;
+        if (line_size(end.row) - end.col + last_size > max_cols) {
             return false;
         }
-        std::string rem = str.substr(ix + 1, last_ix - ix);
-        size_t offset = 0;
+        size_t offset = ix + 1;
         for (int64_t i = 0; i < new_rows - 1; ++i) {
-            size_t pos = rem.find('\n', offset);
+            size_t pos = str.find('\n', offset);
             if (pos - offset > max_cols) {
                 return false;
             }
             offset = pos + 1;
         }
-        std::string old = extract_region(start, end);
-        delete_region(start, end);
-        std::string s = lines[start.row];
-        std::string end_str = s.substr(start.col);
-        s.erase(start.col);
-        lines[start.row] = (s + first);
-        offset = 0;
-        for (int64_t i = 1; i <= new_rows; ++i) {
-            lines.insert(lines.begin() + start.row + i, "");
-        }
-        for (int64_t i = 1; i < new_rows; ++i) {
-            size_t pos = rem.find('\n', offset);
-            lines[start.row + i] = (rem.substr(offset, pos - offset));
-            offset = pos + 1;
-        }
-        TextPosition start_pos = start;
-        lines[start.row + new_rows] = (last + end_str);
-        start.row += new_rows;
-        start.col = static_cast<int64_t>(last.size());
-        action = {start_pos, start, old};
+        removed.clear();
+        text.extract(start_offset, end_offset - start_offset, removed);
+        text.erase(start_offset, end_offset - start_offset);
+        text.insert(start_offset, span);
+        action = {start, {start.row + new_rows, static_cast<int64_t>(last_size)}};
     }
+    lines_valid = false;
     return true;
 }
 
@@ -181,7 +528,7 @@ bool EditLines::move_left(TextPosition &pos, int64_t off) const {
 bool EditLines::move_right(TextPosition &pos, int64_t off) const {
     TextPosition old = pos;
     while (pos.col + off > line_size(pos.row)) {
-        if (pos.row == lines.size() - 1) {
+        if (pos.row == line_count() - 1) {
             pos = old;
             return false;
         }
@@ -207,8 +554,8 @@ void EditLines::set_cursor(TextPosition pos, bool select) {
     if (pos.row < 0) {
         pos.row = 0;
         pos.col = 0;
-    } else if (pos.row >= lines.size()) {
-        pos.row = static_cast<int64_t>(lines.size() - 1);
+    } else if (pos.row >= line_count()) {
+        pos.row = line_count() - 1;
         pos.col = line_size(pos.row);
     } else if (pos.col > line_size(pos.row)) {
         pos.col = line_size(pos.row);
@@ -246,9 +593,31 @@ const TextPosition &EditLines::get_selection_end() const {
 }
 
 const std::vector<std::string> &EditLines::get_lines() const {
+    if (!lines_valid) {
+        std::string all {};
+        text.extract(0, text.size(), all);
+        lines.clear();
+        std::size_t start = 0;
+        while (true) {
+            std::size_t pos = all.find('\n', start);
+            if (pos == std::string::npos) {
+                lines.emplace_back(all, start);
+                break;
+            }
+            lines.emplace_back(all, start, pos - start);
+            start = pos + 1;
+        }
+        lines_valid = true;
+    }
     return lines;
 }
 
+std::string EditLines::line(int64_t row) const {
+    std::string res {};
+    text.extract(text.row_offset(row), line_size(row), res);
+    return res;
+}
+
 void EditLines::set_selection(TextPosition start, TextPosition end, bool cursor_at_end) {
     if (end < start) {
         end = start;
@@ -268,8 +637,17 @@ void EditLines::clear_undo_stack() {
 }
 
 bool EditLines::insert_str(const std::string &str, EditType edit) {
+    TextSpan span = text.append(str);
+    if (!insert_span(span, edit)) {
+        text.release(span);
+        return false;
+    }
+    return true;
+}
+
+bool EditLines::insert_span(TextSpan span, EditType edit) {
     EditAction action;
-    if (!insert_region(str, selection_start, selection_end, action)) {
+    if (!insert_region(span, selection_start, selection_end, action)) {
         return false;
     }
     cursor_pos = action.end;
@@ -279,28 +657,21 @@ bool EditLines::insert_str(const std::string &str, EditType edit) {
         action.chain = true;
     }
     if (edit == EditType::UNDO) {
-        redo_stack.push(action);
+        redo_stack.push(action, removed);
     } else if (edit == EditType::REDO) {
-        undo_stack.push(action);
+        undo_stack.push(action, removed);
     } else if (edit != edit_action || edit == EditType::NONE) {
         redo_stack.clear();
-        undo_stack.push(action);
+        undo_stack.push(action, removed);
     } else {
         redo_stack.clear();
-        if (undo_stack.size() == 0) {
-            undo_stack.push(action);
-        } else {
-            if (undo_stack.top().end == action.start) {
-                undo_stack.top().end = action.end;
-                undo_stack.top().text += action.text;
-            } else {
-                undo_stack.push(action);
-            }
+        if (undo_stack.size() == 0 || !undo_stack.extend_top(action, removed)) {
+            undo_stack.push(action, removed);
         }
     }
     edit_action = edit;
     if (change_callback != nullptr) {
-        change_callback(action.start, action.end, static_cast<int64_t>(action.text.size()), aux_data);
+        change_callback(action.start, action.end, static_cast<int64_t>(removed.size()), aux_data);
     }
     return true;
 }
@@ -308,21 +679,12 @@ bool EditLines::insert_str(const std::string &str, EditType edit) {
 
 std::string EditLines::extract_region(TextPosition start,
                                       TextPosition end) const {
-    if (start == end) {
-        return "";
-    }
-    if (start.row == end.row) {
-        return lines[start.row].substr(start.col,
-                                                  end.col - start.col);
-    } else {
-        std::stringstream res{};
-        res << lines[start.row].substr(start.col);
-        for (int64_t row = start.row + 1; row < end.row; ++row) {
-            res << '\n' << lines[row];
-        }
-        res << '\n' << lines[end.row].substr(0, end.col);
-        return res.str();
+    std::string res {};
+    if (start < end) {
+        std::size_t start_offset = offset_of(start);
+        text.extract(start_offset, offset_of(end) - start_offset, res);
     }
+    return res;
 }
 std::string EditLines::extract_selection() const {
     return extract_region(selection_start, selection_end);
@@ -339,24 +701,27 @@ void EditLines::undo_action(bool redo) {
     }
     EditAction action;
     do {
-        action = stack.pop();
+        action = stack.pop(restored);
         selection_start = action.start;
         selection_end = action.end;
         cursor_pos = selection_start;
-        insert_str(action.text, edit);
-    } while (action.chain);
+        TextSpan span = text.append(restored);
+        if (!insert_span(span, edit)) {
+            text.release(span);
+        }
+    } while (action.chain && stack.size() > 0);
     edit_action = EditType::NONE;
 }
 
 int64_t EditLines::line_count() const {
-    return static_cast<int64_t>(lines.size());
+    return text.line_count();
 }
 
 char EditLines::char_at_pos(TextPosition pos) const {
     if (pos.col == line_size(pos.row)) {
         return '\n';
     }
-    return lines[pos.row].at(pos.col);
+    return text.at(offset_of(pos));
 }
 
 
@@ -421,6 +786,22 @@ int main() {
     ASSERT_EQ(lines.get_selection_end(), lines.get_cursor_pos())
     ASSERT_EQ(lines.has_selection(), false)
 
+    lines.set_selection({0, 4}, {1, 4}, true);
+    ASSERT_EQ(lines.extract_selection(), " is a test123456\nLine")
+    ASSERT_EQ(lines.insert_str(""), true)
+    ASSERT_EQ(lines.get_lines().size(), 1)
+    ASSERT_EQ(lines.get_lines()[0], "This 2")
+    ASSERT_EQ(lines.line(0), "This 2")
+    ASSERT_EQ(lines.char_at_pos({0, 5}), '2')
+
+    lines.undo_action(false);
+    ASSERT_EQ(lines.line_count(), 2)
+    ASSERT_EQ(lines.line(0), "This is a test123456")
+    ASSERT_EQ(lines.line(1), "Line 2")
+    lines.undo_action(true);
+    ASSERT_EQ(lines.line_count(), 1)
+    ASSERT_EQ(lines.line(0), "This 2")
+
 end:
 std::cout << passed_tests << " / " << test_ix << " tests passed" << std::endl;
 }
@@ -1,6 +1,7 @@
 #ifndef PROCASM_EDITLINES_H
 #define PROCASM_EDITLINES_H
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cstdint>
 
@@ -18,8 +19,118 @@ struct TextPosition {
     bool operator!=(const TextPosition& other) const;
 };
 
+/**
+ * A range of characters in the buffer of a TextBuffer.
+ **/
+struct TextSpan {
+    std::size_t start = 0;
+    std::size_t size = 0;
+};
+
+/**
+ * Piece table storing text as a balanced tree (treap) of spans into a single
+ * append-only buffer. Every node keeps the size and newline count of its
+ * subtree, making row lookups, inserts and erases O(log n).
+ * Text in the buffer is never modified, so spans stay valid for the
+ * lifetime of the TextBuffer.
+ **/
+class TextBuffer {
+public:
+    /**
+     * Returns the number of characters in the text.
+     **/
+    std::size_t size() const;
+
+    /**
+     * Returns the number of lines in the text, one more than the number
+     * of newlines.
+     **/
+    int64_t line_count() const;
+
+    /**
+     * Returns the offset of the first character of row.
+     **/
+    std::size_t row_offset(int64_t row) const;
+
+    /**
+     * Returns the character at offset.
+     **/
+    char at(std::size_t offset) const;
+
+    /**
+     * Appends str to the buffer, without adding it to the text.
+     *
+     * @return the span containing str.
+     **/
+    TextSpan append(const std::string &str);
+
+    /**
+     * Drops span from the buffer if it was the last one appended.
+     **/
+    void release(TextSpan span);
+
+    /**
+     * Returns the characters of span. Invalidated by append.
+     **/
+    std::string_view view(TextSpan span) const;
+
+    /**
+     * Inserts the characters of span into the text at offset.
+     **/
+    void insert(std::size_t offset, TextSpan span);
+
+    /**
+     * Removes [offset, offset + size) from the text.
+     **/
+    void erase(std::size_t offset, std::size_t size);
+
+    /**
+     * Appends [offset, offset + size) of the text to out.
+     **/
+    void extract(std::size_t offset, std::size_t size, std::string &out) const;
+
+private:
+    struct Piece {
+        std::size_t start, size;
+        int64_t newlines;
+    };
+
+    struct Node {
+        Piece piece;
+        // Total size and newlines of the subtree
+        std::size_t size;
+        int64_t newlines;
+        uint32_t priority;
+        int32_t left, right;
+    };
+
+    int32_t new_node(Piece piece);
+
+    void free_tree(int32_t node);
+
+    void update(int32_t node);
+
+    int32_t merge(int32_t a, int32_t b);
+
+    void split(int32_t node, std::size_t offset, int32_t &left, int32_t &right);
+
+    bool extend_last(int32_t node, Piece piece);
+
+    void extract(int32_t node, std::size_t offset, std::size_t size,
+                 std::string &out) const;
+
+    int64_t count_newlines(std::size_t start, std::size_t size) const;
+
+    std::string buffer {};
+    std::vector<Node> nodes {};
+    std::vector<int32_t> free_nodes {};
+    int32_t root = -1;
+    uint32_t seed = 0x9e3779b9;
+};
+
 /**
  * Struct representing a singe edit action performend on the text.
+ * The text deleted by the action is stored separately.
  **/
 struct EditAction {
     // Position of fist character inserted by this action.
@@ -27,18 +138,26 @@ struct EditAction {
     // Position after last character inserted by this action.
     TextPosition end {};
 
-    // The text deleted by this action.
-    std::string text {};
     // Boolean indicating that this action is grouped together with
     // the following action in a stack.
     bool chain = false;
 };
 
 /**
- * A finite size stack of actions.
+ * A stack of actions with a fixed memory budget. Actions and the text they
+ * deleted are stored as fixed size records in a single byte ring buffer,
+ * allocated once. Pushing an action that does not fit removes the oldest
+ * ones.
  **/
 class EditStack {
 public:
+    /**
+     * EditStack constructor.
+     *
+     * @param budget the max amount of bytes used by the stack.
+     **/
+    explicit EditStack(std::size_t budget);
+
     /**
      * Return the number of elements in the stack.
      **/
@@ -50,28 +169,59 @@ public:
     void clear();
 
     /**
-     * Push an action to the stack, potentialy removing the oldest one. 
+     * Push an action to the stack, potentialy removing the oldest ones.
+     * If the action does not fit in the budget, the stack is cleared.
      *
-     * @param action: the action to add 
+     * @param action: the action to add
+     * @param text: the text deleted by the action
      **/
-    void push(const EditAction& action);
+    void push(const EditAction& action, std::string_view text);
 
     /**
-     * Peek at the top of the stack. Undefined behaviour if stack is empty.
+     * Merges action into the top of the stack, if action continues it.
+     * That is either when action starts where the top action ends, or when
+     * both only deleted text and action ends where the top action starts,
+     * as with repeated backspace. Undefined behaviour if stack is empty.
      *
-     * @return the top element of the stack.
+     * @param action: the action to merge
+     * @param text: the text deleted by the action
+     * @return true if the action was merged.
      **/
-    EditAction& top();
+    bool extend_top(const EditAction& action, std::string_view text);
 
     /**
      * Pop the top element of the stack. Undefined behaviour if stack is empty.
      *
+     * @param text: set to the text deleted by the action.
      * @return the previous top element of the stack.
      */
-    EditAction pop();
+    EditAction pop(std::string& text);
 private:
-    unsigned pos {0}, data_size {0};
-    std::vector<EditAction> data {};
+    struct Record {
+        TextPosition start, end;
+        uint32_t text_size;
+        bool chain;
+        // True if the text is stored back to front
+        bool reversed;
+    };
+
+    // Record is followed by its text and the size of the whole entry
+    using Footer = uint32_t;
+
+    Record top_record(std::size_t& entry_start) const;
+
+    void write(std::size_t pos, const void* data, std::size_t size);
+
+    void read(std::size_t pos, void* data, std::size_t size) const;
+
+    bool reserve(std::size_t size);
+
+    void pop_oldest();
+
+    std::size_t budget;
+    std::vector<char> journal {};
+    std::size_t head {0}, tail {0}, used {0};
+    unsigned count {0};
 };
 
 /**
@@ -197,12 +347,22 @@ public:
     void set_selection(TextPosition start, TextPosition end, bool cursor_at_end);
 
     /**
-     * Gets the current content of all lines.
+     * Gets the current content of all lines. The lines are materialized
+     * from the text buffer on the first call after a change, prefer
+     * line and line_size when only a few lines are needed.
      *
      * @return the current state of the lines.
      **/
     const std::vector<std::string> &get_lines() const;
 
+    /**
+     * Gets the content of a single line.
+     *
+     * @param row the row to get.
+     * @return the content of the line.
+     **/
+    std::string line(int64_t row) const;
+
     /**
      * Extracts a string from the selection. Line breaks become '\n'.
      *
@@ -254,16 +414,23 @@ public:
      **/
     void clear_undo_stack();
 private:
-    void delete_region(TextPosition start, TextPosition end);
+    std::size_t offset_of(TextPosition pos) const;
 
     std::string extract_region(TextPosition start, TextPosition end) const;
 
-    bool insert_region(const std::string &str, TextPosition start, TextPosition end, EditAction& action);
+    bool insert_region(TextSpan span, TextPosition start, TextPosition end, EditAction& action);
+
+    bool insert_span(TextSpan span, EditType type);
 
     EditType edit_action {EditType::NONE};
 
-    EditStack undo_stack {};
-    EditStack redo_stack {};
+    EditStack undo_stack;
+    EditStack redo_stack;
+
+    // Text removed by the last insert_region and text restored by undo,
+    // reused to avoid allocating for every edit.
+    std::string removed {};
+    std::string restored {};
 
     TextPosition cursor_pos {};
 
@@ -271,7 +438,11 @@ private:
     TextPosition selection_end {};
     TextPosition selection_base {};
 
-    std::vector<std::string> lines {};
+    TextBuffer text {};
+
+    // Materialized lines returned by get_lines.
+    mutable std::vector<std::string> lines {};
+    mutable bool lines_valid {false};
 
     void (*change_callback)(TextPosition start, TextPosition end, int64_t removed, void*);
     void* aux_data;
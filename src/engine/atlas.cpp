@@ -0,0 +1,203 @@
+#include "atlas.h"
+#include "exceptions.h"
+#include "log.h"
+#include "stats.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+Sprite Sprite::from_texture(const Texture &texture) {
+    return {&texture, {0.0f, 0.0f, static_cast<float>(texture.get_width()),
+                       static_cast<float>(texture.get_height())}};
+}
+
+void TextureAtlas::add_image(const std::string &name, const std::string &path,
+                             int w, int h) {
+    std::unique_ptr<SDL_Surface, SurfaceDeleter> surface{IMG_Load(path.c_str())};
+    if (surface == nullptr) {
+        throw image_load_exception(std::string(SDL_GetError()));
+    }
+    if (w != -1 && h != -1 && (surface->w != w || surface->h != h)) {
+        std::unique_ptr<SDL_Surface, SurfaceDeleter> stretched{
+            SDL_CreateSurface(w, h, surface->format)};
+        if (stretched == nullptr) {
+            throw image_load_exception(std::string(SDL_GetError()));
+        }
+        SDL_BlitSurfaceScaled(surface.get(), nullptr, stretched.get(), nullptr,
+                              SDL_SCALEMODE_NEAREST);
+        surface = std::move(stretched);
+    }
+    pending.push_back({name, std::move(surface)});
+}
+
+void TextureAtlas::load_directory(const std::string &dir, int w, int h) {
+    int count = 0;
+    char **files = SDL_GlobDirectory(dir.c_str(), "*.png", 0, &count);
+    if (files == nullptr) {
+        throw image_load_exception(std::string(SDL_GetError()));
+    }
+    for (int i = 0; i < count; ++i) {
+        std::string file{files[i]};
+        std::string name = file.substr(0, file.rfind('.'));
+        add_image(name, dir + "/" + file, w, h);
+    }
+    SDL_free(files);
+}
+
+void TextureAtlas::build(int max_width) {
+    constexpr int PADDING = 1;
+
+    // Simple shelf packing, tallest images first.
+    std::sort(pending.begin(), pending.end(),
+              [](const Pending &a, const Pending &b) {
+                  return a.surface->h > b.surface->h;
+              });
+
+    std::vector<SDL_Rect> placement{};
+    placement.reserve(pending.size());
+    int x = 0, y = 0, shelf_h = 0, used_w = 0;
+    for (const auto &p : pending) {
+        int w = p.surface->w + PADDING, h = p.surface->h + PADDING;
+        if (x + w > max_width) {
+            x = 0;
+            y += shelf_h;
+            shelf_h = 0;
+        }
+        placement.push_back({x, y, p.surface->w, p.surface->h});
+        x += w;
+        shelf_h = std::max(shelf_h, h);
+        used_w = std::max(used_w, x);
+    }
+    int used_h = y + shelf_h;
+    if (used_w > max_width || used_h > max_width) {
+        throw image_load_exception("Atlas images do not fit in " +
+                                   std::to_string(max_width) + " pixels");
+    }
+    if (pending.empty()) {
+        return;
+    }
+
+    std::unique_ptr<SDL_Surface, SurfaceDeleter> atlas{
+        SDL_CreateSurface(used_w, used_h, SDL_PIXELFORMAT_RGBA32)};
+    if (atlas == nullptr) {
+        throw image_load_exception(std::string(SDL_GetError()));
+    }
+    for (std::size_t i = 0; i < pending.size(); ++i) {
+        SDL_SetSurfaceBlendMode(pending[i].surface.get(), SDL_BLENDMODE_NONE);
+        SDL_BlitSurface(pending[i].surface.get(), nullptr, atlas.get(),
+                        &placement[i]);
+    }
+    texture = Texture(atlas.get(), used_w, used_h);
+    LOG_DEBUG("Packed %d images into %dx%d atlas",
+              static_cast<int>(pending.size()), used_w, used_h);
+
+    for (std::size_t i = 0; i < pending.size(); ++i) {
+        const SDL_Rect &r = placement[i];
+        sprites[pending[i].name] = {
+            &texture, {static_cast<float>(r.x), static_cast<float>(r.y),
+                       static_cast<float>(r.w), static_cast<float>(r.h)}};
+    }
+    pending.clear();
+}
+
+bool TextureAtlas::contains(const std::string &name) const {
+    return sprites.count(name) > 0;
+}
+
+const Sprite &TextureAtlas::get(const std::string &name) const {
+    auto it = sprites.find(name);
+    if (it == sprites.end()) {
+        throw logic_exception("No atlas image named " + name);
+    }
+    return it->second;
+}
+
+void SpriteBatch::draw(const Sprite &sprite, float x, float y, int layer) {
+    draw(sprite, {x, y, sprite.src.w, sprite.src.h}, 0.0, {0xff, 0xff, 0xff, 0xff},
+         layer);
+}
+
+void SpriteBatch::draw(const Sprite &sprite, SDL_FRect dest, double angle,
+                       SDL_Color color, int layer) {
+    SDL_FColor c = {color.r / 255.0f, color.g / 255.0f, color.b / 255.0f,
+                    color.a / 255.0f};
+    float tw = static_cast<float>(sprite.texture->get_width());
+    float th = static_cast<float>(sprite.texture->get_height());
+    float u0 = sprite.src.x / tw, u1 = (sprite.src.x + sprite.src.w) / tw;
+    float v0 = sprite.src.y / th, v1 = (sprite.src.y + sprite.src.h) / th;
+
+    Quad q{layer, sprite.texture,
+           {{{dest.x, dest.y}, c, {u0, v0}},
+            {{dest.x + dest.w, dest.y}, c, {u1, v0}},
+            {{dest.x + dest.w, dest.y + dest.h}, c, {u1, v1}},
+            {{dest.x, dest.y + dest.h}, c, {u0, v1}}}};
+    if (angle != 0.0) {
+        float cx = dest.x + dest.w / 2, cy = dest.y + dest.h / 2;
+        float sin = static_cast<float>(std::sin(angle));
+        float cos = static_cast<float>(std::cos(angle));
+        for (auto &v : q.vertices) {
+            float dx = v.position.x - cx, dy = v.position.y - cy;
+            v.position = {cx + dx * cos - dy * sin, cy + dx * sin + dy * cos};
+        }
+    }
+    quads.push_back(q);
+}
+
+void SpriteBatch::draw(PositionedTexture &texture) {
+    draw(Sprite::from_texture(*texture.texture),
+         {static_cast<float>(texture.x), static_cast<float>(texture.y),
+          static_cast<float>(texture.texture->get_width()),
+          static_cast<float>(texture.texture->get_height())},
+         0.0, {texture.r, texture.g, texture.b, 0xff}, texture.index());
+}
+
+void SpriteBatch::fill_rect(SDL_FRect dest, SDL_Color color, int layer) {
+    SDL_FColor c = {color.r / 255.0f, color.g / 255.0f, color.b / 255.0f,
+                    color.a / 255.0f};
+    quads.push_back({layer, nullptr,
+                     {{{dest.x, dest.y}, c, {0.0f, 0.0f}},
+                      {{dest.x + dest.w, dest.y}, c, {0.0f, 0.0f}},
+                      {{dest.x + dest.w, dest.y + dest.h}, c, {0.0f, 0.0f}},
+                      {{dest.x, dest.y + dest.h}, c, {0.0f, 0.0f}}}});
+}
+
+std::size_t SpriteBatch::size() const { return quads.size(); }
+
+void SpriteBatch::flush() {
+    if (quads.empty()) {
+        return;
+    }
+    std::stable_sort(quads.begin(), quads.end(),
+                     [](const Quad &a, const Quad &b) {
+                         if (a.layer != b.layer) {
+                             return a.layer < b.layer;
+                         }
+                         return std::less<const Texture *>{}(a.texture,
+                                                             b.texture);
+                     });
+
+    std::size_t start = 0;
+    while (start < quads.size()) {
+        std::size_t end = start;
+        vertices.clear();
+        indices.clear();
+        // Extend the run while the texture stays the same, across layers.
+        while (end < quads.size() && quads[end].texture == quads[start].texture) {
+            int base = static_cast<int>(vertices.size());
+            vertices.insert(vertices.end(), std::begin(quads[end].vertices),
+                            std::end(quads[end].vertices));
+            for (int ix : {0, 1, 2, 0, 2, 3}) {
+                indices.push_back(base + ix);
+            }
+            ++end;
+        }
+        const Texture *texture = quads[start].texture;
+        SDL_RenderGeometry(gRenderer,
+                           texture == nullptr ? nullptr : texture->get_texture(),
+                           vertices.data(), static_cast<int>(vertices.size()),
+                           indices.data(), static_cast<int>(indices.size()));
+        gFrameStats.add_draw_calls();
+        start = end;
+    }
+    quads.clear();
+}
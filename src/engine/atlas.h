@@ -0,0 +1,132 @@
+#ifndef ENGINE_ATLAS_H
+#define ENGINE_ATLAS_H
+#include "engine.h"
+#include "texture.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * A rectangle within a texture, typically a region of a TextureAtlas.
+ */
+struct Sprite {
+    const Texture *texture = nullptr;
+    // Source rectangle in texture pixels.
+    SDL_FRect src{};
+
+    /**
+     * Creates a sprite covering all of texture.
+     */
+    static Sprite from_texture(const Texture &texture);
+};
+
+/**
+ * Packs many images into a single texture, so that everything drawn from it
+ * can be submitted in one draw call. Sprites returned by get point into the
+ * atlas, so the atlas can not be moved or copied.
+ */
+class TextureAtlas {
+public:
+    TextureAtlas() = default;
+
+    TextureAtlas(const TextureAtlas &other) = delete;
+    TextureAtlas &operator=(const TextureAtlas &other) = delete;
+    TextureAtlas(TextureAtlas &&other) = delete;
+    TextureAtlas &operator=(TextureAtlas &&other) = delete;
+
+    /**
+     * Queues the image at path to be packed under name, stretched to (w, h)
+     * unless w or h is -1. Throws an image_load_exception if loading fails.
+     */
+    void add_image(const std::string &name, const std::string &path,
+                   int w = -1, int h = -1);
+
+    /**
+     * Queues every png image in dir, named by file name without extension.
+     */
+    void load_directory(const std::string &dir, int w = -1, int h = -1);
+
+    /**
+     * Packs all queued images into the atlas texture. Throws an
+     * image_load_exception if they do not fit within max_width x max_width.
+     */
+    void build(int max_width = 1024);
+
+    /**
+     * Returns true if an image named name has been packed.
+     */
+    [[nodiscard]] bool contains(const std::string &name) const;
+
+    /**
+     * Gets the sprite of the image named name, throwing a logic_exception if
+     * there is none.
+     */
+    [[nodiscard]] const Sprite &get(const std::string &name) const;
+
+private:
+    struct Pending {
+        std::string name;
+        std::unique_ptr<SDL_Surface, SurfaceDeleter> surface;
+    };
+
+    std::vector<Pending> pending{};
+
+    std::unordered_map<std::string, Sprite> sprites{};
+
+    Texture texture{};
+};
+
+/**
+ * Collects textured quads for one frame and submits them with as few
+ * SDL_RenderGeometry calls as possible. Quads are ordered by layer, and
+ * within a layer grouped by texture, keeping submission order otherwise.
+ */
+class SpriteBatch {
+public:
+    /**
+     * Draws sprite with its upper left corner at (x, y).
+     */
+    void draw(const Sprite &sprite, float x, float y, int layer = 0);
+
+    /**
+     * Draws sprite stretched to dest, rotated by angle radians around the
+     * centre of dest and modulated by color.
+     */
+    void draw(const Sprite &sprite, SDL_FRect dest, double angle,
+              SDL_Color color, int layer = 0);
+
+    /**
+     * Draws a PositionedTexture, using its index as layer.
+     */
+    void draw(PositionedTexture &texture);
+
+    /**
+     * Draws an untextured rectangle.
+     */
+    void fill_rect(SDL_FRect dest, SDL_Color color, int layer = 0);
+
+    /**
+     * Renders and clears all queued quads.
+     */
+    void flush();
+
+    /**
+     * Returns the number of queued quads.
+     */
+    [[nodiscard]] std::size_t size() const;
+
+private:
+    struct Quad {
+        int layer;
+        const Texture *texture;
+        SDL_Vertex vertices[4];
+    };
+
+    std::vector<Quad> quads{};
+
+    std::vector<SDL_Vertex> vertices{};
+    std::vector<int> indices{};
+};
+
+#endif
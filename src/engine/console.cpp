@@ -0,0 +1,123 @@
+#include "console.h"
+#include "style.h"
+#include <algorithm>
+
+LogConsole::LogConsole(int x, int y, int w, int h, int row_height,
+                       std::size_t capacity)
+    : x(x), y(y), w(w), h(h), row_height(row_height),
+      columns(std::max(1, w / gGlyphs.advance())),
+      visible_rows(std::max(1, h / row_height)), capacity(capacity),
+      chars(capacity * columns), lengths(capacity, 0) {
+    set_text_color(UI_TEXT_COLOR);
+}
+
+void LogConsole::new_row() {
+    if (capacity == 0) {
+        return;
+    }
+    std::size_t ix;
+    if (count < capacity) {
+        ix = (head + count) % capacity;
+        ++count;
+    } else {
+        ix = head;
+        head = (head + 1) % capacity;
+    }
+    lengths[ix] = 0;
+    if (scroll_pos > 0 && scroll_pos + visible_rows < count) {
+        // Keep the view on the same rows while scrolled back
+        ++scroll_pos;
+    }
+    row_open = true;
+}
+
+void LogConsole::print(std::string_view text) {
+    if (capacity == 0) {
+        return;
+    }
+    for (char c : text) {
+        if (c == '\n') {
+            if (!row_open) {
+                new_row();
+            }
+            row_open = false;
+            continue;
+        }
+        std::size_t ix = (head + count - 1) % capacity;
+        if (!row_open || lengths[ix] == columns) {
+            new_row();
+            ix = (head + count - 1) % capacity;
+        }
+        chars[ix * columns + lengths[ix]] = c;
+        ++lengths[ix];
+    }
+    dirty = true;
+}
+
+void LogConsole::clear() {
+    head = 0;
+    count = 0;
+    row_open = false;
+    scroll_pos = 0;
+    dirty = true;
+}
+
+void LogConsole::scroll(int rows) {
+    std::size_t max_scroll =
+        count > static_cast<std::size_t>(visible_rows) ? count - visible_rows
+                                                        : 0;
+    if (rows < 0) {
+        std::size_t back = static_cast<std::size_t>(-rows);
+        scroll_pos = back > scroll_pos ? 0 : scroll_pos - back;
+    } else {
+        scroll_pos = std::min(scroll_pos + rows, max_scroll);
+    }
+    dirty = true;
+}
+
+void LogConsole::scroll_to_end() {
+    scroll_pos = 0;
+    dirty = true;
+}
+
+bool LogConsole::is_pressed(int x_pos, int y_pos) const {
+    return x_pos >= x && x_pos < x + w && y_pos >= y && y_pos < y + h;
+}
+
+std::size_t LogConsole::size() const { return count; }
+
+std::string_view LogConsole::row(std::size_t index) const {
+    std::size_t ix = (head + index) % capacity;
+    return {chars.data() + ix * columns, lengths[ix]};
+}
+
+void LogConsole::set_text_color(Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
+    color = {r, g, b, a};
+    dirty = true;
+}
+
+void LogConsole::layout() {
+    glyphs.clear();
+    glyph_generation = gGlyphs.generation();
+    std::size_t end = count - std::min(scroll_pos, count);
+    std::size_t start =
+        end > static_cast<std::size_t>(visible_rows) ? end - visible_rows : 0;
+    float text_offset = (row_height - gGlyphs.line_height()) / 2.0f;
+    for (std::size_t i = start; i < end; ++i) {
+        std::size_t first = glyphs.size();
+        gGlyphs.layout(row(i), 0, color, glyphs);
+        float row_y = static_cast<float>(i - start) * row_height + text_offset;
+        for (std::size_t v = first; v < glyphs.size(); ++v) {
+            glyphs[v].position.y += row_y;
+        }
+    }
+    dirty = false;
+}
+
+void LogConsole::render(int x_offset, int y_offset) {
+    if (dirty || glyph_generation != gGlyphs.generation()) {
+        layout();
+    }
+    gGlyphs.render(glyphs, static_cast<float>(x + x_offset),
+                   static_cast<float>(y + y_offset));
+}
@@ -0,0 +1,101 @@
+#ifndef ENGINE_CONSOLE_H
+#define ENGINE_CONSOLE_H
+#include "glyphs.h"
+#include <SDL3/SDL.h>
+#include <string_view>
+#include <vector>
+
+/**
+ * Scrollable text log backed by a fixed-capacity ring buffer of rows.
+ * All storage is allocated up front, so printing never allocates. When the
+ * buffer is full the oldest rows are overwritten. Only the visible rows are
+ * laid out, and only when the visible content changed.
+ */
+class LogConsole {
+public:
+    LogConsole() = default;
+
+    /**
+     * Creates a console covering (x, y, w, h), keeping at most capacity rows
+     * of history. Rows are row_height pixels high. Lines wider than the
+     * console are wrapped into several rows.
+     */
+    LogConsole(int x, int y, int w, int h, int row_height,
+               std::size_t capacity);
+
+    /**
+     * Appends text to the log. Newlines end the current row.
+     */
+    void print(std::string_view text);
+
+    /**
+     * Removes all rows.
+     */
+    void clear();
+
+    /**
+     * Scrolls by rows, positive values move back in history.
+     */
+    void scroll(int rows);
+
+    /**
+     * Scrolls to the newest row.
+     */
+    void scroll_to_end();
+
+    /**
+     * Returns true if (x, y) is within the console.
+     */
+    [[nodiscard]] bool is_pressed(int x, int y) const;
+
+    /**
+     * Returns the number of rows in the history.
+     */
+    [[nodiscard]] std::size_t size() const;
+
+    /**
+     * Returns the text of the row at index, 0 being the oldest row.
+     */
+    [[nodiscard]] std::string_view row(std::size_t index) const;
+
+    void set_text_color(Uint8 r, Uint8 g, Uint8 b, Uint8 a);
+
+    void render(int x_offset, int y_offset);
+
+private:
+    /**
+     * Starts a new, empty row, overwriting the oldest one if full.
+     */
+    void new_row();
+
+    /**
+     * Lays out the visible rows into glyphs.
+     */
+    void layout();
+
+    int x{}, y{}, w{}, h{};
+    int row_height{};
+    int columns{};
+    int visible_rows{};
+
+    std::size_t capacity{};
+    std::vector<char> chars{};
+    std::vector<Uint16> lengths{};
+    std::size_t head = 0;
+    std::size_t count = 0;
+
+    // True while the last row has not been ended by a newline.
+    bool row_open = false;
+
+    // Number of rows scrolled back from the newest row.
+    std::size_t scroll_pos = 0;
+
+    SDL_Color color = {0, 0, 0, 0};
+
+    bool dirty = true;
+    std::vector<SDL_Vertex> glyphs{};
+    // Glyph atlas generation the glyphs were laid out for.
+    Uint64 glyph_generation = 0;
+};
+
+#endif
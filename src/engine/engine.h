@@ -3,7 +3,7 @@
 #include <SDL3/SDL.h>
 #include <SDL3_ttf/SDL_ttf.h>
 #include "events.h"
-#include <random>
+#include "random.h"
 
 // Global renderer variable
 extern SDL_Renderer *gRenderer;
@@ -19,7 +19,8 @@ struct SurfaceDeleter {
     void operator()(SDL_Surface *s) { SDL_DestroySurface(s); }
 };
 
-extern std::minstd_rand generator;
+// Global random stream, only to be used from the main thread
+extern Rng generator;
 namespace engine {
 
     void init();
@@ -33,8 +34,8 @@ namespace engine {
 
     template<class T>
     T random(const T min, const T max) {
-        if (min >= max) return min;
-        return (static_cast<T>(generator()) % (max - min)) + min;
+        return static_cast<T>(generator.range(static_cast<int64_t>(min),
+                                              static_cast<int64_t>(max)));
     }
 }; // namespace engine
 
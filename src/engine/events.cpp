@@ -1,6 +1,10 @@
 #include "events.h"
 #include "exceptions.h"
 #include "log.h"
+#include <cstring>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 
 template <> uint64_t EventInfo::get() { return u; }
@@ -35,33 +39,56 @@ template <> void EventInfo::set(int16_t t) { i = t; }
     
 template <> void EventInfo::set(int8_t t) { i = t; }
 
+static int count_trailing_zeros(uint64_t v) {
+#ifdef _MSC_VER
+    unsigned long ix;
+    _BitScanForward64(&ix, v);
+    return static_cast<int>(ix);
+#else
+    return __builtin_ctzll(v);
+#endif
+}
+
 EventScope::EventScope(Events *events) : events{events} {}
 
 EventScope::EventScope(EventScope &&other) noexcept
-    : events{other.events}, cb_indicies{std::move(other.cb_indicies)},
-      aux_indicies{std::move(other.aux_indicies)} {
+    : finalized{other.finalized}, events{other.events}, depth{other.depth},
+      cb_handles{std::move(other.cb_handles)},
+      aux_handles{std::move(other.aux_handles)},
+      evt_handles{std::move(other.evt_handles)} {
     other.events = nullptr;
+    if (events != nullptr && !finalized) {
+        events->scopes[depth] = this;
+    }
 }
 
 EventScope& EventScope::operator=(EventScope&& other) noexcept {
     if (this == &other) {
         return *this;
     }
+    std::swap(finalized, other.finalized);
     std::swap(events, other.events);
-    std::swap(aux_indicies, other.aux_indicies);
-    std::swap(cb_indicies, other.cb_indicies);
+    std::swap(depth, other.depth);
+    std::swap(aux_handles, other.aux_handles);
+    std::swap(cb_handles, other.cb_handles);
+    std::swap(evt_handles, other.evt_handles);
+    if (events != nullptr && !finalized) {
+        events->scopes[depth] = this;
+    }
+    if (other.events != nullptr && !other.finalized) {
+        other.events->scopes[other.depth] = &other;
+    }
     return *this;
 }
 
-void EventScope::add_callback(event_t event, std::size_t ix) {
-    cb_indicies.push_front(ix);
-    cb_indicies.push_front(event);
+void EventScope::add_callback(event_t event, callback_t callback) {
+    cb_handles.emplace_back(event, callback);
 }
 
-void EventScope::add_aux(std::size_t ix) { aux_indicies.push_front(ix); }
+void EventScope::add_aux(slot_handle_t aux) { aux_handles.push_back(aux); }
 
 void EventScope::add_event(event_t event) {
-    evt_indicies.push_front(event);
+    evt_handles.push_back(event);
 }
 
 void EventScope::finalize() {
@@ -72,21 +99,15 @@ EventScope::~EventScope() {
     if (events == nullptr) {
         return;
     }
-    auto stamp = SDL_GetTicks();
-    auto it = cb_indicies.begin();
-    while (it != cb_indicies.end()) {
-        event_t evt = *it;
-        ++it;
-        std::size_t ix = *it;
-        ++it;
-        events->remove_callback(evt, ix);
+    for (auto [evt, cb] : cb_handles) {
+        events->remove_callback(evt, cb);
     }
 
-    for (std::size_t aux : aux_indicies) {
+    for (slot_handle_t aux : aux_handles) {
         events->remove_aux(aux);
     }
 
-    for (event_t evt: evt_indicies) {
+    for (event_t evt: evt_handles) {
         events->remove_event(evt);
     }
     if (!finalized) {
@@ -94,27 +115,34 @@ EventScope::~EventScope() {
     }
 }
 
-Events::Events() noexcept : events{{EventType::EMPTY}}, scopes{} {
+Events::Events() noexcept : scopes{} {
     root_scope = begin_scope();
     root_scope->finalize();
 }
 
 std::unique_ptr<EventScope> Events::begin_scope() {
     auto ptr = std::make_unique<EventScope>(this);
+    ptr->depth = scopes.size();
     scopes.emplace_back(ptr.get());
     return ptr;
 }
 
 void Events::end_scope(EventScope *ptr) {
-    for (int64_t i = scopes.size() - 1; i >= 0; --i) {
-        if (scopes[i] == ptr) {
-            LOG_WARNING("End scope called");
-
-            scopes.erase(scopes.begin() + i);
-            return;
-        }
+    if (ptr->depth >= scopes.size() || scopes[ptr->depth] != ptr) {
+        LOG_WARNING("Invalid scope end");
+        return;
+    }
+    LOG_WARNING("End scope called");
+    if (ptr->depth + 1 == scopes.size()) {
+        scopes.pop_back();
+        return;
+    }
+    // Ended below the top of the stack, the scopes above it now
+    // register into the scope below.
+    scopes.erase(scopes.begin() + static_cast<std::ptrdiff_t>(ptr->depth));
+    for (std::size_t i = ptr->depth; i < scopes.size(); ++i) {
+        scopes[i]->depth = i;
     }
-    LOG_WARNING("Invalid scope end");
 }
 
 void Events::finalize_scope() {
@@ -127,189 +155,321 @@ void Events::finalize_scope() {
 }
 
 event_t Events::register_event(EventType type, int vector_size) {
-    event_t id = free_ix;
-    LOG_DEBUG("Event %u registered", id);
-    ++free_ix;
-    for (; free_ix < events.size(); ++free_ix) {
-        if (events[free_ix].type == EventType::EMPTY) {
-            break;
-        }
-    }
-    if (id > last_ix) {
-        last_ix = id;
-    }
-    if (id == events.size()) {
-        events.resize(id + 1);
-    }
-    events[id] = {type};
+    EventData data{type};
     if (type == EventType::UNIFIED_VEC) {
         if (vector_size <= 1) {
-            events[id].type = EventType::UNIFIED;
+            data.type = EventType::UNIFIED;
         } else {
-            events[id].buffer.resize(vector_size);
-            for (auto &e : events[id].buffer) {
-                e.u = 0;
-            }
+            data.bit_count = vector_size;
+            data.bits.resize((data.bit_count + 63) / 64, 0);
         }
     }
+    event_t id = events.insert(std::move(data));
+    LOG_DEBUG("Event %llu registered", static_cast<unsigned long long>(id));
     scopes.back()->add_event(id);
     return id;
 }
 
-void Events::register_callback(event_t id, void (*callback)(EventInfo, void *),
-                               void *aux) {
-    scopes.back()->add_callback(id, events[id].free_ix);
-    LOG_DEBUG("Event %d callback added at %d", id, events[id].free_ix);
-    if (events[id].free_ix == events[id].callbacks.size()) {
-        events[id].callbacks.push_back({callback, aux});
-        events[id].last_ix = events[id].free_ix;
-        ++events[id].free_ix;
-    } else {
-        events[id].callbacks[events[id].free_ix] = {callback, aux};
-        if (events[id].free_ix > events[id].last_ix) {
-            events[id].last_ix = events[id].free_ix;
-        }
-        std::size_t ix = events[id].free_ix + 1;
-        for (; ix < events[id].callbacks.size(); ++ix) {
-            if (events[id].callbacks[ix].callback == nullptr) {
-                break;
-            }
-        }
-        events[id].free_ix = ix;
+event_t Events::register_queue(std::size_t size, std::size_t capacity) {
+    if (capacity == 0) {
+        throw base_exception("Event queue without capacity");
     }
+    event_t id = register_event(EventType::QUEUED);
+    constexpr std::size_t align = alignof(std::max_align_t);
+    std::size_t slots = (size + align - 1) / align;
+    auto queue = std::make_unique<EventQueue>();
+    queue->slot_size = slots * align;
+    queue->capacity = capacity;
+    queue->data = std::make_unique<std::max_align_t[]>(slots * capacity);
+    events.get(id)->queue = std::move(queue);
+    return id;
+}
+
+void *Events::EventQueue::slot(std::size_t ix) const {
+    return reinterpret_cast<char *>(data.get()) +
+           ((head + ix) % capacity) * slot_size;
+}
+
+bool Events::queue_event(event_t id, const void *payload, std::size_t size) {
+    EventData *event = events.get(id);
+    if (event == nullptr || event->type != EventType::QUEUED ||
+        size > event->queue->slot_size) {
+        LOG_WARNING("Invalid payload queued for event %llu",
+                    static_cast<unsigned long long>(id));
+        return false;
+    }
+    EventQueue *queue = event->queue.get();
+    std::lock_guard<std::mutex> guard{queue->lock};
+    if (queue->count == queue->capacity) {
+        return false;
+    }
+    std::memcpy(queue->slot(queue->count), payload, size);
+    ++queue->count;
+    return true;
+}
+
+callback_t Events::register_callback(event_t id,
+                                     void (*callback)(EventInfo, void *),
+                                     void *aux) {
+    EventData *event = events.get(id);
+    if (event == nullptr) {
+        throw base_exception("Callback registered for removed event");
+    }
+    callback_t cb = event->callbacks.insert({callback, aux});
+    scopes.back()->add_callback(id, cb);
+    return cb;
 }
 
 void Events::notify_event(event_t id, EventInfo data) {
-    switch (events[id].type) {
+    EventData *event = events.get(id);
+    if (event == nullptr) {
+        LOG_WARNING("Removed event %llu called",
+                    static_cast<unsigned long long>(id));
+        return;
+    }
+    switch (event->type) {
     case EventType::IMMEDIATE:
-        for (auto &cb : events[id].callbacks) {
-            cb.callback(data, cb.aux);
-        }
+        dispatch(id, data);
         return;
     case EventType::DELAYED:
-        events[id].buffer.push_back(data);
+        event->buffer.push_back(data);
         return;
     case EventType::UNIFIED:
-        events[id].data = data;
-        events[id].triggered = true;
+        event->data = data;
+        event->triggered = true;
         return;
     case EventType::UNIFIED_VEC:
-        events[id].buffer[data.u].u = 1;
-        events[id].triggered = true;
+        if (data.u >= event->bit_count) {
+            LOG_WARNING("Out of bounds data for event %llu",
+                        static_cast<unsigned long long>(id));
+            return;
+        }
+        event->bits[data.u / 64] |= uint64_t{1} << (data.u % 64);
+        event->triggered = true;
+        return;
+    case EventType::QUEUED:
+        LOG_WARNING("Queued event %llu notified, use queue_event",
+                    static_cast<unsigned long long>(id));
         return;
     case EventType::EMPTY:
-        LOG_WARNING("Empty event %d called", id);
+        LOG_WARNING("Empty event %llu called",
+                    static_cast<unsigned long long>(id));
         return;
     }
 }
 
 void Events::add_aux(WrapperBase *aux) {
-    scopes.back()->add_aux(free_aux);
-    if (free_aux == aux_data.size()) {
-        aux_data.emplace_back(aux);
-        ++free_aux;
-    } else {
-        aux_data[free_aux].reset(aux);
-        ++free_aux;
-        for (; free_aux < aux_data.size(); ++free_aux) {
-            if (aux_data[free_aux] == nullptr) {
-                break;
-            }
-        }
-    }
+    scopes.back()->add_aux(aux_data.insert(std::unique_ptr<WrapperBase>{aux}));
 }
 
-void null_callback(EventInfo, void*) {}
-
 void Events::remove_event(event_t event) {
-    LOG_DEBUG("Removing event %d", event);
-    if (event <= 0 || event >= events.size()) {
-        LOG_WARNING("Out of bounds event removed");
-        return;
-    }
-    events[event].type = EventType::EMPTY;
-    events[event].buffer.clear();
-    events[event].callbacks.clear();
-    if (event < free_ix) {
-        free_ix = event;
-    }
-    if (event == last_ix) {
-        int64_t i = event - 1;
-        for (; i >= 1; --i) {
-            if (events[i].type != EventType::EMPTY) {
-                break;
-            }
-        }
-        last_ix = i;
-        events.resize(i + 1);
-    }
+    LOG_DEBUG("Removing event %llu", static_cast<unsigned long long>(event));
+    events.erase(event);
 }
 
-void Events::remove_callback(event_t event, std::size_t ix) {
-    LOG_DEBUG("Removing event %d callback %d", event, ix);
-    if (event <= 0 || event >= events.size()) {
-        LOG_WARNING("Out of bounds event callback removed");
-        return;
-    }
-    if (events[event].callbacks.size() <= ix) {
-        LOG_WARNING("Out of bounds event callback removed");
-        return;
-    }
-    if (events[event].type == EventType::EMPTY) {
-        LOG_WARNING("Removing callback from empty event");
-        return;
-    }
-    events[event].callbacks[ix].callback = null_callback;
-    events[event].callbacks[ix].aux = nullptr;
-    if (ix < events[event].free_ix) {
-        events[event].free_ix = ix;
-    }
-    if (ix == events[event].last_ix) {
-        int64_t i = ix - 1;
-        for (; i >= 0; --i) {
-            if (events[event].callbacks[i].callback != null_callback) {
-                break;
-            }
-        }
-        events[event].last_ix = i;
-        events[event].callbacks.resize(i + 1);
+void Events::remove_callback(event_t event, callback_t callback) {
+    EventData *data = events.get(event);
+    if (data != nullptr) {
+        data->callbacks.erase(callback);
     }
 }
 
-void Events::remove_aux(std::size_t ix) {
-    LOG_DEBUG("Removing aux %d", ix);
-    aux_data[ix].reset();
-    if (ix < free_aux) {
-        free_aux = ix;
+void Events::remove_aux(slot_handle_t aux) {
+    aux_data.erase(aux);
+}
+
+bool Events::dispatch(event_t id, EventInfo data) {
+    // The event is looked up again for every callback, since a callback
+    // can move it by registering events, or remove it and let another
+    // event take its slot.
+    for (std::size_t cb = 0;; ++cb) {
+        EventData *event = events.get(id);
+        if (event == nullptr) {
+            return false;
+        }
+        if (cb >= event->callbacks.slot_count()) {
+            return true;
+        }
+        const CallbackData *callback = event->callbacks.slot(cb);
+        if (callback != nullptr) {
+            CallbackData copy = *callback;
+            copy.callback(data, copy.aux);
+        }
     }
 }
 
 void Events::handle_events() {
-    for (auto event = events.begin() + 1; event != events.end(); ++event) {
+    for (std::size_t ix = 0; ix < events.slot_count(); ++ix) {
+        EventData *event = events.slot(ix);
+        if (event == nullptr) {
+            continue;
+        }
+        // Every dispatch may remove the event, so it is looked up again by
+        // handle after each one
+        event_t id = events.handle(ix);
         if (event->type == EventType::UNIFIED && event->triggered) {
-            for (auto &cb : event->callbacks) {
-                cb.callback(event->data, cb.aux);
-            }
             event->triggered = false;
-        } else if (event->type == EventType::DELAYED) {
-            for (EventInfo data : event->buffer) {
-                for (auto &cb : event->callbacks) {
-                    cb.callback(data, cb.aux);
-                }
+            dispatch(id, event->data);
+        } else if (event->type == EventType::DELAYED &&
+                   !event->buffer.empty()) {
+            std::swap(event->buffer, event->dispatching);
+            std::size_t count = event->dispatching.size();
+            bool alive = true;
+            for (std::size_t i = 0; alive && i < count; ++i) {
+                alive = dispatch(id, events.get(id)->dispatching[i]);
+            }
+            if (alive) {
+                events.get(id)->dispatching.clear();
             }
-            event->buffer.clear();
         } else if (event->type == EventType::UNIFIED_VEC && event->triggered) {
-            for (uint64_t i = 0; i < event->buffer.size(); ++i) {
-                if (event->buffer[i].u != 0) {
-                    event->buffer[i].u = 0;
+            event->triggered = false;
+            bool alive = true;
+            for (std::size_t w = 0;
+                 alive && w < events.get(id)->bits.size(); ++w) {
+                // Bits set by the callbacks in this word are left for the
+                // next time.
+                uint64_t word = events.get(id)->bits[w];
+                events.get(id)->bits[w] = 0;
+                while (alive && word != 0) {
                     EventInfo data {};
-                    data.u = i;
-                    for (auto &cb : event->callbacks) {
-                        cb.callback(data, cb.aux);
-                    }
+                    data.u = w * 64 + count_trailing_zeros(word);
+                    word &= word - 1;
+                    alive = dispatch(id, data);
                 }
             }
-            event->triggered = false;
+        } else if (event->type == EventType::QUEUED) {
+            EventQueue *queue = event->queue.get();
+            std::size_t count;
+            {
+                std::lock_guard<std::mutex> guard{queue->lock};
+                count = queue->count;
+            }
+            // Producers only write past count, so the slots can be read
+            // without holding the lock. They are released afterwards.
+            bool alive = true;
+            for (std::size_t i = 0; alive && i < count; ++i) {
+                EventInfo data{};
+                data.ptr = queue->slot(i);
+                alive = dispatch(id, data);
+            }
+            if (alive) {
+                std::lock_guard<std::mutex> guard{queue->lock};
+                queue->head = (queue->head + count) % queue->capacity;
+                queue->count -= count;
+            }
+        }
+    }
+}
+
+#ifdef EVENTS_BENCH
+#include <chrono>
+#include <iostream>
+
+static void bench_callback(uint64_t, int *count) { ++*count; }
+
+static void empty_callback(EventInfo, void *) {}
+
+int main() {
+    constexpr int CALLBACKS = 100000;
+    using clock = std::chrono::steady_clock;
+    Events events;
+    event_t evt = events.register_event(EventType::IMMEDIATE);
+    int count = 0;
+
+    for (int round = 0; round < 5; ++round) {
+        auto start = clock::now();
+        auto scope = events.begin_scope();
+        for (int i = 0; i < CALLBACKS; ++i) {
+            events.register_callback(evt, bench_callback, &count);
+        }
+        events.finalize_scope();
+        auto registered = clock::now();
+        events.notify_event(evt, EventInfo{});
+        auto notified = clock::now();
+        scope.reset();
+        auto freed = clock::now();
+
+        auto us = [](clock::time_point a, clock::time_point b) {
+            return std::chrono::duration_cast<std::chrono::microseconds>(b - a)
+                .count();
+        };
+        std::cout << "Register " << us(start, registered) << " us, notify "
+                  << us(registered, notified) << " us, free scope "
+                  << us(notified, freed) << " us" << std::endl;
+    }
+
+    // Interleaved register / remove, as when menus open and close
+    std::vector<callback_t> handles;
+    auto start = clock::now();
+    for (int i = 0; i < CALLBACKS; ++i) {
+        handles.push_back(
+            events.register_callback(evt, empty_callback, nullptr));
+        if (i % 2 == 1) {
+            events.remove_callback(evt, handles[i / 2]);
+        }
+    }
+    auto end = clock::now();
+    std::cout << "Churn "
+              << std::chrono::duration_cast<std::chrono::microseconds>(end -
+                                                                       start)
+                     .count()
+              << " us" << std::endl;
+
+    bool ok = count == 5 * CALLBACKS;
+    events.notify_event(evt, EventInfo{});
+
+    // Per entity events, thousands each tick
+    constexpr int ENTITIES = 10000, TICKS = 1000, PER_TICK = 4000;
+    event_t vec_evt = events.register_event(EventType::UNIFIED_VEC, ENTITIES);
+    struct Delayed {
+        Events *events;
+        event_t id;
+        uint64_t handled;
+    } delayed{&events, events.register_event(EventType::DELAYED), 0};
+    uint64_t vec_sum = 0;
+    events.register_callback(
+        vec_evt, [](EventInfo i, void *sum) { *static_cast<uint64_t *>(sum) += i.u; },
+        &vec_sum);
+    events.register_callback(
+        delayed.id,
+        [](EventInfo i, void *aux) {
+            auto *d = static_cast<Delayed *>(aux);
+            ++d->handled;
+            if (i.u % 8 == 0) {
+                // Queued for the next tick
+                EventInfo next{};
+                next.u = i.u + 1;
+                d->events->notify_event(d->id, next);
+            }
+        },
+        &delayed);
+    uint64_t expected_sum = 0;
+    uint32_t seed = 12345;
+    start = clock::now();
+    for (int tick = 0; tick < TICKS; ++tick) {
+        std::vector<bool> seen(ENTITIES, false);
+        for (int i = 0; i < PER_TICK; ++i) {
+            seed = seed * 1664525 + 1013904223;
+            uint64_t ix = (seed >> 8) % ENTITIES;
+            if (!seen[ix]) {
+                seen[ix] = true;
+                expected_sum += ix;
+            }
+            events.notify_event(vec_evt, ix);
+            events.notify_event(delayed.id, ix);
         }
+        events.handle_events();
     }
+    end = clock::now();
+    std::cout << "Stress " << TICKS << " ticks, "
+              << std::chrono::duration_cast<std::chrono::microseconds>(end -
+                                                                       start)
+                         .count() / TICKS
+              << " us per tick, " << delayed.handled << " delayed events"
+              << std::endl;
+    ok = ok && vec_sum == expected_sum;
+
+    std::cout << (ok ? "ok" : "callback count mismatch") << std::endl;
+    return ok ? 0 : 1;
 }
+#endif
@@ -1,22 +1,32 @@
 #ifndef ENGINE_ENVENT_H
 #define ENGINE_ENVENT_H
+#include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <mutex>
 #include <tuple>
+#include <type_traits>
 #include <vector>
-#include <forward_list>
+#include "slotmap.h"
 
 enum class EventType {
     EMPTY,
     IMMEDIATE,  // Event triggers callaback instantly
     DELAYED,    // Event triggers callback after tick
     UNIFIED,    // Event triggers one callback for all changes this tick
-    UNIFIED_VEC // Event triggers one callback for each unique data
+    UNIFIED_VEC, // Event triggers one callback for each unique data, an
+                 // index below the vector size given on registration
+    QUEUED      // Event carries a typed payload, queued from any thread and
+                // triggering callbacks in handle_events
 };
 
-typedef uint32_t event_t;
+// Generation-checked handle of an event, see SlotMap
+typedef slot_handle_t event_t;
 
-constexpr event_t NULL_EVENT = 0;
+// Generation-checked handle of a callback of an event
+typedef slot_handle_t callback_t;
+
+constexpr event_t NULL_EVENT = NULL_SLOT;
 
 union EventInfo {
     int64_t i;
@@ -86,9 +96,9 @@ public:
 private:
     friend class Events;
 
-    void add_callback(event_t event, std::size_t ix);
+    void add_callback(event_t event, callback_t callback);
 
-    void add_aux(std::size_t ix);
+    void add_aux(slot_handle_t aux);
 
     void add_event(event_t event);
 
@@ -96,10 +106,14 @@ private:
 
     bool finalized = false;
     Events* events {nullptr};
-
-    std::forward_list<std::size_t> cb_indicies {};
-    std::forward_list<std::size_t> aux_indicies {};
-    std::forward_list<event_t> evt_indicies {};
+    // Position in the scope stack of events while not finalized
+    std::size_t depth = 0;
+
+    // Everything registered in the scope, freed together when it ends.
+    // Handles already removed in other ways are skipped.
+    std::vector<std::pair<event_t, callback_t>> cb_handles {};
+    std::vector<slot_handle_t> aux_handles {};
+    std::vector<event_t> evt_handles {};
 };
 
 class Events {
@@ -113,11 +127,43 @@ public:
 
     event_t register_event(EventType type, int vector_size = -1);
 
-    void register_callback(event_t id, void (*callback)(EventInfo, void *),
-                           void *aux);
+    /**
+     * Registers a QUEUED event with payloads of type T. Payloads are copied
+     * into a ring buffer of capacity elements, allocated here, so queueing
+     * never allocates. Callbacks receive a const T* to the payload, valid
+     * until the callback returns. Events must not be registered or removed
+     * while another thread is queueing.
+     */
+    template <class T>
+    event_t register_queue(std::size_t capacity) {
+        static_assert(std::is_trivially_copyable_v<T>,
+                      "Queued payloads must be trivially copyable");
+        static_assert(alignof(T) <= alignof(std::max_align_t),
+                      "Queued payloads must not be over-aligned");
+        return register_queue(sizeof(T), capacity);
+    }
+
+    /**
+     * Queues a payload for a QUEUED event. Safe to call from any thread.
+     * Returns false if the queue is full.
+     */
+    template <class T>
+    bool queue_event(event_t id, const T &payload) {
+        static_assert(std::is_trivially_copyable_v<T>,
+                      "Queued payloads must be trivially copyable");
+        return queue_event(id, &payload, sizeof(T));
+    }
+
+    /**
+     * Registers a callback for event id, owned by the current scope.
+     * Returns a handle that can be passed to remove_callback.
+     */
+    callback_t register_callback(event_t id,
+                                 void (*callback)(EventInfo, void *),
+                                 void *aux);
 
     template <class T, class... Args>
-    void register_callback(event_t id, void (*callback)(T, Args...), Args... args) {
+    callback_t register_callback(event_t id, void (*callback)(T, Args...), Args... args) {
         struct Wrapper : public WrapperBase {
             explicit Wrapper(Args... args, void (*cb)(T, Args...))
                 : args{args...}, cb{cb} {}
@@ -130,11 +176,11 @@ public:
             Wrapper &w = *reinterpret_cast<Wrapper *>(aux);
             w.cb(i.get<T>(), std::get<Args>(w.args)...);
         };
-        register_callback(id, call, aux);
+        return register_callback(id, call, aux);
     }
 
     template <class... Args>
-    void register_callback(event_t id, void (*callback)(Args...), Args... args) {
+    callback_t register_callback(event_t id, void (*callback)(Args...), Args... args) {
         struct Wrapper : public WrapperBase {
             explicit Wrapper(Args... args, void (*cb)(Args...))
                 : args{args...}, cb{cb} {}
@@ -147,9 +193,22 @@ public:
             Wrapper &w = *reinterpret_cast<Wrapper *>(aux);
             w.cb(std::get<Args>(w.args)...);
         };
-        register_callback(id, call, aux);
+        return register_callback(id, call, aux);
     }
 
+    /**
+     * Removes a callback before its scope ends. Does nothing if the callback
+     * or event has already been removed. Data bound to the callback is kept
+     * until the scope ends.
+     */
+    void remove_callback(event_t event, callback_t callback);
+
+    /**
+     * Removes an event and its callbacks before its scope ends. Does nothing
+     * if the event has already been removed.
+     */
+    void remove_event(event_t event);
+
     template<class T>
     void notify_event(event_t id, T t) {
         EventInfo info;
@@ -168,16 +227,24 @@ private:
 
     void add_aux(WrapperBase* ptr);
 
-    void remove_callback(event_t event, std::size_t ix);
+    event_t register_queue(std::size_t size, std::size_t capacity);
 
-    void remove_aux(std::size_t ix);
+    bool queue_event(event_t id, const void *payload, std::size_t size);
 
-    void remove_event(event_t event);
+    struct EventQueue {
+        std::mutex lock{};
+        // Size of one slot, a multiple of alignof(std::max_align_t)
+        std::size_t slot_size;
+        std::size_t capacity;
+        std::unique_ptr<std::max_align_t[]> data;
+        std::size_t head = 0, count = 0;
 
-    void end_scope(EventScope* ptr);
+        [[nodiscard]] void *slot(std::size_t ix) const;
+    };
 
-    std::vector<std::unique_ptr<WrapperBase>> aux_data{};
-    std::size_t free_aux = 0;
+    void remove_aux(slot_handle_t aux);
+
+    void end_scope(EventScope* ptr);
 
     struct CallbackData {
         void (*callback)(EventInfo, void *);
@@ -187,15 +254,27 @@ private:
         EventType type;
         EventInfo data;
         bool triggered;
+        // DELAYED: data notified since the last dispatch. Swapped with
+        // dispatching in handle_events, so notifications made by callbacks
+        // go to the other buffer and are handled the next time.
         std::vector<EventInfo> buffer{};
-        std::vector<CallbackData> callbacks{};
-        std::size_t free_ix = 0;
-        int64_t last_ix = -1;
+        std::vector<EventInfo> dispatching{};
+        // UNIFIED_VEC: one bit per index, set if notified
+        std::vector<uint64_t> bits{};
+        std::size_t bit_count = 0;
+        std::unique_ptr<EventQueue> queue{};
+        SlotMap<CallbackData> callbacks{};
     };
 
-    std::vector<EventData> events {};
-    std::size_t free_ix = 1;
-    int64_t last_ix = 0;
+    /**
+     * Calls all callbacks of event id. Callbacks may register and remove
+     * events and callbacks. Returns false if a callback removed the event.
+     */
+    bool dispatch(event_t id, EventInfo data);
+
+    SlotMap<std::unique_ptr<WrapperBase>> aux_data{};
+
+    SlotMap<EventData> events {};
 
     std::vector<EventScope*> scopes {};
 
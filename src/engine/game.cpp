@@ -2,6 +2,9 @@
 #include "style.h"
 #include "log.h"
 #include "engine.h"
+#include "stats.h"
+#include "glyphs.h"
+#include <algorithm>
 #include <utility>
 
 SDL_Renderer *gRenderer;
@@ -58,69 +61,118 @@ void Game::create() {
     init();
 }
 
+// Max wall time spent ticking per frame, so rendering never stalls.
+constexpr Uint64 MAX_TICK_TIME_NS = 12000000;
+
+void Game::set_tick_rate(Uint32 ticks_per_second, Uint32 catch_up) {
+    if (ticks_per_second == 0 || catch_up == 0) {
+        throw game_exception("Invalid tick rate");
+    }
+    tick_ns = 1000000000 / ticks_per_second;
+    max_catch_up = catch_up;
+}
+
+void Game::dispatch_event(SDL_Event &e) {
+    switch (e.type) {
+    case SDL_EVENT_QUIT:
+        exit_game();
+        break;
+    case SDL_EVENT_KEY_DOWN:
+        handle_keydown(e.key);
+        break;
+    case SDL_EVENT_KEY_UP:
+        handle_keyup(e.key);
+        break;
+    case SDL_EVENT_MOUSE_MOTION:
+        window_state.mouseX = e.motion.x;
+        window_state.mouseY = e.motion.y;
+        break;
+    case SDL_EVENT_MOUSE_BUTTON_DOWN:
+        handle_mousedown(e.button);
+        break;
+    case SDL_EVENT_MOUSE_BUTTON_UP:
+        handle_mouseup(e.button);
+        break;
+    case SDL_EVENT_MOUSE_WHEEL:
+        handle_mousewheel(e.wheel);
+        break;
+    case SDL_EVENT_TEXT_INPUT:
+        handle_textinput(e.text);
+        break;
+    case SDL_EVENT_WINDOW_RESIZED:
+    case SDL_EVENT_WINDOW_DISPLAY_CHANGED:
+    case SDL_EVENT_WINDOW_DISPLAY_SCALE_CHANGED:
+        handle_size_change();
+        break;
+    case SDL_EVENT_WINDOW_FOCUS_LOST:
+        handle_focus_change(false);
+        break;
+    case SDL_EVENT_WINDOW_FOCUS_GAINED:
+        handle_focus_change(true);
+        break;
+    case SDL_EVENT_RENDER_TARGETS_RESET:
+    case SDL_EVENT_RENDER_DEVICE_RESET:
+        handle_render_reset();
+        break;
+    default:
+        if (e.type >= SDL_EVENT_USER) {
+            handle_user_event(e.user);
+        }
+    }
+}
+
 void Game::run() {
     if (destroyed) {
         return;
     }
     running = true;
-    Uint64 last_time = SDL_GetTicks();
+    Uint64 last_time = SDL_GetTicksNS();
+    Uint64 last_frame = last_time;
+    // Simulated time not yet consumed by ticks
+    Uint64 accumulator = 0;
+    Uint64 sim_time = 0, last_tick_ms = 0;
 
     while (true) {
         SDL_Event e;
         while (SDL_PollEvent(&e)) {
-            switch (e.type) {
-            case SDL_EVENT_QUIT:
-                exit_game();
-                break;
-            case SDL_EVENT_KEY_DOWN:
-                handle_keydown(e.key);
-                break;
-            case SDL_EVENT_KEY_UP:
-                handle_keyup(e.key);
-                break;
-            case SDL_EVENT_MOUSE_MOTION:
-                window_state.mouseX = e.motion.x;
-                window_state.mouseY = e.motion.y;
-                break;
-            case SDL_EVENT_MOUSE_BUTTON_DOWN:
-                handle_mousedown(e.button);
-                break;
-            case SDL_EVENT_MOUSE_BUTTON_UP:
-                handle_mouseup(e.button);
-                break;
-            case SDL_EVENT_MOUSE_WHEEL:
-                handle_mousewheel(e.wheel);
-                break;
-            case SDL_EVENT_TEXT_INPUT:
-                handle_textinput(e.text);
-                break;
-            case SDL_EVENT_WINDOW_RESIZED:
-            case SDL_EVENT_WINDOW_DISPLAY_CHANGED:
-            case SDL_EVENT_WINDOW_DISPLAY_SCALE_CHANGED:
-                handle_size_change();
-                break;
-            case SDL_EVENT_WINDOW_FOCUS_LOST:
-                handle_focus_change(false);
-                break;
-            case SDL_EVENT_WINDOW_FOCUS_GAINED:
-                handle_focus_change(true);
-                break;
-            default:
-                if (e.type >= SDL_EVENT_USER) {
-                    handle_user_event(e.user);
-                }
-            }
-
+            dispatch_event(e);
         }
         window_state.mouse_mask = SDL_GetMouseState(nullptr, nullptr);
 
-        Uint64 cur_time = SDL_GetTicks();
-        this->tick(cur_time - last_time);
+        Uint64 cur_time = SDL_GetTicksNS();
+        Uint32 scale = std::max<Uint32>(get_time_scale(), 1);
+        accumulator += (cur_time - last_time) * scale;
+        last_time = cur_time;
+
+        Uint64 max_ticks = static_cast<Uint64>(max_catch_up) * scale;
+        Uint64 ticks = 0;
+        while (running && accumulator >= tick_ns) {
+            if (ticks == max_ticks ||
+                SDL_GetTicksNS() - cur_time > MAX_TICK_TIME_NS) {
+                // Too far behind, drop the backlog
+                accumulator %= tick_ns;
+                break;
+            }
+            sim_time += tick_ns;
+            Uint64 sim_ms = sim_time / 1000000;
+            this->tick(sim_ms - last_tick_ms);
+            last_tick_ms = sim_ms;
+            accumulator -= tick_ns;
+            ++ticks;
+        }
         if (!running)
             break;
-        last_time = cur_time;
+        gFrameStats.ticks = static_cast<Uint32>(ticks);
+        window_state.tick_alpha =
+            static_cast<float>(accumulator) / static_cast<float>(tick_ns);
 
+        Uint64 render_start = SDL_GetTicksNS();
         render();
+        Uint64 frame_end = SDL_GetTicksNS();
+        gFrameStats.render_ns = frame_end - render_start;
+        gFrameStats.frame_ns = frame_end - last_frame;
+        last_frame = frame_end;
+        gFrameStats.end_frame(cur_time / 1000000, 1000);
     }
     shutdown();
 }
@@ -129,6 +181,7 @@ void Game::exit_game() { running = false; }
 
 Game::~Game() {
     if (!destroyed) {
+        gGlyphs.free();
         SDL_DestroyRenderer(gRenderer);
         gRenderer = nullptr;
 
@@ -147,6 +200,8 @@ int State::get_preferred_width() const { return -1; }
 
 int State::get_preferred_height() const { return -1; }
 
+Uint32 State::get_time_scale() const { return 1; }
+
 /*
  * StateGame class
  *
@@ -204,6 +259,10 @@ void StateGame::tick(Uint64 delta) {
     }
 }
 
+Uint32 StateGame::get_time_scale() const {
+    return states.top()->get_time_scale();
+}
+
 void StateGame::update_window(const State *const state) {
     int w = state->get_preferred_width(), h = state->get_preferred_height();
     if (w == -1)
@@ -249,6 +308,10 @@ void StateGame::handle_focus_change(bool focus) {
     states.top()->handle_focus_change(focus);
 }
 
+void StateGame::handle_render_reset() {
+    states.top()->handle_render_reset();
+}
+
 void StateGame::handle_user_event(SDL_UserEvent &e) {
     states.top()->handle_user_event(e);
 }
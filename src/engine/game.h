@@ -31,6 +31,10 @@ struct WindowState {
     int mouseY;
     Uint32 mouse_mask;
     const bool *keyboard_state;
+
+    // Fraction of a tick simulated past the last tick, in [0, 1). Used to
+    // interpolate between the two last ticks when rendering.
+    float tick_alpha;
 };
 
 /**
@@ -51,14 +55,22 @@ public:
     void create();
 
     /**
-     * Starts and runs the game loop, calling tick and render every frame and
-     * handle_keydown / handle_keyup when a keypress happens. Will return after
-     * exit_game has been called, or immediately if the game has not been
-     * created or has been destroyed. Closing the window will call exit_game and
-     * cause run to return.
+     * Starts and runs the game loop, calling render every frame, tick at a
+     * fixed rate and handle_keydown / handle_keyup when a keypress happens.
+     * Will return after exit_game has been called, or immediately if the game
+     * has not been created or has been destroyed. Closing the window will call
+     * exit_game and cause run to return.
      */
     void run();
 
+    /**
+     * Sets the rate of the simulation. tick is called ticks_per_second times
+     * per second of simulated time, independent of the frame rate. At most
+     * max_catch_up ticks, multiplied by the time scale, are run per frame.
+     * If the simulation falls further behind, the backlog is dropped.
+     */
+    void set_tick_rate(Uint32 ticks_per_second, Uint32 max_catch_up);
+
     /**
      * Exits an ongoing game.
      */
@@ -74,6 +86,11 @@ protected:
      */
     virtual void render() {};
 
+    /**
+     * Returns how many times faster than real time the simulation runs.
+     */
+    [[nodiscard]] virtual Uint32 get_time_scale() const { return 1; };
+
     /**
      * Initializes a game, called at the end of create. If init trows an
      * exception the game will not be successfully created.
@@ -81,8 +98,8 @@ protected:
     virtual void init() {};
 
     /**
-     * Tick function, called once every frame, before render. Delta is the
-     * passed time in milliseconds.
+     * Tick function, called at a fixed rate before render, zero or more times
+     * per frame. Delta is the simulated time in milliseconds.
      */
     virtual void tick(Uint64 delta) {};
 
@@ -120,14 +137,28 @@ protected:
 
     virtual void handle_focus_change(bool focus) {};
 
+    /**
+     * Called when render targets or the render device were reset and
+     * cached render targets have lost their contents.
+     */
+    virtual void handle_render_reset() {};
+
     virtual void handle_user_event(SDL_UserEvent& e) {};
 
     virtual void shutdown() {};
 
 private:
+    /**
+     * Passes an event on to the matching handler.
+     */
+    void dispatch_event(SDL_Event &e);
+
     bool running = false;
     bool destroyed = true;
 
+    Uint64 tick_ns = 1000000000 / 60;
+    Uint32 max_catch_up = 5;
+
     const int initial_width = 100, initial_height = 100;
     const std::string initial_title = "Title";
 };
@@ -206,6 +237,12 @@ public:
 
     virtual void handle_focus_change(bool focus) {};
 
+    /**
+     * Called when render targets or the render device were reset and
+     * cached render targets have lost their contents.
+     */
+    virtual void handle_render_reset() {};
+
     virtual void handle_user_event(SDL_UserEvent& e) {};
 
     /**
@@ -218,6 +255,11 @@ public:
      */
     [[nodiscard]] virtual int get_preferred_height() const;
 
+    /**
+     * Get how many times faster than real time this state should be ticked.
+     */
+    [[nodiscard]] virtual Uint32 get_time_scale() const;
+
     virtual void shutdown() {};
 
 protected:
@@ -250,6 +292,11 @@ protected:
      */
     void tick(Uint64 delta) override;
 
+    /**
+     * Returns the time scale of the current top state.
+     */
+    [[nodiscard]] Uint32 get_time_scale() const override;
+
     /**
      * Sends a down-event to the top state with the relevant keycode.
      */
@@ -284,6 +331,8 @@ protected:
 
     void handle_focus_change(bool focus) override;
 
+    void handle_render_reset() override;
+
     void handle_user_event(SDL_UserEvent& e) override;
 
     void shutdown() override;
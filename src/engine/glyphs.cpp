@@ -0,0 +1,191 @@
+#include "glyphs.h"
+#include "engine.h"
+#include "exceptions.h"
+#include "stats.h"
+#include <algorithm>
+#include <climits>
+#include <memory>
+
+GlyphCache gGlyphs;
+
+constexpr int GLYPH_COLUMNS = 16;
+constexpr Uint32 GLYPH_COUNT = GlyphCache::LAST_GLYPH - GlyphCache::FIRST_GLYPH + 1;
+
+void GlyphCache::set_font(TTF_Font *new_font) {
+    font = new_font;
+    reset();
+}
+
+void GlyphCache::reset() {
+    loaded = false;
+    glyph_w = 0;
+    glyph_h = 0;
+    ++atlas_generation;
+}
+
+Uint64 GlyphCache::generation() const { return atlas_generation; }
+
+void GlyphCache::free() {
+    texture.free();
+    reset();
+}
+
+void GlyphCache::load() {
+    if (font == nullptr) {
+        throw logic_exception("Glyph cache used without font");
+    }
+    int advance = 0;
+    if (!TTF_GetGlyphMetrics(font, 'M', nullptr, nullptr, nullptr, nullptr,
+                             &advance)) {
+        throw image_load_exception(std::string(SDL_GetError()));
+    }
+    glyph_w = advance;
+    glyph_h = TTF_GetFontHeight(font);
+
+    int rows = (GLYPH_COUNT + GLYPH_COLUMNS - 1) / GLYPH_COLUMNS;
+    std::unique_ptr<SDL_Surface, SurfaceDeleter> atlas{SDL_CreateSurface(
+        GLYPH_COLUMNS * glyph_w, rows * glyph_h, SDL_PIXELFORMAT_RGBA32)};
+    if (atlas == nullptr) {
+        throw image_load_exception(std::string(SDL_GetError()));
+    }
+    const SDL_Color white = {0xff, 0xff, 0xff, 0xff};
+    for (Uint32 c = FIRST_GLYPH; c <= LAST_GLYPH; ++c) {
+        std::unique_ptr<SDL_Surface, SurfaceDeleter> glyph{
+            TTF_RenderGlyph_Blended(font, c, white)};
+        if (glyph == nullptr) {
+            // Missing glyphs are left empty
+            continue;
+        }
+        Uint32 ix = c - FIRST_GLYPH;
+        SDL_Rect dest = {static_cast<int>(ix % GLYPH_COLUMNS) * glyph_w,
+                         static_cast<int>(ix / GLYPH_COLUMNS) * glyph_h,
+                         std::min(glyph->w, glyph_w), std::min(glyph->h, glyph_h)};
+        SDL_Rect src = {0, 0, dest.w, dest.h};
+        SDL_SetSurfaceBlendMode(glyph.get(), SDL_BLENDMODE_NONE);
+        SDL_BlitSurface(glyph.get(), &src, atlas.get(), &dest);
+    }
+    texture = Texture(atlas.get(), atlas->w, atlas->h);
+    loaded = true;
+}
+
+int GlyphCache::advance() {
+    if (!loaded) {
+        load();
+    }
+    return glyph_w;
+}
+
+int GlyphCache::line_height() {
+    if (!loaded) {
+        load();
+    }
+    return glyph_h;
+}
+
+SDL_Point GlyphCache::measure(std::string_view text) {
+    int w = advance(), h = line_height();
+    int max_col = 0, col = 0, lines = 1;
+    for (char c : text) {
+        if (c == '\n') {
+            ++lines;
+            col = 0;
+        } else {
+            ++col;
+            max_col = std::max(max_col, col);
+        }
+    }
+    return {max_col * w, lines * h};
+}
+
+SDL_Point GlyphCache::layout(std::string_view text, int wrap_width,
+                             SDL_Color color, std::vector<SDL_Vertex> &vertices) {
+    int w = advance(), h = line_height();
+    int cols = wrap_width > 0 ? std::max(1, wrap_width / w) : INT_MAX;
+    float tw = static_cast<float>(texture.get_width());
+    float th = static_cast<float>(texture.get_height());
+    SDL_FColor c = {color.r / 255.0f, color.g / 255.0f, color.b / 255.0f,
+                    color.a / 255.0f};
+
+    int line = 0, col = 0, max_col = 0;
+    auto emit = [&](unsigned char ch) {
+        Uint32 cp = ch;
+        if (cp < FIRST_GLYPH || cp > LAST_GLYPH) {
+            cp = '?';
+        }
+        Uint32 ix = cp - FIRST_GLYPH;
+        float u = static_cast<float>((ix % GLYPH_COLUMNS) * w);
+        float v = static_cast<float>((ix / GLYPH_COLUMNS) * h);
+        float x = static_cast<float>(col * w), y = static_cast<float>(line * h);
+        vertices.push_back({{x, y}, c, {u / tw, v / th}});
+        vertices.push_back({{x + w, y}, c, {(u + w) / tw, v / th}});
+        vertices.push_back({{x + w, y + h}, c, {(u + w) / tw, (v + h) / th}});
+        vertices.push_back({{x, y + h}, c, {u / tw, (v + h) / th}});
+        ++col;
+        max_col = std::max(max_col, col);
+    };
+
+    std::size_t i = 0;
+    while (i < text.size()) {
+        char ch = text[i];
+        if (ch == '\n') {
+            ++line;
+            col = 0;
+            ++i;
+            continue;
+        }
+        if (ch == ' ') {
+            if (col >= cols) {
+                ++line;
+                col = 0;
+            } else {
+                ++col;
+                max_col = std::max(max_col, col);
+            }
+            ++i;
+            continue;
+        }
+        std::size_t end = text.find_first_of(" \n", i);
+        if (end == std::string_view::npos) {
+            end = text.size();
+        }
+        if (col > 0 && col + static_cast<int>(end - i) > cols) {
+            ++line;
+            col = 0;
+        }
+        for (; i < end; ++i) {
+            if (col >= cols) {
+                ++line;
+                col = 0;
+            }
+            emit(text[i]);
+        }
+    }
+    return {max_col * w, (line + 1) * h};
+}
+
+void GlyphCache::render(const std::vector<SDL_Vertex> &vertices, float x,
+                        float y) {
+    if (vertices.empty()) {
+        return;
+    }
+    if (!loaded) {
+        load();
+    }
+    scratch.resize(vertices.size());
+    for (std::size_t i = 0; i < vertices.size(); ++i) {
+        scratch[i] = vertices[i];
+        scratch[i].position.x += x;
+        scratch[i].position.y += y;
+    }
+    std::size_t quads = vertices.size() / 4;
+    while (indices.size() < quads * 6) {
+        int base = static_cast<int>(indices.size() / 6) * 4;
+        for (int ix : {0, 1, 2, 0, 2, 3}) {
+            indices.push_back(base + ix);
+        }
+    }
+    SDL_RenderGeometry(gRenderer, texture.get_texture(), scratch.data(),
+                       static_cast<int>(scratch.size()), indices.data(),
+                       static_cast<int>(quads * 6));
+    gFrameStats.add_draw_calls();
+}
@@ -0,0 +1,93 @@
+#ifndef ENGINE_GLYPHS_H
+#define ENGINE_GLYPHS_H
+#include "texture.h"
+#include <SDL3_ttf/SDL_ttf.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Cache of rasterized glyphs for a monospace font. All glyphs are rendered
+ * once, in white, into a single atlas texture. Text is then laid out as
+ * quads into that texture, with color applied through vertex colors.
+ * Glyphs are rasterized lazily, since the renderer might not exist when the
+ * font is set.
+ */
+class GlyphCache {
+public:
+    // Range of codepoints kept in the atlas, others are drawn as '?'.
+    static constexpr Uint32 FIRST_GLYPH = 0x20;
+    static constexpr Uint32 LAST_GLYPH = 0xff;
+
+    /**
+     * Sets the font used for all glyphs, dropping any rasterized glyphs.
+     */
+    void set_font(TTF_Font *font);
+
+    /**
+     * Drops all rasterized glyphs, for example after the font size changed.
+     */
+    void reset();
+
+    /**
+     * Returns a counter that changes whenever the atlas is dropped. Quads
+     * produced by layout are only valid while it stays the same.
+     */
+    [[nodiscard]] Uint64 generation() const;
+
+    /**
+     * Frees the atlas texture. Must be called before the renderer is
+     * destroyed.
+     */
+    void free();
+
+    /**
+     * Returns the horizontal advance of one character.
+     */
+    int advance();
+
+    /**
+     * Returns the height of one line of text.
+     */
+    int line_height();
+
+    /**
+     * Returns the size of text when laid out without wrapping.
+     */
+    SDL_Point measure(std::string_view text);
+
+    /**
+     * Appends one quad per visible character of text to vertices, with
+     * positions relative to (0, 0). Lines are wrapped at word boundaries to
+     * fit within wrap_width, unless wrap_width <= 0. Returns the size of the
+     * laid out text.
+     */
+    SDL_Point layout(std::string_view text, int wrap_width, SDL_Color color,
+                     std::vector<SDL_Vertex> &vertices);
+
+    /**
+     * Renders quads produced by layout, offset by (x, y), in one draw call.
+     */
+    void render(const std::vector<SDL_Vertex> &vertices, float x, float y);
+
+private:
+    void load();
+
+    TTF_Font *font = nullptr;
+
+    bool loaded = false;
+
+    Uint64 atlas_generation = 0;
+
+    int glyph_w = 0, glyph_h = 0;
+
+    Texture texture{};
+
+    std::vector<SDL_Vertex> scratch{};
+    std::vector<int> indices{};
+};
+
+// Global glyph cache for gFont
+extern GlyphCache gGlyphs;
+
+#endif
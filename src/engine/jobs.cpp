@@ -0,0 +1,112 @@
+#include "jobs.h"
+#include <algorithm>
+
+JobSystem::JobSystem(unsigned workers) {
+    for (unsigned i = 0; i <= workers; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (unsigned i = 1; i <= workers; ++i) {
+        threads.emplace_back(&JobSystem::worker_main, this, i);
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> guard{sleep_lock};
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+unsigned JobSystem::thread_count() const {
+    return static_cast<unsigned>(queues.size());
+}
+
+unsigned JobSystem::default_workers() {
+    unsigned hw = std::thread::hardware_concurrency();
+    return hw > 1 ? hw - 1 : 0;
+}
+
+void JobSystem::run(std::size_t count, std::size_t grain,
+                    void (*fn)(void *, std::size_t, std::size_t), void *ctx) {
+    if (count == 0) {
+        return;
+    }
+    grain = std::max<std::size_t>(grain, 1);
+    if (threads.empty() || count <= grain) {
+        fn(ctx, 0, count);
+        return;
+    }
+    std::size_t jobs = (count + grain - 1) / grain;
+    pending.store(jobs);
+    // Spread the ranges round robin, so every thread starts with local work
+    std::size_t q = 0;
+    for (std::size_t begin = 0; begin < count; begin += grain) {
+        Queue &queue = *queues[q];
+        {
+            std::lock_guard<std::mutex> guard{queue.lock};
+            queue.jobs.push_back({fn, ctx, begin, std::min(begin + grain, count)});
+        }
+        q = (q + 1) % queues.size();
+    }
+    {
+        std::lock_guard<std::mutex> guard{sleep_lock};
+        ++generation;
+    }
+    wake.notify_all();
+
+    while (pending.load() > 0) {
+        if (!run_one(0)) {
+            // Remaining jobs are running on workers
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool JobSystem::run_one(std::size_t ix) {
+    Job job;
+    bool found = false;
+    {
+        Queue &own = *queues[ix];
+        std::lock_guard<std::mutex> guard{own.lock};
+        if (!own.jobs.empty()) {
+            job = own.jobs.back();
+            own.jobs.pop_back();
+            found = true;
+        }
+    }
+    for (std::size_t i = 1; !found && i < queues.size(); ++i) {
+        Queue &victim = *queues[(ix + i) % queues.size()];
+        std::lock_guard<std::mutex> guard{victim.lock};
+        if (!victim.jobs.empty()) {
+            job = victim.jobs.front();
+            victim.jobs.pop_front();
+            found = true;
+        }
+    }
+    if (!found) {
+        return false;
+    }
+    job.fn(job.ctx, job.begin, job.end);
+    pending.fetch_sub(1);
+    return true;
+}
+
+void JobSystem::worker_main(std::size_t ix) {
+    std::size_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard{sleep_lock};
+            wake.wait(guard, [&] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+        }
+        while (run_one(ix)) {
+        }
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef ENGINE_JOBS_H
+#define ENGINE_JOBS_H
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * Thread pool running ranges of parallel loops. Every thread, including the
+ * one calling parallel_for, has its own queue of jobs. Threads take jobs
+ * from the back of their own queue, and steal from the front of the others
+ * when it is empty. Jobs must not depend on the order they run in.
+ */
+class JobSystem {
+public:
+    /**
+     * Starts a pool with the given number of worker threads. With 0
+     * workers, all jobs run on the calling thread.
+     */
+    explicit JobSystem(unsigned workers = default_workers());
+
+    JobSystem(const JobSystem &) = delete;
+    JobSystem &operator=(const JobSystem &) = delete;
+
+    ~JobSystem();
+
+    /**
+     * Calls f(begin, end) for consecutive ranges covering [0, count), each
+     * of at most grain elements, spread over all threads. Returns once all
+     * ranges are done. Must only be called from one thread at a time, and
+     * not from within a job.
+     */
+    template <class F>
+    void parallel_for(std::size_t count, std::size_t grain, F &&f) {
+        auto call = [](void *ctx, std::size_t begin, std::size_t end) {
+            (*static_cast<std::remove_reference_t<F> *>(ctx))(begin, end);
+        };
+        run(count, grain, call, &f);
+    }
+
+    /**
+     * Calls run(workers) once without workers and once with at least 3,
+     * returning true if both calls return the same result. For checking
+     * that a simulation does not depend on how its jobs are spread over
+     * threads.
+     */
+    template <class F> static bool same_on_any_threads(F &&run) {
+        auto serial = run(0u);
+        return run(std::max(default_workers(), 3u)) == serial;
+    }
+
+    /**
+     * Returns the number of threads running jobs, including the caller.
+     */
+    [[nodiscard]] unsigned thread_count() const;
+
+    /**
+     * One less than the number of hardware threads.
+     */
+    static unsigned default_workers();
+
+private:
+    struct Job {
+        void (*fn)(void *, std::size_t, std::size_t);
+        void *ctx;
+        std::size_t begin, end;
+    };
+
+    struct Queue {
+        std::mutex lock{};
+        std::deque<Job> jobs{};
+    };
+
+    void run(std::size_t count, std::size_t grain,
+             void (*fn)(void *, std::size_t, std::size_t), void *ctx);
+
+    /**
+     * Runs one job, from queue ix if possible or else stolen from another.
+     * Returns false if all queues were empty.
+     */
+    bool run_one(std::size_t ix);
+
+    void worker_main(std::size_t ix);
+
+    // Queue 0 belongs to the thread calling parallel_for
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> threads;
+
+    // Jobs not yet finished of the current parallel_for
+    std::atomic<std::size_t> pending{0};
+
+    std::mutex sleep_lock;
+    std::condition_variable wake;
+    // Incremented when new jobs are queued, guarded by sleep_lock
+    std::size_t generation = 0;
+    bool stopping = false;
+};
+
+#endif
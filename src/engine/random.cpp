@@ -1,10 +1,157 @@
+#include <algorithm>
 #include <chrono>
-#include <random>
 #include "engine.h"
 
-std::minstd_rand generator(static_cast<unsigned>(std::chrono::system_clock::now().time_since_epoch().count()));
+static uint64_t world_seed = static_cast<uint64_t>(
+    std::chrono::system_clock::now().time_since_epoch().count());
+
+Rng generator = engine::make_stream(RNG_STREAM_GLOBAL);
+
+// SplitMix64, used to spread seeds over the whole state
+static uint64_t splitmix(uint64_t &x) {
+    uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+void Rng::seed(uint64_t seed) {
+    for (uint64_t &x : s) {
+        x = splitmix(seed);
+    }
+}
+
+uint64_t Rng::below64(uint64_t bound) {
+    // Masking with rejection, since Lemire's method needs a 128 bit product
+    uint64_t mask = bound - 1;
+    mask |= mask >> 1;
+    mask |= mask >> 2;
+    mask |= mask >> 4;
+    mask |= mask >> 8;
+    mask |= mask >> 16;
+    mask |= mask >> 32;
+    uint64_t x;
+    do {
+        x = next() & mask;
+    } while (x >= bound);
+    return x;
+}
+
+void Rng::fill(uint64_t *out, std::size_t count) {
+    for (std::size_t i = 0; i < count; ++i) {
+        out[i] = next();
+    }
+}
+
+void Rng::fill(int32_t *out, std::size_t count, int32_t min, int32_t max) {
+    if (min >= max) {
+        std::fill(out, out + count, min);
+        return;
+    }
+    auto span = static_cast<uint32_t>(static_cast<int64_t>(max) - min);
+    // Same as below, with the rejection threshold computed once
+    uint32_t threshold = (0u - span) % span;
+    for (std::size_t i = 0; i < count; ++i) {
+        uint64_t m;
+        do {
+            m = (next() >> 32) * span;
+        } while (static_cast<uint32_t>(m) < threshold);
+        out[i] = static_cast<int32_t>(static_cast<int64_t>(min) + (m >> 32));
+    }
+}
+
+void Rng::jump() {
+    static constexpr uint64_t JUMP[] = {0x180ec6d33cfd0abaull,
+                                        0xd5a61266f0c9392cull,
+                                        0xa9582618e03fc9aaull,
+                                        0x39abdc4529b1661cull};
+    uint64_t t[4] = {0, 0, 0, 0};
+    for (uint64_t jump : JUMP) {
+        for (int b = 0; b < 64; ++b) {
+            if (jump & (1ull << b)) {
+                for (int i = 0; i < 4; ++i) {
+                    t[i] ^= s[i];
+                }
+            }
+            next();
+        }
+    }
+    for (int i = 0; i < 4; ++i) {
+        s[i] = t[i];
+    }
+}
+
+void engine::seed_world(uint64_t seed) {
+    world_seed = seed;
+    generator = make_stream(RNG_STREAM_GLOBAL);
+}
+
+uint64_t engine::get_world_seed() { return world_seed; }
+
+Rng engine::make_stream(uint64_t id) {
+    uint64_t x = world_seed ^ (id * 0xd1342543de82ef95ull);
+    return Rng{splitmix(x)};
+}
 
 int engine::random(const int min, const int max) {
-    if (min >= max) return min;
-    return (static_cast<int>(generator()) % (max - min)) + min;
+    return static_cast<int>(generator.range(min, max));
+}
+
+#ifdef RANDOM_BENCH
+#include <iostream>
+#include <random>
+#include <vector>
+
+int main() {
+    constexpr std::size_t COUNT = 10000000;
+    std::vector<int32_t> out(COUNT);
+    using clock = std::chrono::steady_clock;
+    auto us = [](clock::time_point a, clock::time_point b) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(b - a)
+            .count();
+    };
+
+    std::minstd_rand old{1};
+    auto start = clock::now();
+    for (std::size_t i = 0; i < COUNT; ++i) {
+        out[i] = static_cast<int32_t>(old() % 100);
+    }
+    auto end = clock::now();
+    std::cout << "minstd_rand %: " << us(start, end) << " us" << std::endl;
+
+    engine::seed_world(1);
+    start = clock::now();
+    for (std::size_t i = 0; i < COUNT; ++i) {
+        out[i] = engine::random(0, 100);
+    }
+    end = clock::now();
+    std::cout << "engine::random: " << us(start, end) << " us" << std::endl;
+
+    Rng rng = engine::make_stream(RNG_STREAM_SPAWN);
+    start = clock::now();
+    rng.fill(out.data(), COUNT, 0, 100);
+    end = clock::now();
+    std::cout << "Rng::fill: " << us(start, end) << " us" << std::endl;
+
+    // A bound of 3 * 2^30 makes % return the lower third twice as often
+    int64_t low = 0;
+    for (std::size_t i = 0; i < COUNT; ++i) {
+        low += rng.below(3u << 30) < (1u << 30);
+    }
+    std::cout << "Share in lower third: " << static_cast<double>(low) / COUNT
+              << std::endl;
+
+    bool ok = true;
+    for (uint64_t id : {RNG_STREAM_MAZE, RNG_STREAM_SCRIPT}) {
+        Rng a = engine::make_stream(id);
+        Rng b = engine::make_stream(id);
+        for (int i = 0; i < 1000; ++i) {
+            ok = ok && a.next() == b.next();
+        }
+    }
+    ok = ok && engine::make_stream(RNG_STREAM_MAZE).next() !=
+                   engine::make_stream(RNG_STREAM_SCRIPT).next();
+    std::cout << (ok ? "ok" : "Streams are not reproducible") << std::endl;
+    return ok ? 0 : 1;
 }
+#endif
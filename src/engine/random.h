@@ -0,0 +1,146 @@
+#ifndef ENGINE_RANDOM_H
+#define ENGINE_RANDOM_H
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+/**
+ * xoshiro256++ random number generator. Fast, with 256 bits of state, and
+ * satisfies UniformRandomBitGenerator. Every Rng is one stream, not safe to
+ * share between threads, use split or engine::make_stream for more.
+ */
+class Rng {
+public:
+    typedef uint64_t result_type;
+
+    /**
+     * Creates a stream from seed. Any seed is valid, including 0.
+     */
+    explicit Rng(uint64_t seed = 0) { this->seed(seed); }
+
+    void seed(uint64_t seed);
+
+    uint64_t next() {
+        uint64_t result = rotl(s[0] + s[3], 23) + s[0];
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+
+    uint64_t operator()() { return next(); }
+
+    static constexpr uint64_t min() { return 0; }
+
+    static constexpr uint64_t max() {
+        return std::numeric_limits<uint64_t>::max();
+    }
+
+    /**
+     * Returns a uniform number in [0, bound), without bias. bound must not
+     * be 0.
+     */
+    uint32_t below(uint32_t bound) {
+        // Lemire's multiply and shift, rejecting the few low products that
+        // would make some results more likely.
+        uint64_t m = (next() >> 32) * bound;
+        auto low = static_cast<uint32_t>(m);
+        if (low < bound) {
+            uint32_t threshold = (0u - bound) % bound;
+            while (low < threshold) {
+                m = (next() >> 32) * bound;
+                low = static_cast<uint32_t>(m);
+            }
+        }
+        return static_cast<uint32_t>(m >> 32);
+    }
+
+    /**
+     * Returns a uniform number in [0, bound), without bias. bound must not
+     * be 0.
+     */
+    uint64_t below64(uint64_t bound);
+
+    /**
+     * Returns a uniform number in [min, max), or min if max <= min.
+     */
+    int64_t range(int64_t min, int64_t max) {
+        if (min >= max) return min;
+        auto span = static_cast<uint64_t>(max) - static_cast<uint64_t>(min);
+        uint64_t r = span <= std::numeric_limits<uint32_t>::max()
+                         ? below(static_cast<uint32_t>(span))
+                         : below64(span);
+        return static_cast<int64_t>(static_cast<uint64_t>(min) + r);
+    }
+
+    /**
+     * Returns a uniform double in [0, 1).
+     */
+    double uniform() {
+        return static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    /**
+     * Fills out with count raw random numbers.
+     */
+    void fill(uint64_t *out, std::size_t count);
+
+    /**
+     * Fills out with count uniform numbers in [min, max).
+     */
+    void fill(int32_t *out, std::size_t count, int32_t min, int32_t max);
+
+    /**
+     * Returns a new stream seeded from this one. The streams do not overlap
+     * in practice, and the result only depends on the state of this one.
+     */
+    Rng split() { return Rng{next()}; }
+
+    /**
+     * Advances the stream by 2^128 numbers, the same as calling next that
+     * many times. Can be used for up to 2^128 non-overlapping streams.
+     */
+    void jump();
+
+private:
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    uint64_t s[4];
+};
+
+/**
+ * Ids of the streams made by engine::make_stream, one per subsystem so
+ * that using one does not change the numbers of the others.
+ */
+enum RNG_STREAMS : uint64_t {
+    RNG_STREAM_GLOBAL,
+    RNG_STREAM_MAZE,
+    RNG_STREAM_SPAWN,
+    RNG_STREAM_SCRIPT,
+    // Followed by one stream for every robot, by robot number
+    RNG_STREAM_ROBOTS,
+};
+
+namespace engine {
+    /**
+     * Sets the world seed, and restarts the global generator from it.
+     * The world seed starts out from the clock.
+     */
+    void seed_world(uint64_t seed);
+
+    [[nodiscard]] uint64_t get_world_seed();
+
+    /**
+     * Returns stream id of the world seed. The same world seed and id
+     * always give the same stream.
+     */
+    [[nodiscard]] Rng make_stream(uint64_t id);
+} // namespace engine
+
+#endif
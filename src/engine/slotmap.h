@@ -0,0 +1,148 @@
+#ifndef ENGINE_SLOTMAP_H
+#define ENGINE_SLOTMAP_H
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * Handle to an element of a SlotMap, the slot index in the low 32 bits and
+ * the generation of the slot in the high 32 bits. Never 0.
+ */
+typedef uint64_t slot_handle_t;
+
+constexpr slot_handle_t NULL_SLOT = 0;
+
+/**
+ * Storage of elements in a vector of reusable slots, addressed by
+ * generation-checked handles. Insert and erase are O(1). Erased slots
+ * are reused, newest first, keeping the slots packed. Every slot has a
+ * generation that is odd while it holds an element and incremented on
+ * insert and erase, so handles to erased elements are never valid again.
+ * Elements never move, erasing an element does not affect other handles
+ * and slots.
+ */
+template <class T> class SlotMap {
+public:
+    /**
+     * Inserts value into a free slot, returning its handle.
+     */
+    slot_handle_t insert(T value) {
+        uint32_t ix;
+        if (free_slots.empty()) {
+            ix = static_cast<uint32_t>(values.size());
+            values.push_back(std::move(value));
+            generations.push_back(1);
+        } else {
+            ix = free_slots.back();
+            free_slots.pop_back();
+            values[ix] = std::move(value);
+            ++generations[ix];
+        }
+        ++count;
+        return make_handle(ix, generations[ix]);
+    }
+
+    /**
+     * Erases the element of handle, resetting its slot to T{}.
+     * Returns false if handle is not valid.
+     */
+    bool erase(slot_handle_t handle) {
+        if (!contains(handle)) {
+            return false;
+        }
+        uint32_t ix = index_of(handle);
+        values[ix] = T{};
+        ++generations[ix];
+        free_slots.push_back(ix);
+        --count;
+        return true;
+    }
+
+    /**
+     * Erases all elements. Handles given out before stay invalid.
+     */
+    void clear() {
+        for (uint32_t ix = 0; ix < values.size(); ++ix) {
+            if (generations[ix] & 1) {
+                erase(make_handle(ix, generations[ix]));
+            }
+        }
+    }
+
+    /**
+     * Returns true if handle refers to an element.
+     */
+    [[nodiscard]] bool contains(slot_handle_t handle) const {
+        uint32_t ix = index_of(handle);
+        return ix < generations.size() &&
+               generations[ix] == generation_of(handle) &&
+               (generations[ix] & 1);
+    }
+
+    /**
+     * Returns the element of handle, or nullptr if handle is not valid.
+     */
+    T *get(slot_handle_t handle) {
+        return contains(handle) ? &values[index_of(handle)] : nullptr;
+    }
+
+    const T *get(slot_handle_t handle) const {
+        return contains(handle) ? &values[index_of(handle)] : nullptr;
+    }
+
+    /**
+     * Returns the number of elements.
+     */
+    [[nodiscard]] std::size_t size() const { return count; }
+
+    /**
+     * Returns the number of slots, including free ones. Used together with
+     * slot to iterate in a way that is safe against inserts and erases.
+     */
+    [[nodiscard]] std::size_t slot_count() const { return values.size(); }
+
+    /**
+     * Returns the element in slot ix, or nullptr if the slot is free.
+     */
+    T *slot(std::size_t ix) {
+        return (generations[ix] & 1) ? &values[ix] : nullptr;
+    }
+
+    /**
+     * Returns the handle of the element in slot ix.
+     */
+    [[nodiscard]] slot_handle_t handle(std::size_t ix) const {
+        return make_handle(static_cast<uint32_t>(ix), generations[ix]);
+    }
+
+    /**
+     * Calls f(T&) for every element, in slot order.
+     */
+    template <class F> void for_each(F &&f) {
+        for (std::size_t ix = 0; ix < values.size(); ++ix) {
+            if (generations[ix] & 1) {
+                f(values[ix]);
+            }
+        }
+    }
+
+    static uint32_t index_of(slot_handle_t handle) {
+        return static_cast<uint32_t>(handle);
+    }
+
+    static uint32_t generation_of(slot_handle_t handle) {
+        return static_cast<uint32_t>(handle >> 32);
+    }
+
+private:
+    static slot_handle_t make_handle(uint32_t ix, uint32_t generation) {
+        return (static_cast<slot_handle_t>(generation) << 32) | ix;
+    }
+
+    std::vector<T> values{};
+    std::vector<uint32_t> generations{};
+    std::vector<uint32_t> free_slots{};
+    std::size_t count = 0;
+};
+
+#endif // ENGINE_SLOTMAP_H
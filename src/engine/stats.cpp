@@ -0,0 +1,31 @@
+#include "stats.h"
+#include "log.h"
+
+FrameStats gFrameStats;
+
+void FrameStats::end_frame(Uint64 now, Uint64 interval) {
+    total_draw_calls += draw_calls;
+    total_render_ns += render_ns;
+    total_frame_ns += frame_ns;
+    total_ticks += ticks;
+    ++frames;
+    draw_calls = 0;
+    render_ns = 0;
+    frame_ns = 0;
+    ticks = 0;
+
+    if (now - last_report < interval) {
+        return;
+    }
+    LOG_DEBUG("Frame: %.3f ms, render: %.3f ms, %.1f draw calls, %.1f ticks",
+              total_frame_ns / (frames * 1e6),
+              total_render_ns / (frames * 1e6),
+              static_cast<double>(total_draw_calls) / frames,
+              static_cast<double>(total_ticks) / frames);
+    total_draw_calls = 0;
+    total_ticks = 0;
+    total_render_ns = 0;
+    total_frame_ns = 0;
+    frames = 0;
+    last_report = now;
+}
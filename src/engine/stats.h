@@ -0,0 +1,40 @@
+#ifndef ENGINE_STATS_H
+#define ENGINE_STATS_H
+#include <SDL3/SDL.h>
+
+/**
+ * Per-frame render statistics, reset at the start of every frame by Game::run.
+ */
+struct FrameStats {
+    // Number of draw calls submitted to gRenderer this frame.
+    Uint32 draw_calls = 0;
+    // Time spent in render() this frame, in nanoseconds.
+    Uint64 render_ns = 0;
+    // Total time of the last frame, in nanoseconds.
+    Uint64 frame_ns = 0;
+    // Number of simulation ticks run this frame.
+    Uint32 ticks = 0;
+
+    // Accumulated values since the last report.
+    Uint64 total_draw_calls = 0;
+    Uint64 total_render_ns = 0;
+    Uint64 total_frame_ns = 0;
+    Uint64 total_ticks = 0;
+    Uint32 frames = 0;
+    Uint64 last_report = 0;
+
+    /**
+     * Registers count draw calls for the current frame.
+     */
+    inline void add_draw_calls(Uint32 count = 1) { draw_calls += count; }
+
+    /**
+     * Closes the current frame, logging averages once every interval ms.
+     */
+    void end_frame(Uint64 now, Uint64 interval);
+};
+
+// Global frame statistics
+extern FrameStats gFrameStats;
+
+#endif
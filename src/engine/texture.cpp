@@ -1,6 +1,7 @@
 #include "texture.h"
 #include "engine.h"
 #include "exceptions.h"
+#include "stats.h"
 
 
 Texture::Texture(SDL_Surface* s, const int w, const int h) {
@@ -79,6 +80,23 @@ void Texture::load_sub_image(SDL_Surface *src, SDL_Rect source_rect) {
     load_sub_image(src, source_rect,  source_rect.w, source_rect.h);
 }
 
+void Texture::create_target(int w, int h) {
+    free();
+
+    texture = SDL_CreateTexture(gRenderer, SDL_PIXELFORMAT_RGBA32,
+                                SDL_TEXTUREACCESS_TARGET, w, h);
+    if (texture == nullptr) {
+        throw image_load_exception(std::string(SDL_GetError()));
+    }
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+
+    width = w;
+    height = h;
+}
+
+void Texture::set_render_target(const Texture* target) {
+    SDL_SetRenderTarget(gRenderer, target == nullptr ? nullptr : target->texture);
+}
 
 void Texture::free() {
     if (texture != nullptr) {
@@ -92,6 +110,7 @@ void Texture::free() {
 void Texture::render_corner(int x, int y) const {
     SDL_FRect rect = {(float)x, (float)y, (float)width, (float)height};
     SDL_RenderTexture(gRenderer, texture, nullptr, &rect);
+    gFrameStats.add_draw_calls();
 }
 
 void Texture::render(const int x, const int y) const {
@@ -99,6 +118,7 @@ void Texture::render(const int x, const int y) const {
                       (float)(y - height / 2.0f),
                       (float)width, (float)height};
     SDL_RenderTexture(gRenderer, texture, nullptr, &rect);
+    gFrameStats.add_draw_calls();
 }
 
 void Texture::render(const int x, const int y, const double angle) const {
@@ -113,6 +133,7 @@ void Texture::render(const int x, const int y, const double angle) const {
         angle * 180 / 3.14159265,
         nullptr,
         SDL_FLIP_NONE);
+    gFrameStats.add_draw_calls();
 }
 
 void Texture::render(const int x, const int y, const double angle, 
@@ -128,6 +149,7 @@ void Texture::render(const int x, const int y, const double angle,
         angle * 180 / 3.14159265,
         nullptr,
         flip);
+    gFrameStats.add_draw_calls();
 }
 
 void Texture::render_corner_f(float x, float y, float w, float h, 
@@ -135,6 +157,7 @@ void Texture::render_corner_f(float x, float y, float w, float h,
     SDL_FRect dest = {x, y, w, h};
     SDL_RenderTextureRotated(gRenderer, texture, nullptr, &dest, 
                              angle, nullptr, flip);
+    gFrameStats.add_draw_calls();
 }
 
 void Texture::render(const int dest_x, const int dest_y, const int x, const int y, const int w, const int h) const {
@@ -142,6 +165,7 @@ void Texture::render(const int dest_x, const int dest_y, const int x, const int
                         (float)width, (float)height};
     SDL_FRect source = {(float)x, (float)y, (float)w, (float)h};
     SDL_RenderTexture(gRenderer, texture, &source, &target);
+    gFrameStats.add_draw_calls();
 }
 
 int Texture::get_height() const {
@@ -152,6 +176,10 @@ int Texture::get_width() const {
     return width;
 }
 
+SDL_Texture* Texture::get_texture() const {
+    return texture;
+}
+
 void Texture::set_dimensions(const int w, const int h) {
     this->width = w;
     this->height = h;
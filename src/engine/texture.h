@@ -43,6 +43,18 @@ class Texture {
 
         void load_sub_image(SDL_Surface *src, SDL_Rect source_rect);
 
+        /**
+         * Creates an empty texture of size (w, h) that can be rendered to,
+         * throwing an image_load_exception if something goes wrong.
+         */
+        void create_target(int w, int h);
+
+        /**
+         * Redirects rendering of the global gRenderer to target, or back to
+         * the window if target is nullptr.
+         */
+        static void set_render_target(const Texture* target);
+
         /**
 	 * Frees all resources associated with this texture.
 	 */
@@ -82,6 +94,11 @@ class Texture {
 	 * Returns the height of this texture.
 	 */
         [[nodiscard]] int get_height() const;
+
+        /**
+         * Returns the underlying SDL_Texture.
+         */
+        [[nodiscard]] SDL_Texture* get_texture() const;
 		
         /**
 	 * Sets the width and height.
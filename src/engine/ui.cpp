@@ -1,6 +1,7 @@
 #include "ui.h"
 #include "log.h"
 #include "style.h"
+#include "stats.h"
 #include <utility>
 
 TTF_Font *TextBox::font;
@@ -10,6 +11,7 @@ void TextBox::init(TTF_Font *font_data) {
     if (TextBox::font == nullptr) {
         throw game_exception(std::string(SDL_GetError()));
     }
+    gGlyphs.set_font(font_data);
 }
 
 TextBox::TextBox(SDL_Rect rect, std::string text, const WindowState &ws)
@@ -25,45 +27,33 @@ TextBox::TextBox(int x, int y, int w, int h, std::string text, int font_size,
       dpi_ratio(std::min(static_cast<double>(window_state.window_width) /
                              window_state.screen_width,
                          static_cast<double>(window_state.window_height) /
-                             window_state.screen_height)),
-      texture((SDL_Texture *)nullptr, 0, 0) {
+                             window_state.screen_height)) {
     set_text_color(UI_TEXT_COLOR);
 }
 
-void TextBox::generate_texture() {
+void TextBox::generate_texture() const {
+    glyphs.clear();
+    glyph_generation = gGlyphs.generation();
     if (text.empty()) {
-        texture.free();
+        text_width = 0;
+        text_height = 0;
         return;
     }
+    SDL_Point size = gGlyphs.layout(text, w, color, glyphs);
+    text_width = size.x;
+    text_height = size.y;
+    update_offsets();
+}
 
-    SDL_Surface *text_surface =
-        TTF_RenderText_Blended_Wrapped(font, text.c_str(), 
-                                       text.length(),
-                                       color, w);
-    if (text_surface == nullptr) {
-        throw image_load_exception(std::string(SDL_GetError()));
-    }
-    int width = text_surface->w;
-    int height = text_surface->h;
-    SDL_Texture *text_texture =
-        SDL_CreateTextureFromSurface(gRenderer, text_surface);
-    SDL_DestroySurface(text_surface);
-
-    if (text_texture == nullptr) {
-        throw image_load_exception(std::string(SDL_GetError()));
-    }
-    texture = Texture(text_texture, width, height);
-
-    TTF_GetStringSize(font, text.c_str(), text.length(), 
-                      &width, &height);
+void TextBox::update_offsets() const {
     if (alignment == Alignment::LEFT) {
         text_offset_x = 0;
     } else if (alignment == Alignment::CENTRE) {
-        text_offset_x = static_cast<int>((w - width / dpi_ratio) / 2);
+        text_offset_x = static_cast<int>((w - text_width / dpi_ratio) / 2);
     } else {
-        text_offset_x = static_cast<int>(w - width / dpi_ratio);
+        text_offset_x = static_cast<int>(w - text_width / dpi_ratio);
     }
-    text_offset_y = static_cast<int>((h - height / dpi_ratio) / 2);
+    text_offset_y = static_cast<int>((h - text_height / dpi_ratio) / 2);
 }
 
 void TextBox::set_dpi_ratio(double dpi) {
@@ -86,22 +76,19 @@ void TextBox::set_align(Alignment align) {
     if (align == Alignment::LEFT) {
         text_offset_x = 0;
     } else if (align == Alignment::CENTRE) {
-        int width, height;
-        TTF_GetStringSize(font, text.c_str(), text.length(),
-                          &width, &height);
-        text_offset_x = static_cast<int>((w - width / dpi_ratio) / 2);
+        text_offset_x = static_cast<int>((w - text_width / dpi_ratio) / 2);
     } else {
-        int width, height;
-        TTF_GetStringSize(font, text.c_str(), text.length(),
-                          &width, &height);
-        text_offset_x = static_cast<int>(w - width / dpi_ratio);
+        text_offset_x = static_cast<int>(w - text_width / dpi_ratio);
     }
 }
 
 void TextBox::set_text_color(const Uint8 r, const Uint8 g, const Uint8 b,
                              const Uint8 a) {
     color = {r, g, b, a};
-    generate_texture();
+    SDL_FColor c = {r / 255.0f, g / 255.0f, b / 255.0f, a / 255.0f};
+    for (auto &v : glyphs) {
+        v.color = c;
+    }
 }
 
 const SDL_Color &TextBox::get_text_color() const { return color; }
@@ -125,15 +112,17 @@ void TextBox::render(const int x_offset, const int y_offset,
     if (text.empty()) {
         return;
     }
+    if (glyph_generation != gGlyphs.generation()) {
+        generate_texture();
+    }
     // When rendering text, set logical size to the size of the window to allow
     // better quality text. Because of this, need to manually adjust for DPI.
     /*SDL_SetRenderLogicalPresentation(gRenderer, 
             dpi_ratio * window_state.screen_width,
             dpi_ratio * window_state.screen_height,
             SDL_LOGICAL_PRESENTATION_DISABLED);*/
-    texture.render_corner(
-        static_cast<int>((x_offset + x + text_offset_x)),
-        static_cast<int>((y_offset + y + text_offset_y)));
+    gGlyphs.render(glyphs, static_cast<float>(x_offset + x + text_offset_x),
+                   static_cast<float>(y_offset + y + text_offset_y));
     /*SDL_SetRenderLogicalPresentation(gRenderer, 
             window_state.screen_width,
             window_state.screen_height,
@@ -166,6 +155,7 @@ void Polygon::render(int x_offset, int y_offset) const {
     }
     SDL_RenderGeometry(gRenderer, nullptr, verticies.data(),
                        verticies.size(), nullptr, 0);
+    gFrameStats.add_draw_calls();
 }
 
 void Polygon::set_points(std::initializer_list<SDL_FPoint> points) {
@@ -203,6 +193,7 @@ void Box::render(int x_offset, int y_offset) const {
                    (float)rect.w, (float)rect.h};
     if (filled) {
         SDL_RenderFillRect(gRenderer, &r);
+        gFrameStats.add_draw_calls();
         return;
     }
     SDL_RenderFillRect(gRenderer, &r);
@@ -211,6 +202,7 @@ void Box::render(int x_offset, int y_offset) const {
                   (float)(r.w - 2 * border_width),
                   (float)(r.h - 2 * border_width)};
     SDL_RenderFillRect(gRenderer, &r);
+    gFrameStats.add_draw_calls(2);
 }
 
 void Box::set_border_color(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
@@ -299,6 +291,7 @@ void Button::render(const int x_offset, const int y_offset,
     if (border) {
         SDL_SetRenderDrawColor(gRenderer, UI_BORDER_COLOR);
         SDL_RenderFillRect(gRenderer, &r);
+        gFrameStats.add_draw_calls();
         r.x += 2;
         r.y += 2;
         r.w -= 4;
@@ -314,6 +307,7 @@ void Button::render(const int x_offset, const int y_offset,
         SDL_SetRenderDrawColor(gRenderer, UI_BUTTON_COLOR);
     }
     SDL_RenderFillRect(gRenderer, &r);
+    gFrameStats.add_draw_calls();
 
     text.render(x_offset, y_offset, window_state);
 }
@@ -374,8 +368,9 @@ void Dropdown::set_choices(const std::vector<std::string> &choices,
     int tw, th;
     const std::string base_str = " -";
     if (default_value != "") {
-        TTF_GetStringSize(gFont, base_str.c_str(), base_str.length(),
-                          &tw, &th);
+        SDL_Point size = gGlyphs.measure(base_str);
+        tw = size.x;
+        th = size.y;
         if (tw > max_w) {
             max_w = tw;
         }
@@ -384,8 +379,9 @@ void Dropdown::set_choices(const std::vector<std::string> &choices,
         }
     }
     for (int i = 0; i < choices.size(); ++i) {
-        const std::string str = " " + choices[i];
-        TTF_GetStringSize(gFont, str.c_str(), str.length(), &tw, &th);
+        SDL_Point size = gGlyphs.measure(" " + choices[i]);
+        tw = size.x;
+        th = size.y;
         if (tw > max_w) {
             max_w = tw;
         }
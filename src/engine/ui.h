@@ -3,6 +3,7 @@
 #include "game.h"
 #include "engine.h"
 #include "texture.h"
+#include "glyphs.h"
 #include "log.h"
 #include <SDL3_ttf/SDL_ttf.h>
 #include <string>
@@ -75,7 +76,7 @@ public:
                 const WindowState &window_state) const;
 
     /**
-     * Initializes the button class, loading the font used for the button text.
+     * Initializes the textbox class, setting the font used for all text.
      */
     static void init(TTF_Font *font_data);
 
@@ -89,26 +90,37 @@ protected:
 
     int font_size{};
 
-    int text_offset_x{};
+    mutable int text_offset_x{};
 
-    int text_offset_y{};
+    mutable int text_offset_y{};
 
     std::string text;
 
     double dpi_ratio{};
 
 private:
-    Texture texture;
+    // Glyph quads of the text, relative to the text origin.
+    mutable std::vector<SDL_Vertex> glyphs{};
+
+    mutable int text_width{}, text_height{};
+
+    // Glyph atlas generation the glyphs were laid out for.
+    mutable Uint64 glyph_generation = 0;
 
     SDL_Color color = {0, 0, 0, 0};
 
     Alignment alignment = Alignment::CENTRE;
 
     /**
-     * Generates the texture containing the text of the button. Called by
-     * constructor and set_text.
+     * Lays out the glyphs of the text and updates the text offsets. Called
+     * by set_text, and by render when the glyph atlas was rebuilt.
+     */
+    void generate_texture() const;
+
+    /**
+     * Updates text_offset_x and text_offset_y from the text size.
      */
-    void generate_texture();
+    void update_offsets() const;
 
     static TTF_Font *font;
 };
@@ -0,0 +1,194 @@
+#include "entities.h"
+#include <algorithm>
+#include <cassert>
+
+
+World::World(int32_t width, int32_t height) : spatial(width, height) {}
+
+entity_t World::spawn(EntityKind kind, vec2i pos, Health hp,
+                      CombatStats stats, FACTIONS faction) {
+    auto ix = static_cast<uint32_t>(ids.size());
+    entity_t id = indices.insert(ix);
+    ids.push_back(id);
+    kinds.push_back(kind);
+    positions.push_back(pos);
+    health.push_back(hp);
+    combat.push_back(stats);
+    ai.push_back({IDLE, 0, 0});
+    factions.push_back(faction);
+    spatial.insert(id, pos);
+    return id;
+}
+
+void World::despawn(entity_t entity) {
+    const uint32_t *ix_ptr = indices.get(entity);
+    if (ix_ptr == nullptr) {
+        return;
+    }
+    std::size_t ix = *ix_ptr;
+    spatial.remove(entity, positions[ix]);
+    std::size_t last = ids.size() - 1;
+    if (ix != last) {
+        ids[ix] = ids[last];
+        kinds[ix] = kinds[last];
+        positions[ix] = positions[last];
+        health[ix] = health[last];
+        combat[ix] = combat[last];
+        ai[ix] = ai[last];
+        factions[ix] = factions[last];
+        *indices.get(ids[ix]) = static_cast<uint32_t>(ix);
+    }
+    ids.pop_back();
+    kinds.pop_back();
+    positions.pop_back();
+    health.pop_back();
+    combat.pop_back();
+    ai.pop_back();
+    factions.pop_back();
+    indices.erase(entity);
+}
+
+void World::clear() {
+    indices.clear();
+    spatial.clear();
+    ids.clear();
+    kinds.clear();
+    positions.clear();
+    health.clear();
+    combat.clear();
+    ai.clear();
+    factions.clear();
+}
+
+void World::reserve(std::size_t count) {
+    ids.reserve(count);
+    kinds.reserve(count);
+    positions.reserve(count);
+    health.reserve(count);
+    combat.reserve(count);
+    ai.reserve(count);
+    factions.reserve(count);
+}
+
+bool World::alive(entity_t entity) const { return indices.contains(entity); }
+
+std::size_t World::size() const { return ids.size(); }
+
+std::size_t World::index_of(entity_t entity) const {
+    const uint32_t *ix = indices.get(entity);
+    assert(ix != nullptr);
+    return *ix;
+}
+
+void World::move_entity(entity_t entity, vec2i pos) {
+    vec2i &current = positions[index_of(entity)];
+    spatial.move(entity, current, pos);
+    current = pos;
+}
+
+bool World::is_occupied(vec2i pos) const { return spatial.is_occupied(pos); }
+
+uint64_t World::hash() const {
+    // FNV-1a over the fields, in dense order
+    uint64_t hash = 1469598103934665603ull;
+    for (std::size_t i = 0; i < size(); ++i) {
+        for (int32_t v : {positions[i].x, positions[i].y, health[i].hp,
+                          ai[i].wait_time}) {
+            hash = (hash ^ static_cast<uint32_t>(v)) * 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+entity_t World::entity_at(vec2i pos) const { return spatial.entity_at(pos); }
+
+void World::query_range(vec2i center, int32_t range, DIST_TYPES type,
+                        std::vector<entity_t> &out) const {
+    spatial.query_range(center, range, type, out);
+}
+
+void render_entities(const World &world, SpriteBatch &batch, float offset_x,
+                     float offset_y) {
+    for (std::size_t i = 0; i < world.size(); ++i) {
+        SDL_Color color;
+        switch (world.kinds[i]) {
+        case EntityKind::PLAYER:
+            continue;
+        case EntityKind::SLIME:
+            color = {0x0, 0xff, 0x0, 0xff};
+            break;
+        case EntityKind::ROBOT:
+            color = {0x80, 0x80, 0xff, 0xff};
+            break;
+        }
+        SDL_FRect rect = {offset_x + (world.positions[i].x * TILE_SIZE),
+                          offset_y + (world.positions[i].y * TILE_SIZE),
+                          TILE_SIZE, TILE_SIZE};
+        batch.fill_rect(rect, color, 1);
+    }
+}
+
+#ifdef ENTITIES_BENCH
+#include "slime.h"
+#include <chrono>
+#include <iostream>
+
+int main() {
+    for (int count : {10000, 100000}) {
+        World world;
+        world.reserve(count);
+        for (int i = 0; i < count; ++i) {
+            spawn_slime(world, i % MAZE_WIDTH, (i / MAZE_WIDTH) % MAZE_HEIGHT,
+                        1 + i % 5);
+        }
+        auto start = std::chrono::steady_clock::now();
+        while (world.size() > 0) {
+            world.despawn(world.ids[world.size() / 2]);
+        }
+        auto end = std::chrono::steady_clock::now();
+        std::cout << count << " despawns: "
+                  << std::chrono::duration_cast<std::chrono::microseconds>(
+                         end - start)
+                         .count()
+                  << " us" << std::endl;
+    }
+
+    // Range queries against a linear scan
+    constexpr int32_t SIZE = 512, QUERY_ENTITIES = 10000;
+    World world{SIZE, SIZE};
+    uint32_t seed = 1;
+    auto next = [&seed]() {
+        seed = seed * 1664525 + 1013904223;
+        return static_cast<int32_t>(seed >> 8);
+    };
+    for (int i = 0; i < QUERY_ENTITIES; ++i) {
+        spawn_slime(world, next() % SIZE, next() % SIZE, 1);
+    }
+    std::vector<entity_t> found;
+    for (DIST_TYPES type : {EUCLIDEAN, MANHATTAN, MANHATTAN_DIAG}) {
+        std::size_t indexed = 0, scanned = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < world.size(); ++i) {
+            found.clear();
+            world.query_range(world.positions[i], 6, type, found);
+            indexed += found.size();
+        }
+        auto mid = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < world.size(); ++i) {
+            for (std::size_t j = 0; j < world.size(); ++j) {
+                scanned += within_range(world.positions[i],
+                                        world.positions[j], 6, type);
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        auto us = [](auto a, auto b) {
+            return std::chrono::duration_cast<std::chrono::microseconds>(b - a)
+                .count();
+        };
+        std::cout << "Range queries " << type << ": " << us(start, mid)
+                  << " us indexed, " << us(mid, end) << " us scanned"
+                  << (indexed == scanned ? "" : ", MISMATCH") << std::endl;
+    }
+    return 0;
+}
+#endif
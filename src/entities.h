@@ -0,0 +1,134 @@
+#pragma once
+#include "utils.h"
+#include "engine/atlas.h"
+#include "maze.h"
+#include "engine/slotmap.h"
+#include "spatial.h"
+#include <vector>
+
+
+
+enum ENEMY_STATE {
+    IDLE,
+    COMBAT,
+};
+
+// Handle of an entity in a World, stays invalid once the entity is despawned.
+typedef slot_handle_t entity_t;
+
+constexpr entity_t NULL_ENTITY = NULL_SLOT;
+
+enum class EntityKind : uint8_t {
+    PLAYER,
+    SLIME,
+    // Run by a program, see Robots
+    ROBOT,
+};
+
+struct Health {
+    int32_t max_hp, hp;
+};
+
+struct CombatStats {
+    int32_t armour, damage, range;
+    DIST_TYPES move_dist_type, attack_dist_type;
+    // ATTACK_EFFECTS and DEFENCE_EFFECTS flags, see combat.h
+    uint8_t attack_effects, defence_effects;
+};
+
+struct AIState {
+    ENEMY_STATE state;
+    int32_t stun_time, wait_time;
+};
+
+/**
+ * Storage of all entities in the maze, with each component in its own
+ * contiguous array, so that systems only touch the components they use.
+ * Components of the entity at dense index i are at index i of every array.
+ * Despawning moves the last entity into the freed index, so dense indices
+ * are only valid until the next despawn, use entity_t to refer to entities
+ * across ticks. Positions are indexed on a grid of the given size, for
+ * finding entities on a tile or within range.
+ */
+class World {
+public:
+    explicit World(int32_t width = MAZE_WIDTH, int32_t height = MAZE_HEIGHT);
+
+    /**
+     * Creates an entity, returning its handle.
+     */
+    entity_t spawn(EntityKind kind, vec2i pos, Health health,
+                   CombatStats combat, FACTIONS faction);
+
+    /**
+     * Removes an entity. Does nothing if it has already been removed.
+     */
+    void despawn(entity_t entity);
+
+    /**
+     * Removes all entities.
+     */
+    void clear();
+
+    void reserve(std::size_t count);
+
+    [[nodiscard]] bool alive(entity_t entity) const;
+
+    /**
+     * Returns the number of entities.
+     */
+    [[nodiscard]] std::size_t size() const;
+
+    /**
+     * Returns the current dense index of an entity that is alive.
+     */
+    [[nodiscard]] std::size_t index_of(entity_t entity) const;
+
+    /**
+     * Moves an entity to pos.
+     */
+    void move_entity(entity_t entity, vec2i pos);
+
+    /**
+     * Returns true if any entity is on the tile at pos.
+     */
+    [[nodiscard]] bool is_occupied(vec2i pos) const;
+
+    /**
+     * Returns an entity on the tile at pos, or NULL_ENTITY if there is none.
+     */
+    [[nodiscard]] entity_t entity_at(vec2i pos) const;
+
+    /**
+     * Appends all entities within range of center to out, measured as type.
+     */
+    void query_range(vec2i center, int32_t range, DIST_TYPES type,
+                     std::vector<entity_t> &out) const;
+
+    /**
+     * Returns a hash of the positions, health and AI state of all entities,
+     * for checking that two simulations ended the same.
+     */
+    [[nodiscard]] uint64_t hash() const;
+
+    // Components, indexed by dense index. Systems may modify the
+    // components, except positions which must be changed with move_entity.
+    // Only spawn and despawn change the size of the arrays.
+    std::vector<entity_t> ids;
+    std::vector<EntityKind> kinds;
+    std::vector<vec2i> positions;
+    std::vector<Health> health;
+    std::vector<CombatStats> combat;
+    std::vector<AIState> ai;
+    std::vector<FACTIONS> factions;
+
+private:
+    SlotMap<uint32_t> indices;
+    SpatialIndex spatial;
+};
+
+/**
+ * Draws every entity except the player, which draws itself.
+ */
+void render_entities(const World &world, SpriteBatch &batch, float offset_x,
+                     float offset_y);
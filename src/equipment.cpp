@@ -1,219 +1,413 @@
 #include "equipment.h"
 #include "engine/engine.h"
+#include <algorithm>
 
 
+// Loot tables. Every item type has a list of bases, one of which is picked
+// uniformly for every item. Stats are rolled from the base, and weapons get
+// a special ability, which also sets how much damage grows with level.
+
+enum LOOT_NAMES : loot_name_t {
+    LONGSWORD,
+    BATTLE_AXE,
+    WAR_HAMMER,
+    SCYTHE,
+    CROSSBOW,
+    LONGBOW,
+    SHORTBOW,
+    HELMET,
+    CROWN,
+    PLATE_ARMOUR,
+    RAZORPLATE,
+    PLATED_BOOTS,
+    WINGED_BOOTS,
+    LOOT_NAME_COUNT
+};
+
+static constexpr std::string_view NAMES[LOOT_NAME_COUNT] = {
+    "Longsword", "Battle Axe",   "War Hammer", "Scythe",
+    "Crossbow",  "Longbow",      "Shortbow",   "Helmet",
+    "Crown",     "Plate Armour", "Razorplate", "Plated Boots",
+    "Winged Boots"};
+
+/**
+ * A stat of level * per_level, plus a random number in
+ * [min_per_level * level + min, max_per_level * level + max).
+ */
+struct LevelRoll {
+    int32_t per_level;
+    int32_t min_per_level, min;
+    int32_t max_per_level, max;
+};
+
+// Weapons get the special at index r of their base for a roll r in
+// [0, max(SPECIAL_ROLLS, SPECIAL_ODDS - level)), and no special otherwise.
+static constexpr int32_t SPECIAL_ROLLS = 3, SPECIAL_ODDS = 10;
+
+// Damage added per level, indexed by special
+static constexpr float MELEE_MODS[] = {MOD_MELEE_NOTHING, MOD_MELEE_LIFE_STEAL,
+                                       MOD_MELEE_ARMOUR_SHRED, MOD_MELEE_SPIN};
+static constexpr float RANGED_MODS[] = {
+    MOD_RANGED_NOTHING, MOD_RANGED_ARMOUR_SHRED, MOD_RANGED_EXPLOSIVE,
+    MOD_RANGED_PIERCING};
+
+struct MeleeBase {
+    loot_name_t name;
+    LevelRoll damage;
+    WEAPON_MELEE_SPECIAL specials[SPECIAL_ROLLS];
+};
+
+static constexpr MeleeBase MELEE_BASES[] = {
+    {LONGSWORD, {0, -1, 0, 1, 1}, {LIFE_STEAL, MELEE_ARMOUR_SHRED, SPIN}},
+    {BATTLE_AXE, {0, -1, 0, 0, 1}, {LIFE_STEAL, SPIN, SPIN}},
+    {WAR_HAMMER,
+     {0, -2, 0, 0, 1},
+     {LIFE_STEAL, MELEE_ARMOUR_SHRED, MELEE_ARMOUR_SHRED}},
+    {SCYTHE, {0, -2, 0, 0, 1}, {LIFE_STEAL, LIFE_STEAL, SPIN}},
+};
+
+struct RangedBase {
+    loot_name_t name;
+    LevelRoll damage;
+    // Range at level 0, increased by one per level
+    int32_t range;
+    WEAPON_RANGED_SPECIAL specials[SPECIAL_ROLLS];
+};
+
+static constexpr RangedBase RANGED_BASES[] = {
+    {CROSSBOW,
+     {0, 0, 0, 1, 1},
+     8,
+     {RANGED_ARMOUR_SHRED, RANGED_ARMOUR_SHRED, PIERCING}},
+    {LONGBOW, {0, -1, 0, 1, 1}, 10, {EXPLOSIVE, PIERCING, PIERCING}},
+    {SHORTBOW,
+     {0, -1, 0, 1, 1},
+     5,
+     {EXPLOSIVE, EXPLOSIVE, RANGED_ARMOUR_SHRED}},
+};
+
+struct ArmourVariant {
+    loot_name_t name;
+    ARMOUR_SPECIAL special;
+    LevelRoll armour, hp, regen;
+};
+
+// Armour gets the special variant when a roll in [0, level) is larger
+// than ARMOUR_SPECIAL_ROLL.
+static constexpr int32_t ARMOUR_SPECIAL_ROLL = 2;
+
+struct ArmourBase {
+    EQUIPMENT_SLOTS slot;
+    // Range of regen_speed, [min, max)
+    int32_t regen_speed_min, regen_speed_max;
+    ArmourVariant normal, special;
+};
+
+static constexpr ArmourBase ARMOUR_BASES[] = {
+    {HEAD,
+     1,
+     3,
+     {HELMET,
+      ARMOUR_NOTHING,
+      {3, 0, 0, 1, 1},
+      {15, 0, 0, 1, 1},
+      {6, 0, 0, 1, 1}},
+     {CROWN, WEALTHY, {2, -1, 0, 0, 1}, {10, -1, 0, 0, 1}, {4, -1, 0, 0, 1}}},
+    {BODY,
+     2,
+     5,
+     {PLATE_ARMOUR,
+      ARMOUR_NOTHING,
+      {9, 0, 0, 1, 1},
+      {18, 0, 0, 1, 1},
+      {3, 0, 0, 1, 1}},
+     {RAZORPLATE,
+      THORNS,
+      {6, -1, 0, 0, 1},
+      {12, -1, 0, 0, 1},
+      {2, -1, 0, 0, 1}}},
+    {BOOTS,
+     1,
+     3,
+     {PLATED_BOOTS,
+      ARMOUR_NOTHING,
+      {3, 0, 0, 1, 1},
+      {12, 0, 0, 1, 1},
+      {3, 0, 0, 1, 1}},
+     {WINGED_BOOTS,
+      QUICK,
+      {2, -1, 0, 0, 1},
+      {8, -1, 0, 0, 1},
+      {2, -1, 0, 0, 1}}},
+};
+
+template <class T, std::size_t N>
+static constexpr int32_t table_size(const T (&)[N]) {
+    return static_cast<int32_t>(N);
+}
+
+static int32_t random_between(Rng &rng, int32_t min, int32_t max) {
+    return static_cast<int32_t>(rng.range(min, max));
+}
+
+static int32_t roll(Rng &rng, const LevelRoll &r, int32_t level) {
+    return r.per_level * level +
+           random_between(rng, r.min_per_level * level + r.min,
+                          r.max_per_level * level + r.max);
+}
+
+template <class T>
+static T roll_special(Rng &rng, const T (&specials)[SPECIAL_ROLLS], T nothing,
+                      int32_t level) {
+    int32_t r =
+        random_between(rng, 0, std::max(SPECIAL_ROLLS, SPECIAL_ODDS - level));
+    return r < SPECIAL_ROLLS ? specials[r] : nothing;
+}
+
+static void roll_melee(Rng &rng, int32_t level, WeaponMelee &w,
+                       loot_name_t &name) {
+    const MeleeBase &base =
+        MELEE_BASES[random_between(rng, 0, table_size(MELEE_BASES))];
+    name = base.name;
+    w.level = level;
+    w.damage = roll(rng, base.damage, level);
+    w.special = roll_special(rng, base.specials, MELEE_NOTHING, level);
+    w.damage += static_cast<int32_t>(MELEE_MODS[w.special] * level);
+}
+
+static void roll_ranged(Rng &rng, int32_t level, WeaponRanged &w,
+                        loot_name_t &name) {
+    const RangedBase &base =
+        RANGED_BASES[random_between(rng, 0, table_size(RANGED_BASES))];
+    name = base.name;
+    w.level = level;
+    w.damage = roll(rng, base.damage, level);
+    w.range = base.range + level;
+    w.special = roll_special(rng, base.specials, RANGED_NOTHING, level);
+    w.damage += static_cast<int32_t>(RANGED_MODS[w.special] * level);
+}
+
+static void roll_armour(Rng &rng, int32_t level, Armour &a, loot_name_t &name) {
+    const ArmourBase &base =
+        ARMOUR_BASES[random_between(rng, 0, table_size(ARMOUR_BASES))];
+    a.level = level;
+    a.slot = base.slot;
+    a.regen_speed =
+        random_between(rng, base.regen_speed_min, base.regen_speed_max);
+    const ArmourVariant &variant =
+        random_between(rng, 0, level) > ARMOUR_SPECIAL_ROLL ? base.special
+                                                            : base.normal;
+    name = variant.name;
+    a.special = variant.special;
+    a.armour = roll(rng, variant.armour, level);
+    a.hp = roll(rng, variant.hp, level);
+    a.regen = roll(rng, variant.regen, level);
+}
+
+std::string_view loot_name(loot_name_t name) {
+    return name < LOOT_NAME_COUNT ? NAMES[name] : std::string_view{};
+}
 
 WeaponMelee generate_weapon_melee(int32_t level) {
     WeaponMelee w{};
-    w.level = level;
+    loot_name_t name;
+    roll_melee(generator, level, w, name);
     w.slot = EQUIPMENT_SLOTS::WEAPON;
-    switch (engine::random(0, 4)) {
-        case 0:
-        default:
-            w.name = "Longsword";
-            w.damage = engine::random(-level, level + 1);
-            switch (engine::random(0, std::max(3, 10 - level))) {
-                case 0:
-                    w.special = WEAPON_MELEE_SPECIAL::LIFE_STEAL;
-                    w.damage += (int32_t)(MOD_MELEE_LIFE_STEAL * level);
-                    break;
-                case 1:
-                    w.special = WEAPON_MELEE_SPECIAL::MELEE_ARMOUR_SHRED;
-                    w.damage += (int32_t)(MOD_MELEE_ARMOUR_SHRED * level);
-                    break;
-                case 2:
-                    w.special = WEAPON_MELEE_SPECIAL::SPIN;
-                    w.damage += (int32_t)(MOD_MELEE_SPIN * level);
-                    break;
-                default:
-                    w.special = WEAPON_MELEE_SPECIAL::MELEE_NOTHING;
-                    w.damage += (int32_t)(MOD_MELEE_NOTHING * level);
-                    break;
-            }
-            break;
-        case 1:
-            w.name = "Battle Axe";
-            w.damage = engine::random(-level, 1);
-            switch (engine::random(0, std::max(3, 10 - level))) {
-                case 0:
-                    w.special = WEAPON_MELEE_SPECIAL::LIFE_STEAL;
-                    w.damage += (int32_t)(MOD_MELEE_LIFE_STEAL * level);
-                    break;
-                case 1:
-                case 2:
-                    w.special = WEAPON_MELEE_SPECIAL::SPIN;
-                    w.damage += (int32_t)(MOD_MELEE_SPIN * level);
-                    break;
-                default:
-                    w.special = WEAPON_MELEE_SPECIAL::MELEE_NOTHING;
-                    w.damage += (int32_t)(MOD_MELEE_NOTHING * level);
-                    break;
-            }
-            break;
-        case 2:
-            w.name = "War Hammer";
-            w.damage = engine::random(-level * 2, 1);
-            switch (engine::random(0, std::max(3, 10 - level))) {
-                case 0:
-                    w.special = WEAPON_MELEE_SPECIAL::LIFE_STEAL;
-                    w.damage += (int32_t)(MOD_MELEE_LIFE_STEAL * level);
-                    break;
-                case 1:
-                case 2:
-                    w.special = WEAPON_MELEE_SPECIAL::MELEE_ARMOUR_SHRED;
-                    w.damage += (int32_t)(MOD_MELEE_ARMOUR_SHRED * level);
-                    break;
-                default:
-                    w.special = WEAPON_MELEE_SPECIAL::MELEE_NOTHING;
-                    w.damage += (int32_t)(MOD_MELEE_NOTHING * level);
-                    break;
-            }
-            break;
-        case 4:
-            w.name = "Scythe";
-            w.damage = engine::random(-level * 2, 1);
-            switch (engine::random(0, std::max(3, 10 - level))) {
-                case 0:
-                case 1:
-                    w.special = WEAPON_MELEE_SPECIAL::LIFE_STEAL;
-                    w.damage += (int32_t)(MOD_MELEE_LIFE_STEAL * level);
-                    break;
-                case 2:
-                    w.special = WEAPON_MELEE_SPECIAL::SPIN;
-                    w.damage += (int32_t)(MOD_MELEE_SPIN * level);
-                    break;
-                default:
-                    w.special = WEAPON_MELEE_SPECIAL::MELEE_NOTHING;
-                    w.damage += (int32_t)(MOD_MELEE_NOTHING * level);
-                    break;
-            }
-    }
+    w.name = loot_name(name);
     return w;
 }
 
-
 WeaponRanged generate_weapon_ranged(int32_t level) {
     WeaponRanged w{};
-    w.level = level;
+    loot_name_t name;
+    roll_ranged(generator, level, w, name);
     w.slot = EQUIPMENT_SLOTS::WEAPON;
-    switch (engine::random(0, 2)) {
-        case 0:
-            w.name = "Crossbow";
-            w.damage = engine::random(0, level + 1);
-            w.range = 8 + level;
-            switch (engine::random(0, std::max(3, 10 - level))) {
-                case 0:
-                case 1:
-                    w.special = WEAPON_RANGED_SPECIAL::RANGED_ARMOUR_SHRED;
-                    w.damage += (int32_t)(MOD_RANGED_ARMOUR_SHRED * level);
-                    break;
-                case 2:
-                    w.special = WEAPON_RANGED_SPECIAL::PIERCING;
-                    w.damage += (int32_t)(MOD_RANGED_PIERCING * level);
-                default:
-                    w.special = WEAPON_RANGED_SPECIAL::RANGED_NOTHING;
-                    w.damage += (int32_t)(MOD_RANGED_NOTHING * level);
-                    break;
-            }
-            break;
-        case 1:
-            w.name = "Longbow";
-            w.damage = engine::random(-level, level + 1);
-            w.range = 10 + level;
-            switch (engine::random(0, std::max(3, 10 - level))) {
-                case 0:
-                    w.special = WEAPON_RANGED_SPECIAL::EXPLOSIVE;
-                    w.damage += (int32_t)(MOD_RANGED_EXPLOSIVE * level);
-                    break;
-                case 1:
-                case 2:
-                    w.special = WEAPON_RANGED_SPECIAL::PIERCING;
-                    w.damage += (int32_t)(MOD_RANGED_PIERCING * level);
-                default:
-                    w.special = WEAPON_RANGED_SPECIAL::RANGED_NOTHING;
-                    w.damage += (int32_t)(MOD_RANGED_NOTHING * level);
-                    break;
-            }
-            break;
-        case 2:
-            w.name = "Shortbow";
-            w.damage = engine::random(-level, level + 1);
-            w.range = 5 + level;
-            switch (engine::random(0, std::max(3, 10 - level))) {
-                case 0:
-                case 1:
-                    w.special = WEAPON_RANGED_SPECIAL::EXPLOSIVE;
-                    w.damage += (int32_t)(MOD_RANGED_EXPLOSIVE * level);
-                    break;
-                case 2:
-                    w.special = WEAPON_RANGED_SPECIAL::RANGED_ARMOUR_SHRED;
-                    w.damage += (int32_t)(MOD_RANGED_ARMOUR_SHRED * level);
-                default:
-                    w.special = WEAPON_RANGED_SPECIAL::RANGED_NOTHING;
-                    w.damage += (int32_t)(MOD_RANGED_NOTHING * level);
-                    break;
-            }
-            break;
-    }
+    w.name = loot_name(name);
     return w;
 }
 
-
 Armour generate_armour(int32_t level) {
     Armour a{};
-    a.level = level;
-    switch (engine::random(0, 3)) {
-        case 0:
-            a.slot = EQUIPMENT_SLOTS::HEAD;
-            a.regen_speed = engine::random(1, 3);
-            if (engine::random(0, level) > 2) {
-                a.name = "Crown";
-                a.special = ARMOUR_SPECIAL::WEALTHY;
-                a.armour = level * 2 + engine::random(-level, 1);
-                a.hp = level * 10 + engine::random(-level, 1);
-                a.regen = level * 4 + engine::random(-level, 1);
-            } else {
-                a.name = "Helmet";
-                a.special = ARMOUR_SPECIAL::ARMOUR_NOTHING;
-                a.armour = level * 3 + engine::random(0, level + 1);
-                a.hp = level * 15 + engine::random(0, level + 1);
-                a.regen = level * 6 + engine::random(0, level + 1);
-            }
-            break;
-        case 1:
-            a.slot = EQUIPMENT_SLOTS::BODY;
-            a.regen_speed = engine::random(2, 5);
-            if (engine::random(0, level) > 2) {
-                a.name = "Razorplate";
-                a.special = ARMOUR_SPECIAL::THORNS;
-                a.armour = level * 6 + engine::random(-level, 1);
-                a.hp = level * 12 + engine::random(-level, 1);
-                a.regen = level * 2 + engine::random(-level, 1);
-            } else {
-                a.name = "Plate Armour";
-                a.special = ARMOUR_SPECIAL::ARMOUR_NOTHING;
-                a.armour = level * 9 + engine::random(0, level + 1);
-                a.hp = level * 18 + engine::random(0, level + 1);
-                a.regen = level * 3 + engine::random(0, level + 1);
-            }
-            break;
-        case 2:
-            a.slot = EQUIPMENT_SLOTS::BOOTS;
-            a.regen_speed = engine::random(1, 3);
-            if (engine::random(0, level) > 2) {
-                a.name = "Winged Boots";
-                a.special = ARMOUR_SPECIAL::QUICK;
-                a.armour = level * 2 + engine::random(-level, 1);
-                a.hp = level * 8 + engine::random(-level, 1);
-                a.regen = level * 2 + engine::random(-level, 1);
-            } else {
-                a.name = "Plated Boots";
-                a.special = ARMOUR_SPECIAL::ARMOUR_NOTHING;
-                a.armour = level * 3 + engine::random(0, level + 1);
-                a.hp = level * 12 + engine::random(0, level + 1);
-                a.regen = level * 3 + engine::random(0, level + 1);
-            }
-            break;
-    }
+    loot_name_t name;
+    roll_armour(generator, level, a, name);
+    a.name = loot_name(name);
+    return a;
+}
+
+std::size_t MeleeLoot::size() const { return names.size(); }
+
+void MeleeLoot::clear() {
+    names.clear();
+    levels.clear();
+    damage.clear();
+    specials.clear();
+}
+
+WeaponMelee MeleeLoot::get(std::size_t ix) const {
+    WeaponMelee w{};
+    w.slot = EQUIPMENT_SLOTS::WEAPON;
+    w.name = loot_name(names[ix]);
+    w.level = levels[ix];
+    w.damage = damage[ix];
+    w.special = specials[ix];
+    return w;
+}
+
+std::size_t RangedLoot::size() const { return names.size(); }
+
+void RangedLoot::clear() {
+    names.clear();
+    levels.clear();
+    damage.clear();
+    range.clear();
+    specials.clear();
+}
+
+WeaponRanged RangedLoot::get(std::size_t ix) const {
+    WeaponRanged w{};
+    w.slot = EQUIPMENT_SLOTS::WEAPON;
+    w.name = loot_name(names[ix]);
+    w.level = levels[ix];
+    w.damage = damage[ix];
+    w.range = range[ix];
+    w.special = specials[ix];
+    return w;
+}
+
+std::size_t ArmourLoot::size() const { return names.size(); }
+
+void ArmourLoot::clear() {
+    names.clear();
+    slots.clear();
+    levels.clear();
+    armour.clear();
+    hp.clear();
+    regen.clear();
+    regen_speed.clear();
+    specials.clear();
+}
+
+Armour ArmourLoot::get(std::size_t ix) const {
+    Armour a{};
+    a.slot = slots[ix];
+    a.name = loot_name(names[ix]);
+    a.level = levels[ix];
+    a.armour = armour[ix];
+    a.hp = hp[ix];
+    a.regen = regen[ix];
+    a.regen_speed = regen_speed[ix];
+    a.special = specials[ix];
     return a;
 }
+
+void generate_loot(MeleeLoot &out, std::size_t count, int32_t min_level,
+                   int32_t max_level, uint64_t seed) {
+    Rng rng{seed};
+    std::size_t size = out.size() + count;
+    out.names.reserve(size);
+    out.levels.reserve(size);
+    out.damage.reserve(size);
+    out.specials.reserve(size);
+    WeaponMelee w{};
+    loot_name_t name;
+    for (std::size_t i = 0; i < count; ++i) {
+        roll_melee(rng, random_between(rng, min_level, max_level + 1), w,
+                   name);
+        out.names.push_back(name);
+        out.levels.push_back(w.level);
+        out.damage.push_back(w.damage);
+        out.specials.push_back(w.special);
+    }
+}
+
+void generate_loot(RangedLoot &out, std::size_t count, int32_t min_level,
+                   int32_t max_level, uint64_t seed) {
+    Rng rng{seed};
+    std::size_t size = out.size() + count;
+    out.names.reserve(size);
+    out.levels.reserve(size);
+    out.damage.reserve(size);
+    out.range.reserve(size);
+    out.specials.reserve(size);
+    WeaponRanged w{};
+    loot_name_t name;
+    for (std::size_t i = 0; i < count; ++i) {
+        roll_ranged(rng, random_between(rng, min_level, max_level + 1), w,
+                    name);
+        out.names.push_back(name);
+        out.levels.push_back(w.level);
+        out.damage.push_back(w.damage);
+        out.range.push_back(w.range);
+        out.specials.push_back(w.special);
+    }
+}
+
+void generate_loot(ArmourLoot &out, std::size_t count, int32_t min_level,
+                   int32_t max_level, uint64_t seed) {
+    Rng rng{seed};
+    std::size_t size = out.size() + count;
+    out.names.reserve(size);
+    out.slots.reserve(size);
+    out.levels.reserve(size);
+    out.armour.reserve(size);
+    out.hp.reserve(size);
+    out.regen.reserve(size);
+    out.regen_speed.reserve(size);
+    out.specials.reserve(size);
+    Armour a{};
+    loot_name_t name;
+    for (std::size_t i = 0; i < count; ++i) {
+        roll_armour(rng, random_between(rng, min_level, max_level + 1), a,
+                    name);
+        out.names.push_back(name);
+        out.slots.push_back(a.slot);
+        out.levels.push_back(a.level);
+        out.armour.push_back(a.armour);
+        out.hp.push_back(a.hp);
+        out.regen.push_back(a.regen);
+        out.regen_speed.push_back(a.regen_speed);
+        out.specials.push_back(a.special);
+    }
+}
+
+#ifdef LOOT_BENCH
+#include <chrono>
+#include <iostream>
+
+template <class Loot> static void bench(const char *kind) {
+    constexpr std::size_t COUNT = 100000;
+    Loot a, b;
+    auto start = std::chrono::steady_clock::now();
+    generate_loot(a, COUNT, 1, 20, 1234);
+    auto end = std::chrono::steady_clock::now();
+    generate_loot(b, COUNT, 1, 20, 1234);
+    bool same = a.names == b.names && a.levels == b.levels;
+    std::cout << COUNT << " " << kind << ": "
+              << std::chrono::duration_cast<std::chrono::microseconds>(end -
+                                                                       start)
+                     .count()
+              << " us, first " << a.get(0).name
+              << (same ? "" : ", results differ for the same seed")
+              << std::endl;
+}
+
+int main() {
+    bench<MeleeLoot>("melee weapons");
+    bench<RangedLoot>("ranged weapons");
+    bench<ArmourLoot>("armour");
+
+    constexpr int COUNT = 100000;
+    auto start = std::chrono::steady_clock::now();
+    int32_t sum = 0;
+    for (int i = 0; i < COUNT; ++i) {
+        sum += generate_weapon_melee(1 + i % 20).damage;
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::cout << COUNT << " single melee weapons: "
+              << std::chrono::duration_cast<std::chrono::microseconds>(end -
+                                                                       start)
+                     .count()
+              << " us (" << sum << ")" << std::endl;
+    return 0;
+}
+#endif
@@ -1,5 +1,8 @@
+#pragma once
 #include <cstdint>
 #include <string>
+#include <string_view>
+#include <vector>
 
 
 
@@ -14,6 +17,9 @@ struct Equipment {
     EQUIPMENT_SLOTS slot;
     std::string name;
 
+    // Polymorphic, so equipped items can be told apart by type
+    virtual ~Equipment() = default;
+
     // virtual void render(int32_t offset_x, int32_t offset_y) = 0;
 };
 
@@ -63,4 +69,62 @@ struct Armour : public Equipment {
 
 WeaponMelee generate_weapon_melee(int32_t level);
 WeaponRanged generate_weapon_ranged(int32_t level);
-Armour generate_armour(int32_t level);
\ No newline at end of file
+Armour generate_armour(int32_t level);
+
+
+// Name of a generated item, looked up with loot_name.
+typedef uint16_t loot_name_t;
+
+std::string_view loot_name(loot_name_t name);
+
+/**
+ * Generated melee weapons, with the stats of item i at index i.
+ */
+struct MeleeLoot {
+    std::vector<loot_name_t> names;
+    std::vector<int32_t> levels, damage;
+    std::vector<WEAPON_MELEE_SPECIAL> specials;
+
+    [[nodiscard]] std::size_t size() const;
+    void clear();
+    [[nodiscard]] WeaponMelee get(std::size_t ix) const;
+};
+
+/**
+ * Generated ranged weapons, with the stats of item i at index i.
+ */
+struct RangedLoot {
+    std::vector<loot_name_t> names;
+    std::vector<int32_t> levels, damage, range;
+    std::vector<WEAPON_RANGED_SPECIAL> specials;
+
+    [[nodiscard]] std::size_t size() const;
+    void clear();
+    [[nodiscard]] WeaponRanged get(std::size_t ix) const;
+};
+
+/**
+ * Generated armour, with the stats of item i at index i.
+ */
+struct ArmourLoot {
+    std::vector<loot_name_t> names;
+    std::vector<EQUIPMENT_SLOTS> slots;
+    std::vector<int32_t> levels, armour, hp, regen, regen_speed;
+    std::vector<ARMOUR_SPECIAL> specials;
+
+    [[nodiscard]] std::size_t size() const;
+    void clear();
+    [[nodiscard]] Armour get(std::size_t ix) const;
+};
+
+/**
+ * Appends count items to out, with levels in [min_level, max_level].
+ * Random numbers are drawn from a stream started from seed, so the same
+ * arguments always give the same items, independent of other random calls.
+ */
+void generate_loot(MeleeLoot &out, std::size_t count, int32_t min_level,
+                   int32_t max_level, uint64_t seed);
+void generate_loot(RangedLoot &out, std::size_t count, int32_t min_level,
+                   int32_t max_level, uint64_t seed);
+void generate_loot(ArmourLoot &out, std::size_t count, int32_t min_level,
+                   int32_t max_level, uint64_t seed);
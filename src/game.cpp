@@ -9,7 +9,7 @@
 
 #include "utils.h"
 
-GameState::GameState() : State()  { enemies.reserve(32); }
+GameState::GameState() : State()  { world.reserve(32); }
 
 void GameState::set_font_size() {
     double new_dpi_scale = std::min(static_cast<double>(window_state->window_width) /
@@ -23,6 +23,7 @@ void GameState::set_font_size() {
     dpi_scale = new_dpi_scale;
     int hpdi = 72, vdpi = 72;
     TTF_SetFontSizeDPI(gFont, 20, hpdi, vdpi);
+    gGlyphs.reset();
     return;
 }
 
@@ -77,59 +78,51 @@ void GameState::init(WindowState *window_state) {
         SDL_CloseIO(file);
     }
 
-    EVT_PRINT = SDL_RegisterEvents(10);
-    EVT_MOVE = EVT_PRINT + 1;
-    EVT_ROTL = EVT_PRINT + 2;
-    EVT_ROTR = EVT_PRINT + 3;
-    EVT_READ_TILE = EVT_PRINT + 4;
-    EVT_MOVE_FORWARDS = EVT_PRINT + 5;
-
-    program.set_events(EVT_PRINT);
+    // The program stops at its first move or turn, so one slot is enough
+    EVT_MOVE = events.register_queue<MoveAction>(1);
+    EVT_ROTL = events.register_queue<EmptyAction>(1);
+    EVT_ROTR = events.register_queue<EmptyAction>(1);
+    EVT_FORWARDS = events.register_queue<EmptyAction>(1);
+    events.register_callback(EVT_MOVE, on_move, this);
+    events.register_callback(EVT_ROTL, on_rotate_left, this);
+    events.register_callback(EVT_ROTR, on_rotate_right, this);
+    events.register_callback(EVT_FORWARDS, on_forwards, this);
 
     comps.set_window_state(window_state);
-    int log_size = 8;
     int log_w = 500;
-    int log_h = 2 * BOX_TEXT_MARGIN + log_size * BOX_LINE_HEIGHT;
+    int log_h = 2 * BOX_TEXT_MARGIN + LOG_ROWS * BOX_LINE_HEIGHT;
     int log_x = WIDTH / 2 - log_w / 2;
     int log_y = HEIGHT - log_h;
-    for (int i = 0; i < log_size; ++i) {
-        log.push_back(comps.add(TextBox(log_x + BOX_TEXT_MARGIN,
-                                        log_y + BOX_LINE_HEIGHT * i + BOX_TEXT_MARGIN,
-                                        log_w - 2 * BOX_TEXT_MARGIN, BOX_LINE_HEIGHT,
-                                        "", *window_state)));
-        log.back()->set_align(Alignment::LEFT);
-    }
+    log = LogConsole(log_x + BOX_TEXT_MARGIN, log_y + BOX_TEXT_MARGIN,
+                     log_w - 2 * BOX_TEXT_MARGIN, LOG_ROWS * BOX_LINE_HEIGHT,
+                     BOX_LINE_HEIGHT, LOG_CAPACITY);
     comps.add(Box(log_x, log_y, log_w, log_h, 4));
 
-    // constexpr int32_t tilesize = 10;
-    textures.reserve(14);
-    Texture* tex = new Texture{};
-    tex->load_from_file("assets/Tile.png", TILE_SIZE, TILE_SIZE);
-    textures.emplace_back(tex);
-    maze.set_texture(textures[0].get());
-    tex = new Texture{};
-    tex->load_from_file("assets/Robot.png", TILE_SIZE, TILE_SIZE);
-    textures.emplace_back(tex);
-
+    atlas.load_directory("assets", TILE_SIZE, TILE_SIZE);
+    atlas.build();
+    maze.set_sprite(&atlas.get("Tile"));
 
-    player.reset(new Player{  maze.start.first, maze.start.second, textures[1].get() });
+    player.reset(new Player{ world, maze.start.first, maze.start.second, &atlas.get("Robot") });
 
+    Rng rng = engine::make_stream(RNG_STREAM_SPAWN);
     for (int32_t i = 0; i < 5; i++) {
-        auto slime = new Slime{ engine::random(0, 20), engine::random(0, 20), i };
-        enemies.emplace_back(slime);
+        auto x = static_cast<int32_t>(rng.range(0, 20));
+        auto y = static_cast<int32_t>(rng.range(0, 20));
+        spawn_slime(world, x, y, i);
     }
 
 }
 
 void GameState::render() {
     box.render();
-    maze.render(0, 0);
+    maze.render(batch, 0, 0);
+    batch.flush();
     comps.render(0, 0);
+    log.render(0, 0);
 
-    for (size_t i{0}; i < enemies.size(); ++i) {
-        enemies[i]->render(0, 0);
-    }
-    player->render(0, 0);
+    render_entities(world, batch, 0, 0);
+    player->render(batch, 0, 0, window_state->tick_alpha);
+    batch.flush();
 }
 void GameState::tick(const Uint64 delta, StateStatus &res) {
     if (paused) {
@@ -137,9 +130,12 @@ void GameState::tick(const Uint64 delta, StateStatus &res) {
         if (action_delay <= 0) {
             action_delay = 0;
             paused = false;
-            program.resume();
         }
     }
+    if (!paused && program.is_running()) {
+        run_program();
+        events.handle_events();
+    }
     res = next_state;
     if (next_state.will_leave()) {
         LOG_DEBUG("Saving...");
@@ -152,12 +148,34 @@ void GameState::tick(const Uint64 delta, StateStatus &res) {
             }
             SDL_CloseIO(file);
         }
+        if (!trace.empty()) {
+            trace.save("trace.bin");
+        }
         return;
     }
 
-    player.get()->tick(maze, enemies, player_mov, vec2i{});
+    player.get()->tick(maze, combat, player_mov, vec2i{});
+    robots.tick(world, maze, jobs);
+    for (const std::string &line : robots.get_output()) {
+        log.print(line);
+    }
+    enemy_ai.tick(world, maze, jobs, combat);
+    combat.resolve(world);
+    for (entity_t dead : combat.get_dead()) {
+        if (dead == player->get_entity()) {
+            LOG_INFO("Robot destroyed");
+        } else {
+            world.despawn(dead);
+        }
+    }
+
+    ui_time += delta;
+    box.tick(ui_time / time_scale);
+    ui_time %= time_scale;
+}
 
-    box.tick(delta);
+Uint32 GameState::get_time_scale() const {
+    return time_scale;
 }
 
 void GameState::handle_up(SDL_Keycode key, Uint8 mouse) {
@@ -204,10 +222,9 @@ void GameState::handle_down(const SDL_Keycode key, const Uint8 mouse) {
             if (!p.parse_lines(lines)) {
                 box.set_errors(p.errors);
             } else {
-                log_ix = 0;
-                for(auto& b: log) {
-                    b->set_text("");
-                }
+                log.clear();
+                history.clear();
+                trace.begin(engine::get_world_seed(), lines);
                 program.load_program(std::move(p.all_statements),
                                      std::move(p.all_expressions),
                                      std::move(p.all_functions),
@@ -235,6 +252,17 @@ void GameState::handle_down(const SDL_Keycode key, const Uint8 mouse) {
             case SDLK_A:
                 player_mov = vec2i_from_dir(DIR_LEFT);
                 break;
+            case SDLK_R:
+                rewind();
+                break;
+            case SDLK_N:
+                spawn_robot();
+                break;
+            case SDLK_T:
+                time_scale = time_scale >= MAX_TIME_SCALE ? 1 : time_scale * 10;
+                ui_time = 0;
+                LOG_INFO("Time scale: %ux", time_scale);
+                break;
             default:
                 break;
         }
@@ -245,6 +273,12 @@ void GameState::resume() {
 
 }
 
+void GameState::handle_wheel(const SDL_MouseWheelEvent &e) {
+    if (log.is_pressed(window_state->mouseX, window_state->mouseY)) {
+        log.scroll(static_cast<int>(e.y));
+    }
+}
+
 void GameState::handle_textinput(const SDL_TextInputEvent &e) {
     if (e.text[0] == '\0' || e.text[1] != '\0') {
         LOG_DEBUG("Invalid input received");
@@ -254,60 +288,135 @@ void GameState::handle_textinput(const SDL_TextInputEvent &e) {
     box.input_char(c);
 }
 
-void GameState::handle_user_event(SDL_UserEvent &e) {
-    if (e.type == EVT_MOVE_FORWARDS) {
-        player->forward(maze);
-        paused = true;
-        action_delay = 500;
-    } else if (e.type == EVT_READ_TILE) {
-      auto* p = static_cast<ReadTile *>(e.data1);
-      p->m.lock();
-      p->is_open = player->read_forward(maze);
-      p->m.unlock();
-      program.resume();
-    } else if (e.type == EVT_ROTL) {
-        player->rotate_left();
-        paused = true;
-        action_delay = 500;
-    } else if (e.type == EVT_ROTR) {
-        player->rotate_right();
-        paused = true;
-        action_delay = 500;
-    } else if (e.type == EVT_MOVE) {
-        uint32_t v = (uintptr_t) e.data1;
-        int64_t x = 0, y = 0;
-        if ((v & 0b11) == 0b11) {
-            y = -1;
-        } else if ((v & 0b11) == 0b01) {
-            y = 1;
-        }
-        if ((v & 0b1100) == 0b1100) {
-            x = -1;
-        } else if ((v & 0b1100) == 0b0100) {
-            x = 1;
+void GameState::delay_action() {
+    if (history.size() >= REWIND_HISTORY) {
+        history.pop_front();
+    }
+    history.push_back({program.snapshot(), world, enemy_ai, robots.snapshot(),
+                       combat, *player, trace.mark()});
+    paused = true;
+    action_delay = 500;
+}
+
+void GameState::rewind() {
+    // The newest state is the current one
+    if (history.size() < 2) {
+        return;
+    }
+    history.pop_back();
+    const GameSnapshot &snapshot = history.back();
+    program.restore(snapshot.program);
+    // Robots are restored with the world, so their entities and the
+    // generations of the world's handles stay in step
+    world = snapshot.world;
+    enemy_ai = snapshot.enemy_ai;
+    robots.restore(snapshot.robots);
+    combat = snapshot.combat;
+    *player = snapshot.player;
+    trace.truncate(snapshot.trace);
+    LOG_INFO("Rewound to action %llu",
+             static_cast<unsigned long long>(trace.size()));
+    paused = true;
+    action_delay = 500;
+}
+
+void GameState::spawn_robot() {
+    std::shared_ptr<const Code> code = program.get_code();
+    if (code == nullptr) {
+        LOG_INFO("Run a program before adding robots");
+        return;
+    }
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        vec2i pos{engine::random(0, MAZE_WIDTH),
+                  engine::random(0, MAZE_HEIGHT)};
+        if (maze.is_open(pos.x, pos.y) && !world.is_occupied(pos)) {
+            robots.spawn(world, pos, std::move(code));
+            LOG_INFO("Robots: %llu",
+                     static_cast<unsigned long long>(robots.size()));
+            return;
         }
-        std::cout << "Move " << x << ", " << y  << ", " << e.timestamp << std::endl;
-        player->move(maze, x, y);
-
-        paused = true;
-        action_delay = 500;
-    } else if (e.type == EVT_PRINT) {
-        auto* s = static_cast<std::string*>(e.data1);
-        if (log_ix == log.size()) {
-            for (int i = 0; i < log.size() - 1; ++i) {
-                log[i]->set_text(log[i + 1]->get_text());
+    }
+    LOG_INFO("No free tile for a robot");
+}
+
+void GameState::run_program() {
+    uint32_t budget = PROGRAM_STEP_BUDGET;
+    while (budget > 0) {
+        switch (program.run_slice(budget)) {
+        case Program::RunStatus::ACTION:
+            if (!handle_action(program.get_action())) {
+                return;
             }
-        } else {
-            ++log_ix;
+            break;
+        case Program::RunStatus::ERROR:
+            trace.print(program.error_buffer);
+            log.print(program.error_buffer);
+            return;
+        case Program::RunStatus::END:
+            // Runs again from the start next tick
+        case Program::RunStatus::YIELD:
+            return;
         }
-        log[log_ix - 1]->set_text(*s);
-        for (int i = 1; i< log.size(); ++i) {
+    }
+}
 
+bool GameState::handle_action(const ProgramAction &action) {
+    switch (action.type) {
+    case ProgramAction::NONE:
+        return true;
+    case ProgramAction::PRINT: {
+        std::string_view text = program.print_buffer;
+        if (text.empty()) {
+            text = "\n";
         }
-        std::cout << *s << std::flush;
-        delete s;
-        program.resume();
+        trace.print(text);
+        log.print(text);
+        return true;
+    }
+    case ProgramAction::READ_FRONT: {
+        bool is_open = player->read_forward(maze);
+        trace.read_tile(is_open);
+        program.set_read_result(is_open);
+        return true;
     }
+    case ProgramAction::MOVE:
+        events.queue_event(EVT_MOVE, MoveAction{action.dx, action.dy});
+        break;
+    case ProgramAction::ROTL:
+        events.queue_event(EVT_ROTL, EmptyAction{});
+        break;
+    case ProgramAction::ROTR:
+        events.queue_event(EVT_ROTR, EmptyAction{});
+        break;
+    case ProgramAction::FORWARDS:
+        events.queue_event(EVT_FORWARDS, EmptyAction{});
+        break;
+    }
+    return false;
+}
+
+void GameState::on_move(const MoveAction *action, GameState *self) {
+    self->trace.move(action->dx, action->dy);
+    self->player->move(self->maze, action->dx, action->dy);
+    self->delay_action();
+}
+
+void GameState::on_rotate_left(const EmptyAction *, GameState *self) {
+    self->trace.rotate_left();
+    self->player->rotate_left();
+    self->delay_action();
+}
+
+void GameState::on_rotate_right(const EmptyAction *, GameState *self) {
+    self->trace.rotate_right();
+    self->player->rotate_right();
+    self->delay_action();
+}
+
+void GameState::on_forwards(const EmptyAction *, GameState *self) {
+    self->trace.forwards();
+    self->player->forward(self->maze);
+    self->delay_action();
 }
 
 void GameState::handle_focus_change(bool focus) {
@@ -318,3 +427,8 @@ void GameState::handle_focus_change(bool focus) {
     }
 }
 
+void GameState::handle_render_reset() {
+    maze.invalidate();
+    box.invalidate();
+}
+
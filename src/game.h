@@ -3,11 +3,37 @@
 #include "language.h"
 #include "engine/game.h"
 #include "engine/ui.h"
+#include "engine/console.h"
 #include "maze.h"
+#include <deque>
 #include <vector>
-#include "enemy.h"
 #include <memory>
 #include "player.h"
+#include "ai.h"
+#include "robots.h"
+#include "trace.h"
+#include "engine/events.h"
+#include "engine/jobs.h"
+
+// Payloads of the player's moves and turns, queued on GameState::events
+struct MoveAction {
+    int32_t dx, dy;
+};
+
+struct EmptyAction {};
+
+/**
+ * State of the program and the world after a robot action, for rewinding.
+ */
+struct GameSnapshot {
+    ProgramSnapshot program;
+    World world;
+    EnemyAI enemy_ai;
+    Robots::Snapshot robots;
+    Combat combat;
+    Player player;
+    Trace::Mark trace;
+};
 
 class GameState : public State {
 public:
@@ -28,27 +54,82 @@ public:
 
     void handle_up(SDL_Keycode key, Uint8 mouse) override;
 
+    void handle_wheel(const SDL_MouseWheelEvent &e) override;
+
     void handle_textinput(const SDL_TextInputEvent &e) override;
 
     void handle_size_change() override;
 
     void handle_focus_change(bool focus) override;
 
-    void handle_user_event(SDL_UserEvent &e) override;
+    void handle_render_reset() override;
+
+    [[nodiscard]] Uint32 get_time_scale() const override;
 
     void menu_change(bool visible);
 
     void clock_tick();
 private:
+    /**
+     * Runs the program for one tick, until it moves or turns, or the budget
+     * runs out.
+     */
+    void run_program();
+
+    /**
+     * Carries out the action the program stopped at. Moves and turns are
+     * queued, to be handled once the program has stopped for this tick.
+     * Returns true if the program can go on running this tick.
+     */
+    bool handle_action(const ProgramAction &action);
+
+    static void on_move(const MoveAction *action, GameState *self);
+
+    static void on_rotate_left(const EmptyAction *action, GameState *self);
+
+    static void on_rotate_right(const EmptyAction *action, GameState *self);
+
+    static void on_forwards(const EmptyAction *action, GameState *self);
+
+    /**
+     * Saves the state after an action for rewinding, and delays resuming
+     * the program by the time of one action.
+     */
+    void delay_action();
+
+    /**
+     * Goes back to the state after the action before the last one.
+     */
+    void rewind();
+
+    /**
+     * Adds a robot on a free tile, running the loaded program.
+     */
+    void spawn_robot();
+
     StateStatus next_state;
+    // Moves and turns of the program, handled after it has run in tick
+    Events events;
+    event_t EVT_MOVE, EVT_ROTL, EVT_ROTR, EVT_FORWARDS;
+    // Run a slice at a time from tick, on the main thread
     Program program;
+    // Actions of the current program run, saved on exit for replaying
+    Trace trace;
 
     Maze maze;
 
-    std::vector<std::unique_ptr<Texture>> textures;
+    TextureAtlas atlas;
+    SpriteBatch batch;
+    // Declared before player, which refers to it
+    World world;
+    EnemyAI enemy_ai;
+    Robots robots;
+    Combat combat;
+    JobSystem jobs;
     std::unique_ptr<Player> player;
     vec2i player_mov;
-    std::vector<std::unique_ptr<Enemy>> enemies;
+    // States after the last actions of the program, the newest last
+    std::deque<GameSnapshot> history;
 
     void set_font_size();
 
@@ -59,13 +140,16 @@ private:
     Editbox box;
     Components comps;
 
-    std::vector<Component<TextBox>> log;
-    int log_ix = 0;
+    LogConsole log;
 
     double dpi_scale = 0.0;
 
     bool paused = false;
     Sint64 action_delay = 0;
 
-    Uint32 EVT_PRINT, EVT_MOVE, EVT_ROTR, EVT_ROTL, EVT_READ_TILE, EVT_MOVE_FORWARDS;
+    // Simulation speed, raised to fast forward programs
+    Uint32 time_scale = 1;
+    // Simulated milliseconds not yet passed on to the editbox, which
+    // animates in real time
+    Uint64 ui_time = 0;
 };
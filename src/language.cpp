@@ -1,179 +1,982 @@
 #include "language.h"
 #include "engine/engine.h"
-#include <SDL3/SDL.h>
-#include <chrono>
-#include <sstream>
+#include <charconv>
+#include <cstdio>
 
-void Program::pause() { paused.store(true); }
+// Max depth of function calls
+constexpr std::size_t MAX_FRAMES = 1024;
 
-void Program::resume() { paused.store(false); }
+bool Value::boolean() const {
+    switch (type) {
+    case TUPLE:
+    case SMALL_TUPLE:
+    case LIST:
+        return length() != 0;
+    case MAP:
+        return MapTable::size(*map.items) != 0;
+    case STRING:
+        return !str->empty();
+    case DOUBLE:
+        return d != 0.0;
+    case INT64:
+        return i != 0;
+    case BOOL:
+        return b;
+    case NONE:
+    default:
+        return false;
+    }
+}
+
+void Value::write(std::string &out, int depth) const {
+    switch (type) {
+    case TUPLE:
+    case SMALL_TUPLE:
+        out += '(';
+        for (std::size_t ix = 0; ix < length(); ++ix) {
+            get(ix).write(out, depth);
+            out += ',';
+        }
+        out += ')';
+        break;
+    case LIST:
+        if (depth == 0) {
+            out += "[...]";
+            break;
+        }
+        out += '[';
+        for (std::size_t ix = 0; ix < length(); ++ix) {
+            get(ix).write(out, depth - 1);
+            out += ',';
+        }
+        out += ']';
+        break;
+    case MAP:
+        if (depth == 0) {
+            out += "{...}";
+            break;
+        }
+        out += '{';
+        MapTable::for_each(*map.items, [&out, depth](const Value &key,
+                                                     const Value &val) {
+            key.write(out, depth - 1);
+            out += ": ";
+            val.write(out, depth - 1);
+            out += ',';
+        });
+        out += '}';
+        break;
+    case STRING:
+        out += *str;
+        break;
+    case DOUBLE: {
+        // The same as the default formatting of streams
+        char buf[32];
+        int len = std::snprintf(buf, sizeof(buf), "%g", d);
+        out.append(buf, static_cast<std::size_t>(len));
+        break;
+    }
+    case BOOL:
+        out += b ? "True" : "False";
+        break;
+    case INT64: {
+        char buf[24];
+        auto res = std::to_chars(buf, buf + sizeof(buf), i);
+        out.append(buf, res.ptr);
+        break;
+    }
+    case NONE:
+        out += "None";
+        break;
+    }
+}
+
+/**
+ * Returns the hash of key, equal for keys that compare equal, or throws
+ * RuntimeError if it can not be a key.
+ */
+static uint64_t hash_key(const Value &key, int32_t lineno) {
+    if (key.is_tuple()) {
+        // The same for small tuples and others
+        uint64_t hash = 0x9e3779b97f4a7c15ull + key.length();
+        for (std::size_t ix = 0; ix < key.length(); ++ix) {
+            hash = (hash ^ hash_key(key.get(ix), lineno)) * 0x100000001b3ull;
+            hash ^= hash >> 29;
+        }
+        return hash;
+    }
+    // Doubles outside [-2^63, 2^63), including NaN and infinity, can not be
+    // converted to int64_t
+    constexpr double INT64_LIMIT = 9223372036854775808.0;
+    int64_t i;
+    if (key.type == Value::INT64) {
+        i = key.i;
+    } else if (key.type == Value::DOUBLE && key.d >= -INT64_LIMIT &&
+               key.d < INT64_LIMIT &&
+               static_cast<double>(static_cast<int64_t>(key.d)) == key.d) {
+        i = static_cast<int64_t>(key.d);
+    } else {
+        throw RuntimeError(lineno, "Invalid key");
+    }
+    // Finalizer of MurmurHash3, so that nearby keys spread out
+    auto x = static_cast<uint64_t>(i);
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+// Compares keys already checked by hash_key
+static bool keys_equal(const Value &a, const Value &b) {
+    if (a.is_tuple() || b.is_tuple()) {
+        if (!a.is_tuple() || !b.is_tuple() || a.length() != b.length()) {
+            return false;
+        }
+        for (std::size_t ix = 0; ix < a.length(); ++ix) {
+            if (!keys_equal(a.get(ix), b.get(ix))) {
+                return false;
+            }
+        }
+        return true;
+    }
+    auto as_int = [](const Value &v) {
+        return v.type == Value::INT64 ? v.i : static_cast<int64_t>(v.d);
+    };
+    return as_int(a) == as_int(b);
+}
+
+std::vector<Value> MapTable::make() {
+    std::vector<Value> items(HEADER + 2 * MIN_SLOTS);
+    items[0] = Value(static_cast<int64_t>(0));
+    items[1] = Value(static_cast<int64_t>(0));
+    return items;
+}
+
+std::size_t MapTable::size(const std::vector<Value> &items) {
+    return static_cast<std::size_t>(items[0].i);
+}
+
+std::size_t MapTable::probe(const Value &key, uint64_t hash,
+                            bool &found) const {
+    // Slots are a power of two, and never all used
+    std::size_t mask = (items.size() - HEADER) / 2 - 1;
+    std::size_t slot = hash & mask;
+    std::size_t removed = 0;
+    while (true) {
+        std::size_t ix = HEADER + 2 * slot;
+        const Value &k = items[ix];
+        if (k.type == Value::NONE) {
+            found = false;
+            return removed != 0 ? removed : ix;
+        } else if (k.type == Value::BOOL) {
+            if (removed == 0) {
+                removed = ix;
+            }
+        } else if (keys_equal(k, key)) {
+            found = true;
+            return ix;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+void MapTable::grow() {
+    std::size_t count = size(items);
+    std::size_t slots = MIN_SLOTS;
+    // At most three quarters used, counting the entry about to be added
+    while ((count + 1) * 4 > slots * 3) {
+        slots *= 2;
+    }
+    std::vector<Value> old = std::move(items);
+    items = make();
+    items.resize(HEADER + 2 * slots);
+    items[0] = Value(static_cast<int64_t>(count));
+    items[1] = Value(static_cast<int64_t>(count));
+    for_each(old, [this, slots](const Value &key, const Value &val) {
+        std::size_t slot = hash_key(key, 0) & (slots - 1);
+        while (items[HEADER + 2 * slot].type != Value::NONE) {
+            slot = (slot + 1) & (slots - 1);
+        }
+        items[HEADER + 2 * slot] = key;
+        items[HEADER + 2 * slot + 1] = val;
+    });
+}
+
+Value *MapTable::find(const Value &key, int32_t lineno) {
+    bool found;
+    std::size_t ix = probe(key, hash_key(key, lineno), found);
+    return found ? &items[ix + 1] : nullptr;
+}
+
+void MapTable::insert(const Value &key, Value val, int32_t lineno) {
+    uint64_t hash = hash_key(key, lineno);
+    bool found;
+    std::size_t ix = probe(key, hash, found);
+    if (found) {
+        items[ix + 1] = std::move(val);
+        return;
+    }
+    if (items[ix].type == Value::NONE) {
+        std::size_t slots = (items.size() - HEADER) / 2;
+        if ((static_cast<std::size_t>(items[1].i) + 1) * 4 > slots * 3) {
+            grow();
+            ix = probe(key, hash, found);
+        }
+        if (items[ix].type == Value::NONE) {
+            ++items[1].i;
+        }
+    }
+    items[ix] = key;
+    items[ix + 1] = std::move(val);
+    ++items[0].i;
+}
+
+bool MapTable::remove(const Value &key, int32_t lineno) {
+    bool found;
+    std::size_t ix = probe(key, hash_key(key, lineno), found);
+    if (!found) {
+        return false;
+    }
+    items[ix] = Value(false);
+    items[ix + 1] = Value();
+    --items[0].i;
+    return true;
+}
+
+void Compiler::compile(const Statement *entry) {
+    entry->compile(*this);
+    emit(Instruction::END, 0);
+    // Function bodies may define more functions
+    for (std::size_t ix = 0; ix < functions.size(); ++ix) {
+        const Function *f = functions[ix];
+        code.functions[ix].entry = next();
+        in_function = true;
+        for (const Statement *s : f->statements) {
+            s->compile(*this);
+        }
+        int32_t lineno = code.instructions.back().lineno;
+        emit_constant(Value(), lineno);
+        emit(Instruction::RETURN, lineno);
+    }
+}
+
+int32_t Compiler::emit(Instruction::Op op, int32_t lineno, int32_t a,
+                       int32_t b) {
+    code.instructions.push_back({op, a, b, lineno});
+    return static_cast<int32_t>(code.instructions.size() - 1);
+}
+
+int32_t Compiler::emit_jump(Instruction::Op op, int32_t lineno, int32_t b) {
+    return emit(op, lineno, -1, b);
+}
+
+void Compiler::patch(int32_t ix) { code.instructions[ix].a = next(); }
+
+int32_t Compiler::next() const {
+    return static_cast<int32_t>(code.instructions.size());
+}
+
+void Compiler::emit_constant(Value value, int32_t lineno) {
+    assert(value.type != Value::TUPLE);
+    code.constants.push_back(std::move(value));
+    emit(Instruction::CONSTANT, lineno,
+         static_cast<int32_t>(code.constants.size() - 1));
+}
+
+void Compiler::emit_string(const std::string &text, int32_t lineno) {
+    auto it = interned.find(text);
+    if (it == interned.end()) {
+        const std::string &str = code.strings.emplace_back(text);
+        code.constants.emplace_back(Value::String{&str});
+        auto ix = static_cast<int32_t>(code.constants.size() - 1);
+        it = interned.insert({text, ix}).first;
+    }
+    emit(Instruction::CONSTANT, lineno, it->second);
+}
+
+void Compiler::emit_fail(const char *cause, int32_t lineno) {
+    code.errors.emplace_back(cause);
+    emit(Instruction::FAIL, lineno,
+         static_cast<int32_t>(code.errors.size() - 1));
+}
+
+int32_t Compiler::add_function(const Function *f) {
+    functions.push_back(f);
+    code.functions.push_back({f->params, -1});
+    return static_cast<int32_t>(functions.size() - 1);
+}
 
 void Program::load_program(std::vector<std::unique_ptr<Statement>> statements,
-                           std::vector<std::unique_ptr<Expression>> expressions,
-                           std::vector<std::unique_ptr<Function>> all_funcs,
+                           std::vector<std::unique_ptr<Expression>> /* expressions */,
+                           std::vector<std::unique_ptr<Function>> /* all_funcs */,
                            Statement *entry) {
-    if (run_thread.joinable()) {
-        stop();
-    }
-    all_exprs = std::move(expressions);
-    all_statements = std::move(statements);
-    all_functions = std::move(all_funcs);
-    entrypoint = entry;
+    stop();
+    // The tree is only needed to compile, and freed here
+    statements.emplace_back(entry);
+    auto compiled = std::make_shared<Code>();
+    Compiler compiler{*compiled};
+    compiler.compile(entry);
+    code = std::move(compiled);
 }
 
-void entry(Program *program) {
-    std::cout << "Run thread started" << std::endl;
+Program::RunStatus Program::run_slice(uint32_t &budget) {
+    assert(running);
+    const std::vector<Instruction> &instructions = code->instructions;
+    action.type = ProgramAction::NONE;
     try {
-        while (true) {
-            program->entrypoint->evaluate(*program);
-            using namespace std::chrono_literals;
-            std::this_thread::sleep_for(10ms);
+        while (budget > 0) {
+            const Instruction &in = instructions[state.pc];
+            ++state.pc;
+            --budget;
+            if (in.op == Instruction::END) {
+                state.pc = 0;
+                return RunStatus::END;
+            }
+            execute(in);
+            // The pc is past the builtin, so the next slice continues
+            // after the action
+            if (action.type != ProgramAction::NONE) {
+                return RunStatus::ACTION;
+            }
         }
     } catch (RuntimeError &e) {
-        SDL_Event evt;
-        evt.type = program->EVT_PRINT;
-        auto *s = new std::string("Runtime error: ");
-        evt.user.data1 = s;
-        *s += e.cause + " at line " + std::to_string(e.lineno + 1) + "\n";
-        SDL_PushEvent(&evt);
-    } catch (StopException &e) {
-        std::cout << "Stopped" << std::endl;
+        std::string &s = error_buffer;
+        s = "Runtime error: ";
+        s += e.cause + " at line " + std::to_string(e.lineno + 1) + "\n";
+        running = false;
+        return RunStatus::ERROR;
     }
+    return RunStatus::YIELD;
 }
 
-void Program::stop() {
-    if (!run_thread.joinable()) {
-        return;
+const ProgramAction &Program::get_action() const { return action; }
+
+void Program::set_read_result(bool is_open) { state.read_result = is_open; }
+
+/**
+ * Returns ix as an index into a tuple or list of size elements, allowing
+ * size itself if end is set, as the end of a slice.
+ */
+static std::size_t get_index(const Value &ix, std::size_t size, bool end,
+                             int32_t lineno) {
+    int64_t i;
+    if (ix.type == Value::DOUBLE) {
+        i = static_cast<int64_t>(ix.d);
+        if (static_cast<double>(i) != ix.d) {
+            throw RuntimeError(lineno, "Non-integer index");
+        }
+    } else if (ix.type == Value::INT64) {
+        i = ix.i;
+    } else {
+        throw RuntimeError(lineno, "Invalid argument");
     }
-    running.store(false);
-    run_thread.join();
-    all_functions.clear();
-    all_exprs.clear();
-    all_statements.clear();
+    if (i < 0 || static_cast<uint64_t>(i) > size ||
+        (!end && static_cast<uint64_t>(i) == size)) {
+        throw RuntimeError(lineno, "Index out of bounds");
+    }
+    return static_cast<std::size_t>(i);
+}
 
-    globals.clear();
-    scopes.clear();
+void Program::execute(const Instruction &in) {
+    switch (in.op) {
+    case Instruction::CONSTANT:
+        push(code->constants[in.a]);
+        break;
+    case Instruction::LOAD:
+        push(get_var(in.a, in.lineno));
+        break;
+    case Instruction::STORE:
+        set_var(in.a, pop(), false);
+        break;
+    case Instruction::POP:
+        state.stack.erase(state.stack.end() - in.a, state.stack.end());
+        break;
+    case Instruction::BINARY: {
+        Value right = pop();
+        Value left = pop();
+        push(BinOp::apply(static_cast<BinOp::Type>(in.a), left, right, *this,
+                          in.lineno));
+        break;
+    }
+    case Instruction::UNARY: {
+        Value inner = pop();
+        push(UniOp::apply(static_cast<UniOp::Type>(in.a), inner, in.lineno));
+        break;
+    }
+    case Instruction::MAKE_TUPLE: {
+        const Value *top = state.stack.data() + state.stack.size() - in.a;
+        if (Value::fits_small(top, in.a)) {
+            Value t = Value::small_tuple(top, in.a);
+            state.stack.resize(state.stack.size() - in.a);
+            push(std::move(t));
+            break;
+        }
+        auto first = state.stack.end() - in.a;
+        std::vector<Value> vals{std::make_move_iterator(first),
+                                std::make_move_iterator(state.stack.end())};
+        state.stack.erase(first, state.stack.end());
+        push(Value(add_tuple(std::move(vals))));
+        break;
+    }
+    case Instruction::MAKE_LIST: {
+        auto first = state.stack.end() - in.a;
+        std::vector<Value> vals{std::make_move_iterator(first),
+                                std::make_move_iterator(state.stack.end())};
+        state.stack.erase(first, state.stack.end());
+        push(Value(add_list(std::move(vals))));
+        break;
+    }
+    case Instruction::INDEX: {
+        Value ix = pop();
+        Value seq = pop();
+        if (!seq.sequence()) {
+            throw RuntimeError(in.lineno, "Indexing requires tuple or list");
+        }
+        push(seq.get(get_index(ix, seq.length(), false, in.lineno)));
+        break;
+    }
+    case Instruction::SLICE: {
+        Value end = (in.a & 2) ? pop() : Value();
+        Value start = (in.a & 1) ? pop() : Value();
+        Value seq = pop();
+        if (!seq.sequence()) {
+            throw RuntimeError(in.lineno, "Slicing requires tuple or list");
+        }
+        std::size_t size = seq.length();
+        std::size_t first =
+            (in.a & 1) ? get_index(start, size, true, in.lineno) : 0;
+        std::size_t last =
+            (in.a & 2) ? get_index(end, size, true, in.lineno) : size;
+        if (first > last) {
+            throw RuntimeError(in.lineno, "Slice end before start");
+        }
+        if (seq.is_tuple()) {
+            std::vector<Value> vals;
+            vals.reserve(last - first);
+            for (std::size_t i = first; i < last; ++i) {
+                vals.push_back(seq.get(i));
+            }
+            push(make_tuple(std::move(vals)));
+        } else {
+            // Shares the items of the list
+            Value::List &list = seq.list;
+            push(Value(Value::List{list.items,
+                                   static_cast<uint32_t>(list.start + first),
+                                   static_cast<uint32_t>(last - first)}));
+        }
+        break;
+    }
+    case Instruction::STORE_INDEX: {
+        Value val = pop();
+        Value ix = pop();
+        Value seq = pop();
+        if (seq.type != Value::LIST) {
+            throw RuntimeError(in.lineno, "Assignment to element of non-list");
+        }
+        seq.list_item(get_index(ix, seq.length(), false, in.lineno)) =
+            std::move(val);
+        break;
+    }
+    case Instruction::BUILTIN:
+        call_builtin(in);
+        break;
+    case Instruction::READ_RESULT:
+        push(Value(state.read_result));
+        break;
+    case Instruction::CALL: {
+        auto it = state.funcs.find(in.a);
+        if (it == state.funcs.end()) {
+            throw RuntimeError(in.lineno, "Tries to access undefined function");
+        }
+        const CompiledFunction &f = code->functions[it->second];
+        if (static_cast<std::size_t>(in.b) != f.params.size()) {
+            throw RuntimeError(in.lineno, "Wrong number of arguments");
+        }
+        if (state.frames.size() >= MAX_FRAMES) {
+            throw RuntimeError(in.lineno, "Recursion limit hit");
+        }
+        std::size_t base = state.stack.size() - in.b;
+        state.frames.push_back({{}, state.pc, base});
+        for (std::size_t ix = 0; ix < f.params.size(); ++ix) {
+            set_var(f.params[ix], std::move(state.stack[base + ix]), true);
+        }
+        state.stack.erase(state.stack.begin() + base, state.stack.end());
+        state.pc = f.entry;
+        break;
+    }
+    case Instruction::RETURN: {
+        Value v = pop();
+        Frame &frame = state.frames.back();
+        state.stack.erase(state.stack.begin() + frame.stack_base,
+                          state.stack.end());
+        state.pc = frame.return_pc;
+        state.frames.pop_back();
+        push(std::move(v));
+        break;
+    }
+    case Instruction::JUMP:
+        state.pc = in.a;
+        break;
+    case Instruction::JUMP_IF_FALSE:
+        if (!pop().boolean()) {
+            state.pc = in.a;
+        }
+        break;
+    case Instruction::FOR_BEGIN:
+        if (state.stack.back().type == Value::MAP) {
+            // Keys at the start of the loop, so the map can be changed
+            std::vector<Value> keys;
+            MapTable::for_each(*state.stack.back().map.items,
+                               [&keys](const Value &key, const Value &) {
+                                   keys.push_back(key);
+                               });
+            state.stack.back() = make_tuple(std::move(keys));
+        }
+        if (!state.stack.back().sequence()) {
+            throw RuntimeError(in.lineno, "For loop requires tuple or list");
+        }
+        push(Value(static_cast<int64_t>(0)));
+        break;
+    case Instruction::FOR_NEXT: {
+        Value &ix = state.stack.back();
+        const Value &seq = state.stack[state.stack.size() - 2];
+        // Elements appended to a list during the loop are visited too
+        if (static_cast<std::size_t>(ix.i) >= seq.length()) {
+            state.pc = in.a;
+        } else {
+            Value elem = seq.get(ix.i);
+            ++ix.i;
+            set_var(in.b, std::move(elem), false);
+        }
+        break;
+    }
+    case Instruction::DEFINE:
+        state.funcs.insert({in.a, in.b});
+        break;
+    case Instruction::FAIL:
+        throw RuntimeError(in.lineno, code->errors[in.a]);
+    case Instruction::END:
+        // Handled by run_slice
+        state.pc = 0;
+        break;
+    }
+}
 
-    funcs.clear();
+void Program::call_builtin(const Instruction &in) {
+    int32_t lineno = in.lineno;
+    auto intv = [lineno](const Value& v) -> int64_t {
+        if (!v.numeric()) {
+            throw RuntimeError(lineno, "Invalid integer");
+        }
+        if (v.type == Value::DOUBLE) {
+            auto i = static_cast<int64_t>(v.d);
+            if (static_cast<double>(i) != v.d) {
+                throw RuntimeError(lineno, "Invalid integer");
+            }
+            return i;
+        } else {
+            return v.i;
+        }
+    };
 
+    switch (static_cast<BuiltinCall::Type>(in.a)) {
+    case BuiltinCall::RANDOM:
+        push(Value(state.rng.range(0, 100)));
+        break;
+    case BuiltinCall::FORWARDS:
+        action = {ProgramAction::FORWARDS, 0, 0};
+        push(Value());
+        break;
+    case BuiltinCall::READ_FRONT:
+        // The result is pushed by the READ_RESULT that follows
+        action = {ProgramAction::READ_FRONT, 0, 0};
+        break;
+    case BuiltinCall::ROTR:
+        action = {ProgramAction::ROTR, 0, 0};
+        push(Value());
+        break;
+    case BuiltinCall::ROTL:
+        action = {ProgramAction::ROTL, 0, 0};
+        push(Value());
+        break;
+    case BuiltinCall::MOVE: {
+        int64_t y = intv(pop());
+        int64_t x = intv(pop());
+        action = {ProgramAction::MOVE, static_cast<int32_t>((x > 0) - (x < 0)),
+                  static_cast<int32_t>((y > 0) - (y < 0))};
+        push(Value());
+        break;
+    }
+    case BuiltinCall::ELEM: {
+        Value ix = pop();
+        Value t = pop();
+        if (!t.sequence()) {
+            throw RuntimeError(lineno, "Invalid argument");
+        }
+        push(t.get(get_index(ix, t.length(), false, lineno)));
+        break;
+    }
+    case BuiltinCall::LENGTH: {
+        Value v = pop();
+        if (v.type == Value::MAP) {
+            push(Value(static_cast<int64_t>(MapTable::size(*v.map.items))));
+            break;
+        } else if (v.type == Value::STRING) {
+            push(Value(static_cast<int64_t>(v.str->size())));
+            break;
+        }
+        if (!v.sequence()) {
+            throw RuntimeError(lineno,
+                               "len requires tuple, list, map or string");
+        }
+        push(Value(static_cast<int64_t>(v.length())));
+        break;
+    }
+    case BuiltinCall::DICT:
+        push(Value(add_map()));
+        break;
+    case BuiltinCall::INSERT: {
+        Value val = pop();
+        Value key = pop();
+        Value m = pop();
+        if (m.type != Value::MAP) {
+            throw RuntimeError(lineno, "insert requires map");
+        }
+        MapTable{*m.map.items}.insert(key, std::move(val), lineno);
+        push(Value());
+        break;
+    }
+    case BuiltinCall::LOOKUP:
+    case BuiltinCall::CONTAINS: {
+        Value key = pop();
+        Value m = pop();
+        if (m.type != Value::MAP) {
+            throw RuntimeError(lineno, "Lookup requires map");
+        }
+        Value *val = MapTable{*m.map.items}.find(key, lineno);
+        if (in.a == BuiltinCall::CONTAINS) {
+            push(Value(val != nullptr));
+        } else {
+            push(val != nullptr ? *val : Value());
+        }
+        break;
+    }
+    case BuiltinCall::REMOVE: {
+        Value key = pop();
+        Value m = pop();
+        if (m.type != Value::MAP) {
+            throw RuntimeError(lineno, "remove requires map");
+        }
+        push(Value(MapTable{*m.map.items}.remove(key, lineno)));
+        break;
+    }
+    case BuiltinCall::APPEND: {
+        Value v = pop();
+        Value l = pop();
+        if (l.type != Value::LIST) {
+            throw RuntimeError(lineno, "append requires list");
+        }
+        if (l.list.size != Value::ALL) {
+            throw RuntimeError(lineno, "Can not append to a slice");
+        }
+        if (l.list.items->size() >= Value::ALL) {
+            throw RuntimeError(lineno, "List too long");
+        }
+        l.list.items->push_back(std::move(v));
+        push(Value());
+        break;
+    }
+    case BuiltinCall::STR: {
+        Value v = pop();
+        if (v.type == Value::STRING) {
+            push(std::move(v));
+            break;
+        }
+        std::string text;
+        v.write(text);
+        push(Value(add_string(std::move(text))));
+        break;
+    }
+    case BuiltinCall::FORMAT: {
+        // Every {} in the format is replaced by the next argument
+        auto first = state.stack.end() - in.b;
+        if (first->type != Value::STRING) {
+            throw RuntimeError(lineno, "format requires string");
+        }
+        const std::string &format = *first->str;
+        std::string text;
+        auto arg = first + 1;
+        std::size_t pos = 0;
+        std::size_t hole;
+        while ((hole = format.find("{}", pos)) != std::string::npos) {
+            if (arg == state.stack.end()) {
+                throw RuntimeError(lineno, "Too few arguments for format");
+            }
+            text.append(format, pos, hole - pos);
+            arg->write(text);
+            ++arg;
+            pos = hole + 2;
+        }
+        if (arg != state.stack.end()) {
+            throw RuntimeError(lineno, "Too many arguments for format");
+        }
+        text.append(format, pos, std::string::npos);
+        state.stack.erase(first, state.stack.end());
+        push(Value(add_string(std::move(text))));
+        break;
+    }
+    case BuiltinCall::PRINT: {
+        action = {ProgramAction::PRINT, 0, 0};
+        // Formatted in place, so a print allocates nothing once the buffer
+        // has grown to fit
+        print_buffer.clear();
+        if (in.b == 0) {
+            push(Value());
+            break;
+        }
+        auto first = state.stack.end() - in.b;
+        for (auto it = first; it != state.stack.end(); ++it) {
+            if (it != first) {
+                print_buffer += ", ";
+            }
+            it->write(print_buffer);
+        }
+        print_buffer += '\n';
+        state.stack.erase(first, state.stack.end());
+        push(Value());
+        break;
+    }
+    case BuiltinCall::TUPLE:
+        // Compiled to MAKE_TUPLE
+        break;
+    case BuiltinCall::LIST:
+        // Compiled to MAKE_LIST
+        break;
+    }
+}
+
+void Program::stop() {
+    running = false;
+    // Values first, while the tuples they refer to are alive
+    state = ExecutionState();
     tuples.clear();
+    strings.clear();
+    code.reset();
 }
 
 void Program::start() {
-    assert(!run_thread.joinable());
-    paused.store(false);
-    running.store(true);
-    run_thread = std::thread{entry, this};
+    begin(code, engine::make_stream(RNG_STREAM_SCRIPT));
 }
 
-void Program::set_events(uint32_t print_evt) {
-    EVT_PRINT = print_evt;
-    EVT_MOVE = print_evt + 1;
-    EVT_ROTL = print_evt + 2;
-    EVT_ROTR = print_evt + 3;
-    EVT_READ_TILE = print_evt + 4;
-    EVT_MOVE_FORWARDS = print_evt + 5;
+std::shared_ptr<const Code> Program::get_code() const { return code; }
+
+void Program::begin(std::shared_ptr<const Code> code, Rng rng) {
+    state = ExecutionState();
+    tuples.clear();
+    strings.clear();
+    this->code = std::move(code);
+    state.rng = rng;
+    running = this->code != nullptr;
 }
 
-void Program::status(int32_t line) {
-    using namespace std::chrono_literals;
-    if (!running.load()) {
-        throw StopException();
-    }
-    while (paused.load()) {
-        if (!running.load()) {
-            throw StopException();
-        }
-        std::this_thread::sleep_for(50ms);
+bool Program::is_running() const { return running; }
+
+ProgramSnapshot Program::snapshot() const {
+    ProgramSnapshot snapshot;
+    if (!running) {
+        return snapshot;
     }
-    this->lineno.store(line);
+    snapshot.code = code;
+    copy_state(state, snapshot.state, snapshot.tuples, snapshot.strings);
+    return snapshot;
 }
 
-void Program::add_scope() { 
-    if (scopes.size() >= 1024) {
-        throw RuntimeError(lineno.load(), "Recursion limit hit");
+void Program::restore(const ProgramSnapshot &snapshot) {
+    stop();
+    if (snapshot.code == nullptr) {
+        return;
     }
-    scopes.emplace_back();
+    code = snapshot.code;
+    copy_state(snapshot.state, state, tuples, strings);
+    running = true;
 }
 
-void Program::remove_scope() {
-    scopes.pop_back();
+void Program::copy_state(const ExecutionState &src, ExecutionState &dest,
+                         RefCountSet<std::vector<Value>> &tuples,
+                         RefCountSet<const std::string> &strings) {
+    // Every tuple, list and map is copied once, so the copies share elements
+    // the same way as the originals, including lists that contain
+    // themselves.
+    std::unordered_map<const std::vector<Value> *, Value::Tuple> copies;
+    std::unordered_map<const std::string *, Value::String> string_copies;
+    auto copy = [&](const Value &v, auto &copy) -> Value {
+        if (v.type == Value::STRING && v.str.counted()) {
+            auto it = string_copies.find(v.str.get());
+            if (it == string_copies.end()) {
+                it = string_copies
+                         .insert({v.str.get(),
+                                  Value::String{new std::string(*v.str),
+                                                strings}})
+                         .first;
+            }
+            return Value(it->second);
+        }
+        const std::vector<Value> *src = v.heap_items();
+        if (src == nullptr) {
+            return v;
+        }
+        auto it = copies.find(src);
+        if (it == copies.end()) {
+            // Added before the elements are copied, which may refer to it
+            auto *vals = new std::vector<Value>();
+            vals->reserve(src->size());
+            it = copies.insert({src, Value::Tuple{vals, tuples}}).first;
+            for (const Value &elem : *src) {
+                vals->push_back(copy(elem, copy));
+            }
+        }
+        if (v.type == Value::TUPLE) {
+            return Value(it->second);
+        } else if (v.type == Value::MAP) {
+            // Hashes only depend on the keys, so the slots stay valid
+            return Value(Value::Map{it->second});
+        }
+        return Value(Value::List{it->second, v.list.start, v.list.size});
+    };
+    auto copy_vars = [&copy](const std::unordered_map<int32_t, Value> &vars,
+                             std::unordered_map<int32_t, Value> &out) {
+        out.reserve(vars.size());
+        for (const auto &var : vars) {
+            out.insert({var.first, copy(var.second, copy)});
+        }
+    };
+
+    copy_vars(src.globals, dest.globals);
+    dest.funcs = src.funcs;
+    dest.frames.reserve(src.frames.size());
+    for (const Frame &frame : src.frames) {
+        dest.frames.push_back({{}, frame.return_pc, frame.stack_base});
+        copy_vars(frame.locals, dest.frames.back().locals);
+    }
+    dest.stack.reserve(src.stack.size());
+    for (const Value &v : src.stack) {
+        dest.stack.push_back(copy(v, copy));
+    }
+    dest.pc = src.pc;
+    dest.read_result = src.read_result;
+    dest.rng = src.rng;
 }
 
 void Program::set_var(int32_t id, Value val, bool param) {
-    if (!scopes.empty()) {
-        auto var = scopes.back().find(id);
-        if (var != scopes.back().end()) {
+    if (!state.frames.empty()) {
+        auto &locals = state.frames.back().locals;
+        auto var = locals.find(id);
+        if (var != locals.end()) {
             var->second = val;
             return;
         }
         if (param) {
-            scopes.back().insert({id, val});
+            locals.insert({id, val});
             return;
         }
     }
-    auto global_var = globals.find(id);
-    if (global_var != globals.end()) {
+    auto global_var = state.globals.find(id);
+    if (global_var != state.globals.end()) {
         global_var->second = val;
         return;
     }
-    if (!scopes.empty()) {
-        scopes.back().insert({id, val});
+    if (!state.frames.empty()) {
+        state.frames.back().locals.insert({id, val});
     } else {
-        globals.insert({id, val});
+        state.globals.insert({id, val});
     }
 }
 
-void Program::set_function(int32_t id, Function *f) { funcs.insert({id, f}); }
-
-Function *Program::get_function(int32_t id) {
-    auto it = funcs.find(id);
-    if (it == funcs.end()) {
-        throw RuntimeError(lineno.load(), "Tries to access undefined function");
-    }
-    return it->second;
-}
-
-Value Program::get_var(int32_t id) {
-    if (scopes.size() > 0) {
-        auto var = scopes.back().find(id);
-        if (var != scopes.back().end()) {
+Value Program::get_var(int32_t id, int32_t lineno) {
+    if (!state.frames.empty()) {
+        auto &locals = state.frames.back().locals;
+        auto var = locals.find(id);
+        if (var != locals.end()) {
             return var->second;
         }
     }
-    auto global_var = globals.find(id);
-    if (global_var != globals.end()) {
+    auto global_var = state.globals.find(id);
+    if (global_var != state.globals.end()) {
         return global_var->second;
     }
-    throw RuntimeError(lineno.load(), "Tried to access undefined variable");
+    throw RuntimeError(lineno, "Tried to access undefined variable");
 }
 
-void Program::set_return(Value val) { return_val = std::move(val); }
-
-Value Program::get_return() { return return_val; }
-
 Value::Tuple Program::add_tuple(std::vector<Value> tuple) {
     auto *val = new std::vector<Value>(std::move(tuple));
     return Value::Tuple{val, tuples};
 }
 
-Value BinOp::evaluate(Program &p) const {
-    p.status(lineno);
-    Value left = lhs->evaluate(p);
+Value::List Program::add_list(std::vector<Value> items) {
+    return Value::List{add_tuple(std::move(items)), 0, Value::ALL};
+}
+
+Value::Map Program::add_map() {
+    return Value::Map{add_tuple(MapTable::make())};
+}
+
+Value::String Program::add_string(std::string text) {
+    return Value::String{new std::string(std::move(text)), strings};
+}
+
+Value Program::make_tuple(std::vector<Value> vals) {
+    if (Value::fits_small(vals.data(), vals.size())) {
+        return Value::small_tuple(vals.data(), vals.size());
+    }
+    return Value(add_tuple(std::move(vals)));
+}
+
+void Literal::compile(Compiler &c, int32_t lineno) const {
+    switch (type) {
+    case DOUBLE:
+        c.emit_constant(Value(d), lineno);
+        break;
+    case INT64:
+        c.emit_constant(Value(i), lineno);
+        break;
+    case BOOL:
+        c.emit_constant(Value(b), lineno);
+        break;
+    case NONE:
+        c.emit_constant(Value(), lineno);
+        break;
+    case TUPLE:
+        for (const Expression *e : tuple) {
+            e->compile(c);
+        }
+        c.emit(Instruction::MAKE_TUPLE, lineno,
+               static_cast<int32_t>(tuple.size()));
+        break;
+    }
+}
+
+void BinOp::compile(Compiler &c) const {
+    // Both sides are always evaluated, and and or do not short circuit
+    lhs->compile(c);
+    rhs->compile(c);
+    c.emit(Instruction::BINARY, lineno, type);
+}
+
+Value BinOp::apply(Type type, const Value &left, const Value &right,
+                   Program &p, int32_t lineno) {
     if (type == AND) {
-        Value right = rhs->evaluate(p);
         if (left.boolean()) {
             return Value(right.boolean());
         }
         return Value(false);
     } else if (type == OR) {
-        Value right = rhs->evaluate(p);
         if (!left.boolean()) {
             return Value(right.boolean());
         }
         return Value(true);
     }
-    Value right = rhs->evaluate(p);
     auto dbl = [](const Value& v) {
         if (v.type == Value::DOUBLE) {
             return v.d;
@@ -182,20 +985,49 @@ Value BinOp::evaluate(Program &p) const {
         return static_cast<double>(v.i);
     };
 
-    if (left.type == Value::TUPLE || right.type == Value::TUPLE) {
+    if (left.type == Value::STRING || right.type == Value::STRING) {
+        bool both = left.type == right.type;
+        if (type == EQ) {
+            return Value(both && *left.str == *right.str);
+        } else if (type == NEQ) {
+            return Value(!both || *left.str != *right.str);
+        } else if (type != ADD || !both) {
+            throw RuntimeError(lineno, "Invalid binary operation for string");
+        }
+        // Always a new string, use format to join many
+        std::string text;
+        text.reserve(left.str->size() + right.str->size());
+        text += *left.str;
+        text += *right.str;
+        return Value(p.add_string(std::move(text)));
+    }
+
+    if (left.sequence() || right.sequence()) {
         if (type != ADD) {
             throw RuntimeError(lineno, "Invalid binary operation for tuple");
         }
     }
+    if (left.type == Value::MAP || right.type == Value::MAP) {
+        throw RuntimeError(lineno, "Invalid binary operation for map");
+    }
 
     switch (type) {
     case ADD:
-        if (left.type == Value::TUPLE && right.type == Value::TUPLE) {
-            std::vector<Value> vals{*left.tuple};
-            for (Value &v : *right.tuple) {
-                vals.push_back(v);
+        if ((left.is_tuple() && right.is_tuple()) ||
+            (left.type == Value::LIST && right.type == Value::LIST)) {
+            // Always a new tuple or list, use append to grow a list
+            std::vector<Value> vals;
+            vals.reserve(left.length() + right.length());
+            for (std::size_t ix = 0; ix < left.length(); ++ix) {
+                vals.push_back(left.get(ix));
+            }
+            for (std::size_t ix = 0; ix < right.length(); ++ix) {
+                vals.push_back(right.get(ix));
+            }
+            if (left.type == Value::LIST) {
+                return Value(p.add_list(std::move(vals)));
             }
-            return Value(p.add_tuple(std::move(vals)));
+            return p.make_tuple(std::move(vals));
         }
         if (!left.numeric() || !right.numeric()) {
             throw RuntimeError(lineno, "Addition of non-numeric type");
@@ -312,12 +1144,15 @@ Value BinOp::evaluate(Program &p) const {
     return Value();
 }
 
-Value UniOp::evaluate(Program &p) const {
-    if (type == PAREN) {
-        return e->evaluate(p);
+
+void UniOp::compile(Compiler &c) const {
+    e->compile(c);
+    if (type != PAREN) {
+        c.emit(Instruction::UNARY, lineno, type);
     }
-    p.status(lineno);
-    Value inner = e->evaluate(p);
+}
+
+Value UniOp::apply(Type type, const Value &inner, int32_t lineno) {
     if (type == POSITIVE) {
         if (!inner.numeric()) {
             throw RuntimeError(lineno, "Unary plus of non-numeric type");
@@ -339,304 +1174,450 @@ Value UniOp::evaluate(Program &p) const {
     }
 }
 
-Value BuiltinCall::evaluate(Program &p) const {
-    p.status(lineno);
-    auto intv = [&p, this](const Value& v) -> int64_t {
-        if (!v.numeric()) {
-            throw RuntimeError(lineno, "Invalid integer");
+
+void BuiltinCall::compile(Compiler &c) const {
+    std::size_t argc = args.size();
+    switch (type) {
+    case RANDOM:
+        // Arguments are ignored
+        c.emit(Instruction::BUILTIN, lineno, type, 0);
+        return;
+    case TUPLE:
+        for (const Expression *e : args) {
+            e->compile(c);
         }
-        if (v.type == Value::DOUBLE) {
-            auto i = static_cast<int64_t>(v.d);
-            if (static_cast<double>(i) != v.d) {
-                throw RuntimeError(lineno, "Invalid integer");
-            }
-            return i;
-        } else {
-            return v.i;
+        c.emit(Instruction::MAKE_TUPLE, lineno, static_cast<int32_t>(argc));
+        return;
+    case LIST:
+        for (const Expression *e : args) {
+            e->compile(c);
         }
-    };
-
-    if (type == RANDOM) {
-        Value v = Value(engine::random<int64_t>(0, 100));
-        return v;
-    } else if (type == FORWARDS) {
-        SDL_Event e;
-        e.type = p.EVT_MOVE_FORWARDS;
-        if (!args.empty()) {
-            throw RuntimeError(lineno, "Wrong number of arguments");
-        }
-        SDL_PushEvent(&e);
-        p.pause();
-    } else if (type == READ_FRONT) {
-        SDL_Event e;
-        e.type = p.EVT_READ_TILE;
-        if (!args.empty()) {
-            throw RuntimeError(lineno, "Wrong number of arguments");
-        }
-        auto *t = new ReadTile();
-        e.user.data1 = t;
-        SDL_PushEvent(&e);
-        p.pause();
-        p.status(lineno);
-
-        t->m.lock();
-        Value v = Value(t->is_open);
-        t->m.unlock();
-        delete t;
-        return v;
-    } else if (type == ROTR) {
-        SDL_Event e;
-        e.type = p.EVT_ROTR;
-        if (args.size() != 0) {
-            throw RuntimeError(lineno, "Wrong number of arguments");
-        }
-        SDL_PushEvent(&e);
-        p.pause();
-        return Value();
-    } else if (type == ROTL) {
-        SDL_Event e;
-        e.type = p.EVT_ROTL;
-        if (!args.empty()) {
-            throw RuntimeError(lineno, "Wrong number of arguments");
-        }
-        SDL_PushEvent(&e);
-        p.pause();
-        return Value();
-    } else if (type == MOVE) {
-        SDL_Event e;
-        e.type = p.EVT_MOVE;
-        if (args.size() != 2) {
-            throw RuntimeError(lineno, "Wrong number of arguments");
-        }
-        int64_t x = intv(args[0]->evaluate(p));
-        int64_t y = intv(args[1]->evaluate(p));
-        if (x < 0) {
-            x = 0b11;
-        } else if (x > 0) {
-            x = 0b01;
-        }
-        if (y < 0) {
-            y = 0b11;
-        } else if (y > 0) {
-            y = 0b01;
-        }
-        // 4-bit value two x, two y.
-        e.user.data1 = (void *)(uintptr_t)(x << 2 | y);
-        SDL_PushEvent(&e);
-        p.pause();
-    } else if (type == ELEM) {
-        if (args.size() != 2) {
-            throw RuntimeError(lineno, "Wrong number of arguments");
-        }
-        Value t = args[0]->evaluate(p);
-        Value ix = args[1]->evaluate(p);
-        if (t.type != Value::TUPLE || !ix.numeric()) {
-            throw RuntimeError(lineno, "Invalid argument");
+        c.emit(Instruction::MAKE_LIST, lineno, static_cast<int32_t>(argc));
+        return;
+    case INSERT:
+        if (argc != 2 && argc != 3) {
+            c.emit_fail("Wrong number of arguments", lineno);
+            return;
         }
-        int64_t i;
-        if (ix.type == Value::DOUBLE) {
-            i = static_cast<int64_t>(ix.d);
-            if (static_cast<double>(i) != ix.d) {
-                throw RuntimeError(lineno, "Non-integer index");
-            }
-        } else {
-            i = ix.i;
-        }
-        if (i >= t.tuple->size()) {
-            throw RuntimeError(lineno, "Index out of bounds");
-        }
-        Value res = (*t.tuple)[i];
-        return res;
-    } else if (type == TUPLE) {
-        std::vector<Value> v;
-        v.reserve(args.size());
-        for (auto &a : args) {
-            v.push_back(a->evaluate(p));
-        }
-        return Value(p.add_tuple(v));
-    } else if (type == LENGTH) {
-        if (args.size() != 1) {
-            throw RuntimeError(lineno, "Wrong number of arguments");
-        }
-        Value v = args[0]->evaluate(p);
-        if (v.type != Value::TUPLE) {
-            throw RuntimeError(lineno, "len requires tuple");
-        }
-        return Value(static_cast<int64_t>(v.tuple->size()));
-    } else if (type == PRINT) {
-        std::stringstream ss{};
-        SDL_Event e;
-        e.type = p.EVT_PRINT;
-        if (args.empty()) {
-            ss << "\n";
-            e.user.data1 = new std::string{ss.str()};
-            SDL_PushEvent(&e);
-            return Value();
-        }
-        Value first = args[0]->evaluate(p);
-        first.write(ss);
-        for (size_t ix = 1; ix < args.size(); ++ix) {
-            ss << ", ";
-            Value v = args[ix]->evaluate(p);
-            v.write(ss);
-        }
-        ss << "\n";
-        e.user.data1 = new std::string{ss.str()};
-        SDL_PushEvent(&e);
-        p.pause();
-        return Value();
-    }
-    // Unreachable
-    return Value();
+        for (const Expression *e : args) {
+            e->compile(c);
+        }
+        // insert(m, key) adds key to a set
+        if (argc == 2) {
+            c.emit_constant(Value(true), lineno);
+        }
+        c.emit(Instruction::BUILTIN, lineno, type, 3);
+        return;
+    case PRINT:
+        break;
+    case DICT:
+    case FORWARDS:
+    case READ_FRONT:
+    case ROTR:
+    case ROTL:
+        if (argc != 0) {
+            c.emit_fail("Wrong number of arguments", lineno);
+            return;
+        }
+        break;
+    case FORMAT:
+        if (argc == 0) {
+            c.emit_fail("Wrong number of arguments", lineno);
+            return;
+        }
+        break;
+    case LENGTH:
+    case STR:
+        if (argc != 1) {
+            c.emit_fail("Wrong number of arguments", lineno);
+            return;
+        }
+        break;
+    case MOVE:
+    case ELEM:
+    case APPEND:
+    case LOOKUP:
+    case CONTAINS:
+    case REMOVE:
+        if (argc != 2) {
+            c.emit_fail("Wrong number of arguments", lineno);
+            return;
+        }
+        break;
+    }
+    for (const Expression *e : args) {
+        e->compile(c);
+    }
+    c.emit(Instruction::BUILTIN, lineno, type, static_cast<int32_t>(argc));
+    if (type == READ_FRONT) {
+        c.emit(Instruction::READ_RESULT, lineno);
+    }
 }
 
-Value FuncCall::evaluate(Program &p) const {
-    p.status(lineno);
-    Function *f = p.get_function(name_id);
+void StringExpr::compile(Compiler &c) const {
+    c.emit_string(text, lineno);
+}
 
-    if (args.size() != f->params.size()) {
-        throw RuntimeError(lineno, "Wrong number of arguments");
+void FuncCall::compile(Compiler &c) const {
+    for (const Expression *e : args) {
+        e->compile(c);
     }
+    c.emit(Instruction::CALL, lineno, name_id,
+           static_cast<int32_t>(args.size()));
+}
+
+void VariableExpr::compile(Compiler &c) const {
+    c.emit(Instruction::LOAD, lineno, id);
+}
+
+void IndexExpr::compile(Compiler &c) const {
+    target->compile(c);
+    index->compile(c);
+    c.emit(Instruction::INDEX, lineno);
+}
 
-    p.add_scope();
-    for (size_t ix = 0; ix < args.size(); ++ix) {
-        Value v = args[ix]->evaluate(p);
-        p.set_var(f->params[ix], v, true);
+void SliceExpr::compile(Compiler &c) const {
+    target->compile(c);
+    int32_t bounds = 0;
+    if (start != nullptr) {
+        start->compile(c);
+        bounds |= 1;
     }
-    for (Statement *s : f->statements) {
-        Statement::Status status = s->evaluate(p);
-        if (status == Statement::RETURN) {
-            Value v = p.get_return();
-            p.remove_scope();
-            return v;
-        } else if (status != Statement::NEXT) {
-            p.remove_scope();
-            throw RuntimeError(lineno, "Invalid placement of break / continue");
-        }
+    if (end != nullptr) {
+        end->compile(c);
+        bounds |= 2;
     }
-    p.remove_scope();
-    return Value();
+    c.emit(Instruction::SLICE, lineno, bounds);
 }
 
-Value VariableExpr::evaluate(Program &p) const {
-    p.status(lineno);
-    Value v = p.get_var(id);
-    return v;
+void IndexAssignment::compile(Compiler &c) const {
+    target->compile(c);
+    index->compile(c);
+    val->compile(c);
+    c.emit(Instruction::STORE_INDEX, lineno);
 }
 
-Statement::Status Assignment::evaluate(Program &p) const {
-    p.status(lineno);
-    Value v = val->evaluate(p);
-    p.set_var(id, v, false);
-    return Statement::NEXT;
+void Assignment::compile(Compiler &c) const {
+    val->compile(c);
+    c.emit(Instruction::STORE, lineno, id);
 }
 
-Statement::Status ExpressionStatement::evaluate(Program &p) const {
-    Value v = expr->evaluate(p);
-    return Statement::NEXT;
+void ExpressionStatement::compile(Compiler &c) const {
+    expr->compile(c);
+    c.emit(Instruction::POP, lineno, 1);
 }
 
-Statement::Status ReturnStatement::evaluate(Program &p) const {
-    p.status(lineno);
+void ReturnStatement::compile(Compiler &c) const {
     if (expr == nullptr) {
-        p.set_return(Value());
+        c.emit_constant(Value(), lineno);
     } else {
-        Value v = expr->evaluate(p);
-        p.set_return(v);
+        expr->compile(c);
+    }
+    if (!c.in_function) {
+        c.emit_fail("Illegal statement", 0);
+        return;
     }
-    return Statement::RETURN;
+    c.emit(Instruction::RETURN, lineno);
 }
 
-Statement::Status FlowStatement::evaluate(Program &p) const {
-    p.status(lineno);
+void FlowStatement::compile(Compiler &c) const {
+    if (c.loops.empty()) {
+        if (c.in_function) {
+            c.emit_fail("Invalid placement of break / continue", lineno);
+        } else {
+            c.emit_fail("Illegal statement", 0);
+        }
+        return;
+    }
+    Compiler::Loop &loop = c.loops.back();
     if (is_break) {
-        return Statement::BREAK;
+        loop.breaks.push_back(c.emit_jump(Instruction::JUMP, lineno));
     } else {
-        return Statement::CONTINUE;
+        c.emit(Instruction::JUMP, lineno, loop.continue_target);
     }
 }
 
-Statement::Status IfStatement::evaluate(Program &p) const {
-    bool c = true;
-    p.status(lineno);
-    if (cond != nullptr) {
-        Value v = cond->evaluate(p);
-        c = v.boolean();
-    }
-    if (c) {
-        for (Statement *s : on_if) {
-            Statement::Status status = s->evaluate(p);
-            if (status != Statement::NEXT) {
-                return status;
-            }
+void IfStatement::compile(Compiler &c) const {
+    std::vector<int32_t> ends;
+    for (const IfStatement *s = this; s != nullptr; s = s->next) {
+        int32_t skip = -1;
+        if (s->cond != nullptr) {
+            s->cond->compile(c);
+            skip = c.emit_jump(Instruction::JUMP_IF_FALSE, s->lineno);
+        }
+        for (const Statement *st : s->on_if) {
+            st->compile(c);
         }
-    } else if (next != nullptr) {
-        return next->evaluate(p);
+        if (s->next != nullptr) {
+            ends.push_back(c.emit_jump(Instruction::JUMP, s->lineno));
+        }
+        if (skip >= 0) {
+            c.patch(skip);
+        }
+    }
+    for (int32_t ix : ends) {
+        c.patch(ix);
     }
-    return Statement::NEXT;
 }
 
-Statement::Status WhileStatement::evaluate(Program &p) const {
-    p.status(lineno);
-    while (true) {
-        Value v = cond->evaluate(p);
-        bool c = v.boolean();
-        if (!c) {
-            break;
-        }
-        for (Statement *s : statements) {
-            Statement::Status status = s->evaluate(p);
-            if (status == Statement::RETURN) {
-                return Statement::RETURN;
-            } else if (status == Statement::BREAK) {
-                goto end;
-            } else if (status == Statement::CONTINUE) {
-                break;
-            }
-        }
+void WhileStatement::compile(Compiler &c) const {
+    int32_t loop = c.next();
+    cond->compile(c);
+    int32_t exit = c.emit_jump(Instruction::JUMP_IF_FALSE, lineno);
+    c.loops.push_back({loop, {}});
+    for (const Statement *s : statements) {
+        s->compile(c);
+    }
+    c.emit(Instruction::JUMP, lineno, loop);
+    c.patch(exit);
+    for (int32_t ix : c.loops.back().breaks) {
+        c.patch(ix);
+    }
+    c.loops.pop_back();
+}
+
+void ForStatement::compile(Compiler &c) const {
+    // The tuple and the index of the next element stay on the stack
+    expr->compile(c);
+    c.emit(Instruction::FOR_BEGIN, lineno);
+    int32_t loop = c.emit_jump(Instruction::FOR_NEXT, lineno, var_id);
+    c.loops.push_back({loop, {}});
+    for (const Statement *s : statements) {
+        s->compile(c);
+    }
+    c.emit(Instruction::JUMP, lineno, loop);
+    c.patch(loop);
+    for (int32_t ix : c.loops.back().breaks) {
+        c.patch(ix);
     }
-end:
-    return Statement::NEXT;
+    c.loops.pop_back();
+    c.emit(Instruction::POP, lineno, 2);
 }
 
-Statement::Status ForStatement::evaluate(Program &p) const {
-    p.status(lineno);
-    Value v = expr->evaluate(p);
-    if (v.type != Value::TUPLE) {
-        throw RuntimeError(lineno, "For loop requires tuple");
+void GlobalStatement::compile(Compiler &c) const {
+    for (const Statement *s : statements) {
+        s->compile(c);
     }
+}
 
-    for (const auto & ix : *v.tuple) {
-        p.set_var(var_id, ix, false);
-        for (Statement *s : statements) {
-            Statement::Status status = s->evaluate(p);
-            if (status == Statement::RETURN) {
-                return Statement::RETURN;
-            } else if (status == Statement::BREAK) {
-                goto end;
-            } else if (status == Statement::CONTINUE) {
-                break;
-            }
-        }
+void FuncDef::compile(Compiler &c) const {
+    c.emit(Instruction::DEFINE, lineno, name_id, c.add_function(function));
+}
+
+#ifdef LANGUAGE_BENCH
+#include "parser.h"
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+// Heap allocations since start, counted by the replaced operator new
+static std::size_t allocations = 0;
+
+void *operator new(std::size_t size) {
+    ++allocations;
+    if (void *p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
     }
-end:
-    return Statement::NEXT;
+    throw std::bad_alloc();
 }
 
-Statement::Status GlobalStatement::evaluate(Program &p) const {
-    p.status(lineno);
-    for (Statement *s : statements) {
-        Statement::Status status = s->evaluate(p);
-        if (status != Statement::NEXT) {
-            throw RuntimeError(lineno, "Illegal statement");
-        }
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+// Builds a path of n points, with tuple concatenation or list append
+static std::vector<std::string> path_program(int n, bool fast) {
+    return {
+        "n = " + std::to_string(n),
+        fast ? "path = []" : "path = tuple()",
+        "i = 0",
+        "while i < n:",
+        fast ? "    append(path, tuple(i, i))"
+             : "    path = path + tuple(tuple(i, i))",
+        "    i = i + 1",
+        "print(len(path))",
+    };
+}
+
+// Visits every one of n / 2 points twice, keeping the visited points in a
+// list or in a set. Operators group to the right, hence the parentheses.
+static std::vector<std::string> visit_program(int n, bool fast) {
+    std::vector<std::string> lines = {
+        "n = " + std::to_string(n),
+        fast ? "visited = dict()" : "visited = []",
+        "i = 0",
+        "while i < n:",
+        "    y = (i // 2) // 64",
+        "    x = (i // 2) - y * 64",
+    };
+    if (fast) {
+        lines.insert(lines.end(), {
+            "    if contains(visited, tuple(x, y)) = False:",
+            "        insert(visited, tuple(x, y))",
+        });
+    } else {
+        lines.insert(lines.end(), {
+            "    found = False",
+            "    for p in visited:",
+            "        if p[0] = x:",
+            "            if p[1] = y:",
+            "                found = True",
+            "    if found = False:",
+            "        append(visited, tuple(x, y))",
+        });
+    }
+    lines.insert(lines.end(), {"    i = i + 1", "print(len(visited))"});
+    return lines;
+}
+
+// Walks a point around with coordinate tuples, and keeps a few in a set
+static std::vector<std::string> walk_program(int n, bool) {
+    return {
+        "n = " + std::to_string(n),
+        "seen = dict()",
+        "pos = tuple(0, 0)",
+        "dir = tuple(1, 0)",
+        "i = 0",
+        "while i < n:",
+        "    pos = tuple(pos[0] + dir[0], pos[1] + dir[1])",
+        "    if pos[0] > 7:",
+        "        dir = tuple(0, 1)",
+        "        pos = tuple(0, pos[1])",
+        "    if pos[1] > 7:",
+        "        pos = tuple(pos[0], 0)",
+        "    insert(seen, pos)",
+        "    i = i + 1",
+        "print(n)",
+    };
+}
+
+// Runs the program until its first print, returning the microseconds
+// taken, or -1 if it does not print expected. Sets allocs to the number of
+// heap allocations on the way.
+static long long run_until_print(const std::vector<std::string> &lines,
+                                 int expected, std::size_t &allocs) {
+    Parser parser{};
+    if (!parser.parse_lines(lines)) {
+        return -1;
     }
-    return Statement::NEXT;
+    Program program;
+    program.load_program(std::move(parser.all_statements),
+                         std::move(parser.all_expressions),
+                         std::move(parser.all_functions), parser.entry);
+    parser.entry = nullptr;
+    program.start();
+    auto start = std::chrono::steady_clock::now();
+    std::size_t start_allocations = allocations;
+    Program::RunStatus status;
+    do {
+        uint32_t budget = 1 << 20;
+        status = program.run_slice(budget);
+    } while (status == Program::RunStatus::YIELD);
+    auto end = std::chrono::steady_clock::now();
+    allocs = allocations - start_allocations;
+    if (status != Program::RunStatus::ACTION ||
+        program.print_buffer != std::to_string(expected) + "\n") {
+        return -1;
+    }
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - start)
+        .count();
 }
 
-Statement::Status FuncDef::evaluate(Program &p) const {
-    p.status(lineno);
-    p.set_function(name_id, function);
+// Runs a program that prints a string, a number, a tuple and None n
+// times, returning the microseconds taken, or -1 if a print is wrong. Sets
+// allocs to the number of heap allocations by the program after the first
+// print, checking the prints is not counted.
+static long long run_prints(int n, std::size_t &allocs) {
+    std::vector<std::string> lines = {
+        "i = 0",
+        "while True:",
+        "    print(\"step\", i, tuple(i, 2.5), None)",
+        "    i = i + 1",
+    };
+    Parser parser{};
+    if (!parser.parse_lines(lines)) {
+        return -1;
+    }
+    Program program;
+    program.load_program(std::move(parser.all_statements),
+                         std::move(parser.all_expressions),
+                         std::move(parser.all_functions), parser.entry);
+    parser.entry = nullptr;
+    program.start();
+    allocs = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < n; ++i) {
+        std::size_t start_allocations = allocations;
+        Program::RunStatus status;
+        do {
+            uint32_t budget = 1 << 20;
+            status = program.run_slice(budget);
+        } while (status == Program::RunStatus::YIELD ||
+                 status == Program::RunStatus::END);
+        if (i > 0) {
+            allocs += allocations - start_allocations;
+        }
+        std::string expected = "step, " + std::to_string(i) + ", (" +
+                               std::to_string(i) + ",2.5,), None\n";
+        if (status != Program::RunStatus::ACTION ||
+            program.print_buffer != expected) {
+            return -1;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(end - start)
+        .count();
+}
 
-    return Statement::NEXT;
+int main() {
+    struct Bench {
+        const char *name;
+        std::vector<std::string> (*program)(int n, bool fast);
+        int divisor;
+    };
+    bool ok = true;
+    for (const Bench &bench : {Bench{"path", path_program, 1},
+                               Bench{"visited", visit_program, 2}}) {
+        for (bool fast : {false, true}) {
+            for (int n : {1000, 2000, 4000, 8000}) {
+                std::size_t allocs;
+                long long us = run_until_print(bench.program(n, fast),
+                                               n / bench.divisor, allocs);
+                if (us < 0) {
+                    ok = false;
+                    continue;
+                }
+                std::cout << bench.name << (fast ? " (fast), " : ", ") << n
+                          << " steps: " << us << " us, " << us * 1000 / n
+                          << " ns per step" << std::endl;
+            }
+        }
+    }
+    for (int n : {10000, 100000}) {
+        std::size_t allocs;
+        long long us = run_until_print(walk_program(n, false), n, allocs);
+        if (us < 0) {
+            ok = false;
+            continue;
+        }
+        std::cout << "walk, " << n << " steps: " << us * 1000 / n
+                  << " ns per step, "
+                  << static_cast<double>(allocs) / n
+                  << " allocations per step" << std::endl;
+    }
+    for (int n : {10000, 100000}) {
+        std::size_t allocs;
+        long long us = run_prints(n, allocs);
+        if (us < 0) {
+            ok = false;
+            continue;
+        }
+        std::cout << "print, " << n << " lines: " << us * 1000 / n
+                  << " ns per print, "
+                  << static_cast<double>(allocs) / n
+                  << " allocations per print" << std::endl;
+    }
+    std::cout << (ok ? "ok" : "failed") << std::endl;
+    return ok ? 0 : 1;
 }
+#endif
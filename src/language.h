@@ -2,17 +2,17 @@
 #define LANGUAGE_H
 
 #include <cassert>
+#include <deque>
 #include <exception>
 #include <iostream>
 #include <memory>
-#include <mutex>
 #include <string>
-#include <thread>
 #include <unordered_map>
 #include <utility>
-#include <atomic>
 #include <vector>
+#include <string_view>
 #include "refcount.h"
+#include "engine/random.h"
 
 
 struct StrWithSize {
@@ -45,15 +45,73 @@ public:
         : lineno{lineno}, cause{std::move(cause)} {}
 };
 
-class StopException : std::exception {};
-
 struct Value {
-    enum Type { TUPLE, DOUBLE, INT64, BOOL, NONE } type;
+    enum Type {
+        TUPLE,
+        SMALL_TUPLE,
+        LIST,
+        MAP,
+        STRING,
+        DOUBLE,
+        INT64,
+        BOOL,
+        NONE
+    } type;
 
     typedef RefCounted<std::vector<Value>> Tuple;
 
+    /**
+     * Tuple of a few numbers, bools or Nones, such as a coordinate, kept
+     * in the value itself so that making one allocates nothing. Larger
+     * tuples are kept with the other tuples.
+     */
+    struct SmallTuple {
+        static constexpr std::size_t CAPACITY = 2;
+
+        union {
+            double d;
+            int64_t i;
+            bool b;
+        } elems[CAPACITY];
+        uint8_t types[CAPACITY];
+        uint8_t size;
+    };
+
+    /**
+     * Reference to a mutable list. Copies refer to the same list, and
+     * slices to a range of it, so changes are seen through all of them.
+     * The items are kept with the tuples.
+     */
+    struct List {
+        Tuple items;
+        // Range of items seen, all of them if size is ALL
+        uint32_t start;
+        uint32_t size;
+    };
+
+    static constexpr uint32_t ALL = UINT32_MAX;
+
+    /**
+     * Immutable text. Literals refer to the text interned in the Code
+     * without counting, other strings are kept with the strings of the
+     * program.
+     */
+    typedef RefCounted<const std::string> String;
+
+    /**
+     * Reference to a hash table, see MapTable. Copies refer to the same
+     * table.
+     */
+    struct Map {
+        Tuple items;
+    };
+
     union {
         Tuple tuple;
+        SmallTuple small;
+        List list;
+        Map map;
+        String str;
         double d;
         int64_t i;
         bool b;
@@ -61,42 +119,10 @@ struct Value {
 
     ~Value() { del(); }
 
-    Value(const Value &other) : type{other.type} {
-        switch (type) {
-        case TUPLE:
-            new (&tuple) Tuple{other.tuple};
-            break;
-        case DOUBLE:
-            d = other.d;
-            break;
-        case INT64:
-            i = other.i;
-            break;
-        case BOOL:
-            b = other.b;
-            break;
-        case NONE:
-            break;
-        }
-    }
+    Value(const Value &other) : type{other.type} { copy_from(other); }
 
     Value(Value &&other) noexcept : type{other.type} {
-        switch (type) {
-        case TUPLE:
-            new (&tuple) Tuple{std::move(other.tuple)};
-            break;
-        case DOUBLE:
-            d = other.d;
-            break;
-        case INT64:
-            i = other.i;
-            break;
-        case BOOL:
-            b = other.b;
-            break;
-        case NONE:
-            break;
-        }
+        copy_from(other);
         other.del();
     }
 
@@ -104,22 +130,7 @@ struct Value {
         if (this != &other) {
             del();
             type = other.type;
-            switch (type) {
-            case TUPLE:
-                new (&tuple) Tuple{other.tuple};
-                break;
-            case DOUBLE:
-                d = other.d;
-                break;
-            case INT64:
-                i = other.i;
-                break;
-            case BOOL:
-                b = other.b;
-                break;
-            case NONE:
-                break;
-            }
+            copy_from(other);
         }
         return *this;
     }
@@ -128,22 +139,7 @@ struct Value {
         if (this != &other) {
             del();
             type = other.type;
-            switch (type) {
-            case TUPLE:
-                new (&tuple) Tuple{std::move(other.tuple)};
-                break;
-            case DOUBLE:
-                d = other.d;
-                break;
-            case INT64:
-                i = other.i;
-                break;
-            case BOOL:
-                b = other.b;
-                break;
-            case NONE:
-                break;
-            }
+            copy_from(other);
             other.del();
         }
         return *this;
@@ -153,130 +149,589 @@ struct Value {
     explicit Value(int64_t i) : type{INT64}, i{i} {}
     explicit Value(double d) : type{DOUBLE}, d{d} {}
     explicit Value(Tuple tuple) : type{TUPLE}, tuple{std::move(tuple)} {}
+    explicit Value(SmallTuple small) : type{SMALL_TUPLE}, small{small} {}
+    explicit Value(List list) : type{LIST}, list{std::move(list)} {}
+    explicit Value(Map map) : type{MAP}, map{std::move(map)} {}
+    explicit Value(String str) : type{STRING}, str{std::move(str)} {}
     explicit Value() : type{NONE}, i{0} {}
 
     bool numeric() const { return type == DOUBLE || type == INT64; }
 
-    bool boolean() const {
+    /**
+     * Returns true for values that fit in a SmallTuple.
+     */
+    bool scalar() const {
+        return type == DOUBLE || type == INT64 || type == BOOL || type == NONE;
+    }
+
+    bool is_tuple() const { return type == TUPLE || type == SMALL_TUPLE; }
+
+    /**
+     * Returns true for tuples and lists, which have elements.
+     */
+    bool sequence() const { return is_tuple() || type == LIST; }
+
+    /**
+     * Returns the number of elements of a tuple or list.
+     */
+    std::size_t length() const {
+        if (type == TUPLE) {
+            return tuple->size();
+        } else if (type == SMALL_TUPLE) {
+            return small.size;
+        }
+        return list.size == ALL ? list.items->size() : list.size;
+    }
+
+    /**
+     * Returns element ix of a tuple or list, ix must be below length.
+     */
+    Value get(std::size_t ix) const {
+        if (type == TUPLE) {
+            return (*tuple)[ix];
+        } else if (type == SMALL_TUPLE) {
+            switch (small.types[ix]) {
+            case DOUBLE:
+                return Value(small.elems[ix].d);
+            case INT64:
+                return Value(small.elems[ix].i);
+            case BOOL:
+                return Value(small.elems[ix].b);
+            default:
+                return Value();
+            }
+        }
+        return (*list.items)[list.start + ix];
+    }
+
+    /**
+     * Returns element ix of a list, ix must be below length.
+     */
+    Value &list_item(std::size_t ix) {
+        return (*list.items)[list.start + ix];
+    }
+
+    /**
+     * Returns true if the count values from first fit in a SmallTuple.
+     */
+    static bool fits_small(const Value *first, std::size_t count) {
+        if (count > SmallTuple::CAPACITY) {
+            return false;
+        }
+        for (std::size_t ix = 0; ix < count; ++ix) {
+            if (!first[ix].scalar()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Returns a small tuple of the count values from first, which must
+     * fit.
+     */
+    static Value small_tuple(const Value *first, std::size_t count) {
+        SmallTuple t{};
+        t.size = static_cast<uint8_t>(count);
+        for (std::size_t ix = 0; ix < count; ++ix) {
+            t.types[ix] = static_cast<uint8_t>(first[ix].type);
+            if (first[ix].type == DOUBLE) {
+                t.elems[ix].d = first[ix].d;
+            } else if (first[ix].type == INT64) {
+                t.elems[ix].i = first[ix].i;
+            } else if (first[ix].type == BOOL) {
+                t.elems[ix].b = first[ix].b;
+            }
+        }
+        return Value(t);
+    }
+
+    /**
+     * Returns the items kept with the tuples for tuples, lists and maps,
+     * and nullptr for other values.
+     */
+    const std::vector<Value> *heap_items() const {
         switch (type) {
         case TUPLE:
-            return !tuple->empty();
-        case DOUBLE:
-            return d != 0.0;
-        case INT64:
-            return i != 0;
-        case BOOL:
-            return b;
-        case NONE:
+            return tuple.get();
+        case LIST:
+            return list.items.get();
+        case MAP:
+            return map.items.get();
         default:
-            return false;
+            return nullptr;
         }
     }
 
-    void write(std::ostream &o) {
+    bool boolean() const;
+
+    /**
+     * Appends the value as printed by scripts to out. Lists and maps nested
+     * deeper than depth, which they can be by containing themselves, are
+     * cut short.
+     */
+    void write(std::string &out, int depth = 8) const;
+
+    void del() {
+        if (type == TUPLE) {
+            tuple.~Tuple();
+        } else if (type == LIST) {
+            list.~List();
+        } else if (type == MAP) {
+            map.~Map();
+        } else if (type == STRING) {
+            str.~String();
+        }
+        type = NONE;
+    }
+
+private:
+    // Copies the payload of other, type must already be set
+    void copy_from(const Value &other) {
         switch (type) {
         case TUPLE:
-            o << "(";
-            for (Value &v : *tuple) {
-                v.write(o);
-                o << ',';
-            }
-            o << ")";
+            new (&tuple) Tuple{other.tuple};
             break;
-        case DOUBLE:
-            o << d;
+        case SMALL_TUPLE:
+            small = other.small;
             break;
-        case BOOL:
-            o << (b ? "True" : "False");
+        case LIST:
+            new (&list) List{other.list};
+            break;
+        case MAP:
+            new (&map) Map{other.map};
+            break;
+        case STRING:
+            new (&str) String{other.str};
+            break;
+        case DOUBLE:
+            d = other.d;
             break;
         case INT64:
-            o << i;
+            i = other.i;
+            break;
+        case BOOL:
+            b = other.b;
             break;
         case NONE:
-            o << "None";
             break;
         }
     }
+};
 
-    void del() {
-        if (type == TUPLE) {
-            tuple.~Tuple();
+static_assert(sizeof(Value::SmallTuple) <= sizeof(Value::List),
+              "Small tuples must not make values larger");
+
+/**
+ * Open addressing hash table kept in the items of a map, so that it is
+ * reference counted and copied like a tuple. Keys are integers and tuples
+ * of keys, with integral doubles equal to the same integer. Item 0 is the
+ * number of entries and item 1 the number of used slots, removed ones
+ * included, followed by a key and value per slot. Empty slots have a None
+ * key and removed ones a False key.
+ */
+class MapTable {
+public:
+    explicit MapTable(std::vector<Value> &items) : items{items} {}
+
+    /**
+     * Returns the items of an empty table.
+     */
+    static std::vector<Value> make();
+
+    /**
+     * Returns the number of entries of the table in items.
+     */
+    static std::size_t size(const std::vector<Value> &items);
+
+    /**
+     * Calls f with the key and value of every entry of the table in items.
+     */
+    template <class F>
+    static void for_each(const std::vector<Value> &items, F &&f) {
+        for (std::size_t ix = HEADER; ix < items.size(); ix += 2) {
+            if (items[ix].type != Value::NONE &&
+                items[ix].type != Value::BOOL) {
+                f(items[ix], items[ix + 1]);
+            }
         }
-        type = NONE;
     }
+
+    /**
+     * Returns the value of key, or nullptr if it is missing. Throws
+     * RuntimeError if key can not be a key.
+     */
+    Value *find(const Value &key, int32_t lineno);
+
+    void insert(const Value &key, Value val, int32_t lineno);
+
+    /**
+     * Removes key, returning false if it is missing.
+     */
+    bool remove(const Value &key, int32_t lineno);
+
+private:
+    static constexpr std::size_t HEADER = 2;
+    static constexpr std::size_t MIN_SLOTS = 8;
+
+    /**
+     * Returns the item index of the key slot of key, or of the slot to
+     * insert it in if found is false.
+     */
+    std::size_t probe(const Value &key, uint64_t hash, bool &found) const;
+
+    // Rebuilds the table with room for one more entry
+    void grow();
+
+    std::vector<Value> &items;
 };
 
 class Expression;
 class Statement;
 class Function;
 
-class Program {
-    std::unordered_map<int32_t, Value> globals;
-    std::vector<std::unordered_map<int32_t, Value>> scopes;
+/**
+ * One instruction of a compiled program. Instructions work on the value
+ * stack of the program, see Instruction::Op for what a and b mean.
+ */
+struct Instruction {
+    enum Op : uint8_t {
+        // Push constant a
+        CONSTANT,
+        // Push variable a
+        LOAD,
+        // Pop into variable a
+        STORE,
+        // Pop a values
+        POP,
+        // Pop the right and left operands, push the result of BinOp::Type a
+        BINARY,
+        // Pop the operand, push the result of UniOp::Type a
+        UNARY,
+        // Pop a values, push a tuple of them
+        MAKE_TUPLE,
+        // Pop a values, push a list of them
+        MAKE_LIST,
+        // Pop the index and the tuple or list, push the element
+        INDEX,
+        // Pop the end if a & 2, the start if a & 1, and the tuple or list,
+        // push the slice
+        SLICE,
+        // Pop the value, the index and the list, and set the element
+        STORE_INDEX,
+        // Call builtin BuiltinCall::Type a on the top b values
+        BUILTIN,
+        // Push the result of the last READ_FRONT
+        READ_RESULT,
+        // Call function a with the top b values as arguments
+        CALL,
+        // Pop the return value, leave the frame and push it
+        RETURN,
+        // Continue at a
+        JUMP,
+        // Pop, and continue at a if false
+        JUMP_IF_FALSE,
+        // Check that the top is a tuple or list, replacing a map with a
+        // tuple of its keys, and push the loop index
+        FOR_BEGIN,
+        // Set variable b to the next element and advance the index, or
+        // continue at a if there is none
+        FOR_NEXT,
+        // Define function a as compiled function b
+        DEFINE,
+        // Raise runtime error a
+        FAIL,
+        // End of the entrypoint, restart it
+        END,
+    } op;
+    int32_t a, b;
+    int32_t lineno;
+};
 
-    std::unordered_map<int32_t, Function *> funcs;
+struct CompiledFunction {
+    std::vector<int32_t> params;
+    int32_t entry;
+};
 
-    // Used for memory only
-    std::vector<std::unique_ptr<Expression>> all_exprs;
-    std::vector<std::unique_ptr<Statement>> all_statements;
-    std::vector<std::unique_ptr<Function>> all_functions;
+/**
+ * Compiled program, never changed once compiled, so it is shared between
+ * a program and its snapshots.
+ */
+struct Code {
+    std::vector<Instruction> instructions;
+    // Only scalar values and interned strings, which can be copied from any
+    // thread
+    std::vector<Value> constants;
+    // Text of the string literals, once each. Never moved, since constants
+    // refer to it
+    std::deque<std::string> strings;
+    std::vector<std::string> errors;
+    std::vector<CompiledFunction> functions;
+};
 
-    // Reference counts
-    RefCountSet<std::vector<Value>> tuples;
+/**
+ * Compiles statements into Code. The entrypoint starts at instruction 0,
+ * functions follow it.
+ */
+class Compiler {
+public:
+    explicit Compiler(Code &code) : code{code} {}
+
+    void compile(const Statement *entry);
+
+    int32_t emit(Instruction::Op op, int32_t lineno, int32_t a = 0,
+                 int32_t b = 0);
+
+    /**
+     * Emits a jump with a target set later with patch.
+     */
+    int32_t emit_jump(Instruction::Op op, int32_t lineno, int32_t b = 0);
+
+    /**
+     * Sets the target of jump ix to the next instruction.
+     */
+    void patch(int32_t ix);
+
+    [[nodiscard]] int32_t next() const;
+
+    void emit_constant(Value value, int32_t lineno);
 
-    std::atomic_bool paused{false};
-    std::atomic_bool running{false};
-    std::atomic<int32_t> lineno{0};
+    /**
+     * Emits a constant of the interned text, one constant for every
+     * distinct text.
+     */
+    void emit_string(const std::string &text, int32_t lineno);
 
-    std::thread run_thread;
+    void emit_fail(const char *cause, int32_t lineno);
 
-    Value return_val = Value();
+    /**
+     * Compiles a function body later, returning its index.
+     */
+    int32_t add_function(const Function *f);
 
+    // Loops being compiled, for break and continue
+    struct Loop {
+        int32_t continue_target;
+        std::vector<int32_t> breaks;
+    };
+    std::vector<Loop> loops;
+    bool in_function = false;
+
+private:
+    Code &code;
+    std::vector<const Function *> functions;
+    // Constant of every interned text
+    std::unordered_map<std::string, int32_t> interned;
+};
+
+struct Frame {
+    std::unordered_map<int32_t, Value> locals;
+    int32_t return_pc;
+    // Size of the value stack when the frame was entered
+    std::size_t stack_base;
+};
+
+/**
+ * Everything that changes while a program runs, besides the tuples the
+ * values refer to.
+ */
+struct ExecutionState {
+    std::unordered_map<int32_t, Value> globals;
+    std::unordered_map<int32_t, int32_t> funcs;
+    std::vector<Frame> frames;
+    std::vector<Value> stack;
+    int32_t pc = 0;
+    // Answer to the last READ_FRONT, see Program::set_read_result
+    bool read_result = false;
+    // Stream of the rand builtin, restarted from the world seed on start
+    Rng rng;
+};
+
+/**
+ * Copy of a program between slices, see Program::snapshot.
+ */
+class ProgramSnapshot {
 public:
-    uint32_t EVT_PRINT, EVT_MOVE, EVT_ROTL, EVT_ROTR, EVT_READ_TILE,
-        EVT_MOVE_FORWARDS;
+    ProgramSnapshot() = default;
+    ProgramSnapshot(ProgramSnapshot &&other) = default;
+    ProgramSnapshot &operator=(ProgramSnapshot &&other) noexcept {
+        // Swapped, since moving tuples first would free the tuples the old
+        // state still refers to
+        std::swap(strings, other.strings);
+        std::swap(tuples, other.tuples);
+        std::swap(code, other.code);
+        std::swap(state, other.state);
+        return *this;
+    }
 
-    Statement *entrypoint;
+private:
+    friend class Program;
 
-    ~Program() { stop(); }
+    // Declared first, so the values are released before them
+    RefCountSet<const std::string> strings;
+    RefCountSet<std::vector<Value>> tuples;
+    std::shared_ptr<const Code> code;
+    ExecutionState state;
+};
 
-    void status(int32_t lineno);
+/**
+ * Action requested by a program, see Program::run_slice.
+ */
+struct ProgramAction {
+    enum Type : uint8_t {
+        NONE,
+        // Text in print_buffer, empty for a print without arguments
+        PRINT,
+        MOVE,
+        ROTL,
+        ROTR,
+        FORWARDS,
+        // Answered with set_read_result before the program continues
+        READ_FRONT,
+    } type;
+    // Direction of a MOVE, each -1, 0 or 1
+    int32_t dx, dy;
+};
 
-    void set_events(uint32_t print_evt);
+/**
+ * A compiled program and the state of running it. Programs run on the
+ * calling thread, a slice at a time. When a script calls an action builtin
+ * the slice ends, and the action is left for the caller to carry out
+ * before running the next slice, so a waiting program costs no thread.
+ */
+class Program {
+    std::shared_ptr<const Code> code;
 
-    void add_scope();
+    // Reference counts, declared before state so it is released first.
+    // Strings come before the tuples, whose items may refer to them.
+    RefCountSet<const std::string> strings;
+    RefCountSet<std::vector<Value>> tuples;
 
-    void load_program(std::vector<std::unique_ptr<Statement>> statements,
-                      std::vector<std::unique_ptr<Expression>> expressions,
-                      std::vector<std::unique_ptr<Function>> all_funcs,
-                      Statement *entry); // Outside thread
+    ExecutionState state;
 
-    void pause(); // Outside thread
+    ProgramAction action{ProgramAction::NONE, 0, 0};
 
-    void resume(); // Outside thread
+    bool running = false;
 
-    void step(); // Outside thread
+    void execute(const Instruction &in);
 
-    void stop(); // Outside thread
+    void call_builtin(const Instruction &in);
 
-    void start(); // Outside thread
+    void push(Value v) { state.stack.push_back(std::move(v)); }
 
-    void remove_scope();
+    Value pop() {
+        Value v = std::move(state.stack.back());
+        state.stack.pop_back();
+        return v;
+    }
 
     // Implicit add_ref
     void set_var(int32_t id, Value val, bool param);
 
-    Value get_var(int32_t id);
+    Value get_var(int32_t id, int32_t lineno);
 
-    void set_function(int32_t id, Function *f);
+    /**
+     * Copies state into dest, with copies of all tuples and strings it
+     * refers to added to tuples and strings. Those referred to more than
+     * once are copied once, interned strings are shared.
+     */
+    static void copy_state(const ExecutionState &src, ExecutionState &dest,
+                           RefCountSet<std::vector<Value>> &tuples,
+                           RefCountSet<const std::string> &strings);
 
-    Function *get_function(int32_t id);
+public:
+    enum class RunStatus {
+        // Stopped at an action, see get_action
+        ACTION,
+        // Ran out of instructions
+        YIELD,
+        // Reached the end of the entrypoint, and will run it again
+        END,
+        // Stopped by a runtime error, with the message in error_buffer
+        ERROR,
+    };
 
-    void set_return(Value val);
+    // Text of the last print and runtime error. Prints are formatted
+    // straight into print_buffer, which keeps its capacity between them.
+    std::string print_buffer;
+    std::string error_buffer;
 
-    Value get_return();
+    /**
+     * Compiles the program, which is run from the start by start.
+     */
+    void load_program(std::vector<std::unique_ptr<Statement>> statements,
+                      std::vector<std::unique_ptr<Expression>> expressions,
+                      std::vector<std::unique_ptr<Function>> all_funcs,
+                      Statement *entry);
+
+    /**
+     * Returns the compiled program, which other programs can run with
+     * begin.
+     */
+    [[nodiscard]] std::shared_ptr<const Code> get_code() const;
+
+    /**
+     * Starts the loaded program from the beginning, with rand drawing from
+     * the script stream of the world seed.
+     */
+    void start();
+
+    /**
+     * Starts code from the beginning. rng is the stream of rand.
+     */
+    void begin(std::shared_ptr<const Code> code, Rng rng);
+
+    /**
+     * Stops the program and frees its state and code.
+     */
+    void stop();
+
+    /**
+     * Returns true from start until stopped or a runtime error.
+     */
+    [[nodiscard]] bool is_running() const;
+
+    /**
+     * Runs instructions until budget of them have run, stopping early at
+     * an action, the end of the entrypoint or a runtime error. budget is
+     * lowered by the number run. Must only be called while running.
+     */
+    RunStatus run_slice(uint32_t &budget);
+
+    /**
+     * Returns the action the last slice stopped at.
+     */
+    [[nodiscard]] const ProgramAction &get_action() const;
+
+    /**
+     * Answers a READ_FRONT action.
+     */
+    void set_read_result(bool is_open);
+
+    /**
+     * Copies the state of the program. Takes time and memory in proportion
+     * to the live values.
+     */
+    [[nodiscard]] ProgramSnapshot snapshot() const;
+
+    /**
+     * Continues the program from snapshot. Any number of programs can be
+     * restored from the same snapshot.
+     */
+    void restore(const ProgramSnapshot &snapshot);
 
     Value::Tuple add_tuple(std::vector<Value> tuple);
+
+    Value::List add_list(std::vector<Value> items);
+
+    Value::Map add_map();
+
+    Value::String add_string(std::string text);
+
+    /**
+     * Returns a tuple of vals, kept in the value if it is small enough.
+     */
+    Value make_tuple(std::vector<Value> vals);
 };
 
 class Expression {
@@ -287,20 +742,21 @@ public:
 
     virtual ~Expression() = default;
 
-    virtual Value evaluate(Program &p) const = 0;
+    /**
+     * Emits instructions leaving the value of the expression on the stack.
+     */
+    virtual void compile(Compiler &c) const = 0;
 };
 
 class Statement {
 public:
-    enum Status { RETURN, BREAK, CONTINUE, NEXT };
-
     explicit Statement(int32_t lineno) : lineno{lineno} {}
 
     int32_t lineno;
 
     virtual ~Statement() = default;
 
-    virtual Status evaluate(Program &p) const = 0;
+    virtual void compile(Compiler &c) const = 0;
 };
 
 class Function {
@@ -354,27 +810,10 @@ public:
         }
     }
 
-    Value to_value(Program &p) const {
-        if (type == DOUBLE) {
-            return Value(d);
-        }
-        if (type == INT64) {
-            return Value(i);
-        }
-        if (type == BOOL) {
-            return Value(b);
-        }
-        if (type == NONE) {
-            return Value();
-        }
-        std::vector<Value> vals;
-        vals.reserve(tuple.size());
-        for (auto &lit : tuple) {
-            vals.push_back(lit->evaluate(p));
-        }
-        auto v = p.add_tuple(std::move(vals));
-        return Value(v);
-    }
+    /**
+     * Emits instructions pushing the value of the literal.
+     */
+    void compile(Compiler &c, int32_t lineno) const;
 
     union {
         std::vector<Expression *> tuple;
@@ -391,11 +830,17 @@ public:
     LiteralExpr(Literal &&val, int32_t lineno)
         : Expression(lineno), val{std::move(val)} {}
 
-    Value evaluate(Program &p) const override {
-        p.status(lineno);
-        Value v = val.to_value(p);
-        return v;
-    }
+    void compile(Compiler &c) const override { val.compile(c, lineno); }
+};
+
+class StringExpr : public Expression {
+    std::string text;
+
+public:
+    StringExpr(int32_t lineno, std::string text)
+        : Expression{lineno}, text{std::move(text)} {}
+
+    void compile(Compiler &c) const override;
 };
 
 class BinOp : public Expression {
@@ -427,7 +872,13 @@ public:
     BinOp(Type type, Expression *lhs, Expression *rhs, int32_t lineno)
         : Expression(lineno), type{type}, lhs{lhs}, rhs{rhs} {}
 
-    Value evaluate(Program &program) const override;
+    /**
+     * Returns the result of operation type, or throws RuntimeError.
+     */
+    static Value apply(Type type, const Value &left, const Value &right,
+                       Program &p, int32_t lineno);
+
+    void compile(Compiler &c) const override;
 };
 
 class UniOp : public Expression {
@@ -438,7 +889,9 @@ public:
     UniOp(int32_t lineno, Type type, Expression *e)
         : Expression{lineno}, type{type}, e{e} {}
 
-    Value evaluate(Program &p) const override;
+    static Value apply(Type type, const Value &inner, int32_t lineno);
+
+    void compile(Compiler &c) const override;
 };
 
 class FuncCall : public Expression {
@@ -449,14 +902,9 @@ public:
     FuncCall(int32_t lineno, int32_t name_id, std::vector<Expression *> args)
         : Expression{lineno}, name_id{name_id}, args{std::move(args)} {}
 
-    Value evaluate(Program &p) const override;
+    void compile(Compiler &c) const override;
 };
 
-struct ReadTile {
-    ReadTile() : m{}, is_open{false} {}
-    std::mutex m;
-    bool is_open;
-};
 
 class BuiltinCall : public Expression {
     std::vector<Expression *> args;
@@ -472,12 +920,21 @@ public:
         ROTL,
         FORWARDS,
         READ_FRONT,
-        RANDOM
+        RANDOM,
+        LIST,
+        APPEND,
+        DICT,
+        INSERT,
+        LOOKUP,
+        CONTAINS,
+        REMOVE,
+        STR,
+        FORMAT
     } type;
     BuiltinCall(int32_t lineno, Type type, std::vector<Expression *> args)
         : Expression{lineno}, type{type}, args{std::move(args)} {}
 
-    Value evaluate(Program &p) const override;
+    void compile(Compiler &c) const override;
 };
 
 class VariableExpr : public Expression {
@@ -486,7 +943,35 @@ class VariableExpr : public Expression {
 public:
     VariableExpr(int32_t lineno, int32_t id) : Expression{lineno}, id{id} {}
 
-    Value evaluate(Program &p) const override;
+    void compile(Compiler &c) const override;
+};
+
+class IndexExpr : public Expression {
+    Expression *target;
+    Expression *index;
+
+public:
+    IndexExpr(int32_t lineno, Expression *target, Expression *index)
+        : Expression{lineno}, target{target}, index{index} {}
+
+    void compile(Compiler &c) const override;
+};
+
+/**
+ * target[start:end], where start and end may be nullptr for the start
+ * and end of target.
+ */
+class SliceExpr : public Expression {
+    Expression *target;
+    Expression *start;
+    Expression *end;
+
+public:
+    SliceExpr(int32_t lineno, Expression *target, Expression *start,
+              Expression *end)
+        : Expression{lineno}, target{target}, start{start}, end{end} {}
+
+    void compile(Compiler &c) const override;
 };
 
 class Assignment : public Statement {
@@ -497,7 +982,23 @@ public:
     Assignment(int32_t lineno, int32_t id, Expression *expr)
         : Statement{lineno}, id{id}, val{expr} {}
 
-    Status evaluate(Program &p) const override;
+    void compile(Compiler &c) const override;
+};
+
+/**
+ * target[index] = val, where target is a list.
+ */
+class IndexAssignment : public Statement {
+    Expression *target;
+    Expression *index;
+    Expression *val;
+
+public:
+    IndexAssignment(int32_t lineno, Expression *target, Expression *index,
+                    Expression *val)
+        : Statement{lineno}, target{target}, index{index}, val{val} {}
+
+    void compile(Compiler &c) const override;
 };
 
 class ExpressionStatement : public Statement {
@@ -507,7 +1008,7 @@ public:
     ExpressionStatement(int32_t lineno, Expression *expr)
         : Statement{lineno}, expr{expr} {}
 
-    Status evaluate(Program &p) const override;
+    void compile(Compiler &c) const override;
 };
 
 class ReturnStatement : public Statement {
@@ -517,7 +1018,7 @@ public:
     ReturnStatement(int32_t lineno, Expression *expr)
         : Statement{lineno}, expr{expr} {}
 
-    Status evaluate(Program &p) const override;
+    void compile(Compiler &c) const override;
 };
 
 class FlowStatement : public Statement {
@@ -527,7 +1028,7 @@ public:
     FlowStatement(int32_t lineno, bool is_break)
         : Statement{lineno}, is_break{is_break} {}
 
-    Status evaluate(Program &p) const override;
+    void compile(Compiler &c) const override;
 };
 
 class IfStatement : public Statement {
@@ -540,7 +1041,7 @@ public:
                 std::vector<Statement *> on_if, IfStatement *next)
         : Statement(lineno), cond{cond}, on_if{std::move(on_if)}, next{next} {}
 
-    Status evaluate(Program &p) const override;
+    void compile(Compiler &c) const override;
 };
 
 class WhileStatement : public Statement {
@@ -551,7 +1052,7 @@ public:
     WhileStatement(int32_t lineno, Expression *cond,
                    std::vector<Statement *> statements)
         : Statement{lineno}, cond{cond}, statements{std::move(statements)} {}
-    Status evaluate(Program &p) const override;
+    void compile(Compiler &c) const override;
 };
 
 class ForStatement : public Statement {
@@ -564,7 +1065,7 @@ public:
                  std::vector<Statement *> statements)
         : Statement{lineno}, expr{expr}, var_id{var_id},
           statements{std::move(statements)} {}
-    Status evaluate(Program &p) const override;
+    void compile(Compiler &c) const override;
 };
 
 class GlobalStatement : public Statement {
@@ -573,7 +1074,7 @@ class GlobalStatement : public Statement {
 public:
     explicit GlobalStatement(std::vector<Statement *> statements)
         : Statement{0}, statements{std::move(statements)} {}
-    Status evaluate(Program &p) const override;
+    void compile(Compiler &c) const override;
 };
 
 class FuncDef : public Statement {
@@ -584,7 +1085,7 @@ public:
     FuncDef(int32_t lineno, Function *f, int32_t name_id)
         : Statement{lineno}, function{f}, name_id{name_id} {}
 
-    Status evaluate(Program &p) const override;
+    void compile(Compiler &c) const override;
 };
 
 #endif
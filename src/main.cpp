@@ -1,4 +1,5 @@
 #include "game.h"
+#include "config.h"
 #include "engine/log.h"
 #include "engine/engine.h"
 #include "engine/game.h"
@@ -55,6 +56,7 @@ int main(int argv, char* argc[]) {
 
     StateGame game {new GameState(), 1920, 1080, "Text box!!!"};
     try {
+        game.set_tick_rate(TICKS_PER_SECOND, MAX_CATCH_UP_TICKS);
         game.create();
         game.run();
     } catch (base_exception& e) {
@@ -30,11 +30,13 @@ void Maze::generate_maze() {
         std::fill(row.begin(), row.end(), TileType::VOID);
     }
 
-    auto generate_room = []() {
-        int32_t w = engine::random<int32_t>(ROOM_MIN_SIZE, ROOM_MAX_SIZE);
-        int32_t h = engine::random<int32_t>(ROOM_MIN_SIZE, ROOM_MAX_SIZE);
-        int32_t x = engine::random<int32_t>(0, MAZE_WIDTH - w);
-        int32_t y = engine::random<int32_t>(0, MAZE_HEIGHT - h);
+    Rng rng = engine::make_stream(RNG_STREAM_MAZE);
+
+    auto generate_room = [&rng]() {
+        auto w = static_cast<int32_t>(rng.range(ROOM_MIN_SIZE, ROOM_MAX_SIZE));
+        auto h = static_cast<int32_t>(rng.range(ROOM_MIN_SIZE, ROOM_MAX_SIZE));
+        auto x = static_cast<int32_t>(rng.range(0, MAZE_WIDTH - w));
+        auto y = static_cast<int32_t>(rng.range(0, MAZE_HEIGHT - h));
         return Room{x, y, w, h};
     };
 
@@ -147,7 +149,8 @@ void Maze::generate_maze() {
     std::vector<Room> rooms{};
     uint32_t tries = 0;
 
-    uint32_t room_count = engine::random<uint32_t>(MIN_ROOM_COUNT, MAX_ROOM_COUNT);
+    auto room_count =
+        static_cast<uint32_t>(rng.range(MIN_ROOM_COUNT, MAX_ROOM_COUNT));
     for (uint32_t i = 0; i < room_count;) {
         auto room = generate_room();
         auto room_intersects = [&room, &intersects](Room r) { 
@@ -170,45 +173,60 @@ void Maze::generate_maze() {
     }
 
     for (uint32_t i = 0; i < 8; ++i) {
-        uint32_t ix1 = engine::random<uint32_t>(0, rooms.size());
-        uint32_t ix2 = engine::random<uint32_t>(0, rooms.size());
+        auto ix1 = static_cast<uint32_t>(rng.range(0, rooms.size()));
+        auto ix2 = static_cast<uint32_t>(rng.range(0, rooms.size()));
         connect_rooms(rooms[ix1], rooms[ix2]);
     }
 
     start = rooms.front().middle();
     goal = rooms.back().middle();
+    invalidate();
 }
 
 Maze::Maze() : map{MAZE_WIDTH} { generate_maze(); }
 
-void Maze::set_texture(Texture *texture) { texture_tile = texture ;}
+void Maze::set_sprite(const Sprite *sprite) {
+    tile_sprite = sprite;
+    invalidate();
+}
+
+void Maze::invalidate() { static_dirty = true; }
 
-void Maze::render(float offset_x, float offset_y) {
-    constexpr SDL_Color LIGHTGRAY = {0xe0, 0xe0, 0xe0, 0xff};
+void Maze::render_static_layer() {
     constexpr SDL_Color GRAY = {0x3f, 0x3f, 0x3f, 0xff};
     constexpr SDL_Color WHITE = {0xff, 0xff, 0xff, 0xff};
-    constexpr SDL_Color BLACK = {0x0, 0x0, 0x0, 0xff};
 
+    if (static_layer.get_width() == 0) {
+        static_layer.create_target(static_cast<int>(TILE_SIZE * MAZE_WIDTH),
+                                   static_cast<int>(TILE_SIZE * MAZE_HEIGHT));
+    }
+    Texture::set_render_target(&static_layer);
+    SDL_SetRenderDrawColor(gRenderer, 0, 0, 0, 0);
+    SDL_RenderClear(gRenderer);
+
+    SpriteBatch batch{};
     for (int i = 0; i < map.size(); i++) {
         for (int j = 0; j < map[0].size(); j++) {
-            bool draw_texture = false;
-            SDL_Color color = WHITE;
-            SDL_FRect rect = {offset_x + TILE_SIZE * i,
-                              offset_y + TILE_SIZE * j, TILE_SIZE,
+            SDL_FRect rect = {TILE_SIZE * i, TILE_SIZE * j, TILE_SIZE,
                               TILE_SIZE};
             if (!is_open(i, j)) {
-                color = GRAY;
-                (i % 2 == 0) ? LIGHTGRAY : ((j % 2 == 0) ? GRAY : BLACK);
+                batch.fill_rect(rect, GRAY);
+            } else if (tile_sprite == nullptr) {
+                batch.fill_rect(rect, WHITE);
             } else {
-                draw_texture = texture_tile != nullptr;
-            }
-            if (draw_texture) {
-                texture_tile->render_corner(offset_x + TILE_SIZE * i, offset_y + TILE_SIZE * j);
-            } else {
-                SDL_SetRenderDrawColor(gRenderer, color.r, color.g, color.b,
-                                        color.a);
-                SDL_RenderFillRect(gRenderer, &rect);
+                batch.draw(*tile_sprite, rect, 0.0, WHITE);
             }
         }
     }
+    batch.flush();
+
+    Texture::set_render_target(nullptr);
+    static_dirty = false;
+}
+
+void Maze::render(SpriteBatch &batch, float offset_x, float offset_y) {
+    if (static_dirty) {
+        render_static_layer();
+    }
+    batch.draw(Sprite::from_texture(static_layer), offset_x, offset_y);
 }
@@ -6,7 +6,7 @@ constexpr float TILE_SIZE = 32.0f;
 
 #include <array>
 #include <vector>
-#include "engine/texture.h"
+#include "engine/atlas.h"
 
 enum Direction : int { LEFT = 0, UP = 1, RIGHT = 2, DOWN = 3 };
 
@@ -18,12 +18,22 @@ private:
 
     void generate_maze();
 
-    Texture* texture_tile;
+    /**
+     * Draws every tile into static_layer. Called from render whenever the
+     * tiles or the tile texture have changed.
+     */
+    void render_static_layer();
+
+    const Sprite* tile_sprite = nullptr;
+
+    // Cached render target holding all tiles, redrawn only when dirty.
+    Texture static_layer;
+    bool static_dirty = true;
 
 public:
     std::pair<int32_t, int32_t> start, goal;
 
-    bool is_open(int32_t x, int32_t y) {
+    bool is_open(int32_t x, int32_t y) const {
         if (x < 0 || x >= map.size()) {
             return false;
         }
@@ -35,7 +45,13 @@ public:
 
     Maze();
 
-    void set_texture(Texture* texture);
+    void set_sprite(const Sprite* sprite);
+
+    /**
+     * Marks the cached tile layer as outdated, causing it to be redrawn on
+     * the next render.
+     */
+    void invalidate();
 
-    void render(float offet_x, float offset_y);
+    void render(SpriteBatch& batch, float offset_x, float offset_y);
 };
@@ -4,9 +4,16 @@
 // Global scope:
 //      <statement>|<function_def>
 // <statement>:
-//      <call>|<assignment>|<if>|<while>|<for>|<return>|<break>|<continue>
+//      <call>|<assignment>|<index_assignment>|<if>|<while>|<for>|<return>|
+//      <break>|<continue>
 // <expr>
-//      <call>|<var>|<unop>|<binop>|<literal>
+//      <call>|<var>|<unop>|<binop>|<literal>|<string>|<list>|<index>|<slice>
+// <string>
+//      "<text>", with \", \\, \n and \t escapes
+// <list>
+//      [<expr>, ...]
+// <index>, <slice>
+//      <expr>[<expr>], <expr>[<expr>?:<expr>?]
 //
 //
 
@@ -29,6 +36,15 @@ Parser::Parser() {
     builtins.insert({"forward", BuiltinCall::FORWARDS});
     builtins.insert({"read_front", BuiltinCall::READ_FRONT});
     builtins.insert({"rand", BuiltinCall::RANDOM});
+    builtins.insert({"list", BuiltinCall::LIST});
+    builtins.insert({"append", BuiltinCall::APPEND});
+    builtins.insert({"dict", BuiltinCall::DICT});
+    builtins.insert({"insert", BuiltinCall::INSERT});
+    builtins.insert({"lookup", BuiltinCall::LOOKUP});
+    builtins.insert({"contains", BuiltinCall::CONTAINS});
+    builtins.insert({"remove", BuiltinCall::REMOVE});
+    builtins.insert({"str", BuiltinCall::STR});
+    builtins.insert({"format", BuiltinCall::FORMAT});
 }
 
 // Advances ix to point to first non-space in string
@@ -147,6 +163,12 @@ Expression* Parser::parse_expression(Lines lines) {
         ++ix;
         Expression* e = parse_expression(lines);
         var = new UniOp(lineno, UniOp::NOT, e);
+    } else if (lines[line][ix] == '[') {
+        std::vector<Expression*> items{};
+        parse_expression_list(lines, items, '[', ']');
+        var = new BuiltinCall(lineno, BuiltinCall::LIST, items);
+    } else if (lines[line][ix] == '"') {
+        var = new StringExpr(lineno, parse_string(lines));
     } else if (lines[line][ix] >= '0' && lines[line][ix] <= '9') {
         std::string s;
         double d;
@@ -190,6 +212,10 @@ Expression* Parser::parse_expression(Lines lines) {
     }
     all_expressions.emplace_back(var);
     skip_spaces(ix, lines[line]);
+    while (ix < lines[line].size() && lines[line][ix] == '[') {
+        var = parse_index(lines, var);
+        skip_spaces(ix, lines[line]);
+    }
     if (ix >= lines[line].size()) {
         return var;
     }
@@ -369,7 +395,25 @@ Statement* Parser::parse_statement(Lines lines, int32_t indent) {
         if (ix >= lines[line].size()) {
             throw ParseError(lineno, "Not a statement");
         }
-        if (lines[line][ix] != '(') {
+        if (lines[line][ix] == '[') {
+            // Assignment to an element, the last index is the target
+            Expression* target = new VariableExpr(lineno, get_var(id));
+            all_expressions.emplace_back(target);
+            Expression* index = parse_subscript(lines);
+            skip_spaces(ix, lines[line]);
+            while (ix < lines[line].size() && lines[line][ix] == '[') {
+                target = new IndexExpr(lineno, target, index);
+                all_expressions.emplace_back(target);
+                index = parse_subscript(lines);
+                skip_spaces(ix, lines[line]);
+            }
+            expect_char(lines, '=');
+            Expression* source = parse_expression(lines);
+            expect_eol(lines);
+            auto* assign = new IndexAssignment(lineno, target, index, source);
+            all_statements.emplace_back(assign);
+            return assign;
+        } else if (lines[line][ix] != '(') {
             // assignment
             int32_t var_id = get_var(id);
             expect_char(lines, '=');
@@ -416,19 +460,88 @@ void Parser::parse_statements(Lines lines, int32_t indents, std::vector<Statemen
 }
 
 
-void Parser::parse_expression_list(Lines lines, std::vector<Expression*>& dest) {
-    expect_char(lines, '(');
+std::string Parser::parse_string(Lines lines) {
+    expect_char(lines, '"');
+    std::string text;
+    const std::string& l = lines[line];
+    while (ix < l.size() && l[ix] != '"') {
+        char c = l[ix];
+        ++ix;
+        if (c == '\\') {
+            if (ix >= l.size()) {
+                break;
+            }
+            c = l[ix];
+            ++ix;
+            if (c == 'n') {
+                c = '\n';
+            } else if (c == 't') {
+                c = '\t';
+            } else if (c != '"' && c != '\\') {
+                throw ParseError(line, "Invalid escape");
+            }
+        }
+        text.push_back(c);
+    }
+    if (ix >= l.size()) {
+        throw ParseError(line, "Missing closing '\"'");
+    }
+    ++ix;
+    return text;
+}
+
+Expression* Parser::parse_subscript(Lines lines) {
+    expect_char(lines, '[');
+    Expression* index = parse_expression(lines);
+    skip_spaces(ix, lines[line]);
+    if (ix < lines[line].size() && lines[line][ix] == ':') {
+        throw ParseError(line, "Can not assign to a slice");
+    }
+    expect_char(lines, ']');
+    return index;
+}
+
+Expression* Parser::parse_index(Lines lines, Expression* target) {
+    int32_t lineno = line;
+    expect_char(lines, '[');
+    skip_spaces(ix, lines[line]);
+    Expression* start = nullptr;
+    if (ix >= lines[line].size() || lines[line][ix] != ':') {
+        start = parse_expression(lines);
+        skip_spaces(ix, lines[line]);
+    }
+    Expression* res;
+    if (ix < lines[line].size() && lines[line][ix] == ':') {
+        ++ix;
+        skip_spaces(ix, lines[line]);
+        Expression* end = nullptr;
+        if (ix >= lines[line].size() || lines[line][ix] != ']') {
+            end = parse_expression(lines);
+        }
+        res = new SliceExpr(lineno, target, start, end);
+    } else {
+        res = new IndexExpr(lineno, target, start);
+    }
+    all_expressions.emplace_back(res);
+    expect_char(lines, ']');
+    return res;
+}
+
+void Parser::parse_expression_list(Lines lines, std::vector<Expression*>& dest,
+                                   char open, char close) {
+    expect_char(lines, open);
     while (ix >= lines[line].size()) {
         ix = 0;
         do {
             ++line;
             if (line >= lines.size()) {
-                throw ParseError(line - 1, "Missing closing ')'");
+                throw ParseError(line - 1, std::string("Missing closing '") +
+                                               close + "'");
             }
         } while (is_empty(lines[line]));
         skip_spaces(ix, lines[line]);
     }
-    if (lines[line][ix] == ')') {
+    if (lines[line][ix] == close) {
         ++ix;
         return;
     }
@@ -439,13 +552,14 @@ void Parser::parse_expression_list(Lines lines, std::vector<Expression*>& dest)
             do {
                 ++line;
                 if (line >= lines.size()) {
-                    throw ParseError(line - 1, "Missing closing ')'");
+                    throw ParseError(line - 1, std::string("Missing closing '") +
+                                                   close + "'");
                 }
             } while (is_empty(lines[line]));
             skip_spaces(ix, lines[line]);
             continue;
         }
-        if (lines[line][ix] == ')') {
+        if (lines[line][ix] == close) {
             ++ix;
             return;
         }
@@ -24,7 +24,17 @@ class Parser {
 
     void expect_eol(Lines lines);
 
-    void parse_expression_list(Lines lines, std::vector<Expression*>& dest);
+    void parse_expression_list(Lines lines, std::vector<Expression*>& dest,
+                               char open = '(', char close = ')');
+
+    // Parses [index] or [start:end] after target
+    Expression* parse_index(Lines lines, Expression* target);
+
+    // Parses [index] on the left of an assignment
+    Expression* parse_subscript(Lines lines);
+
+    // Parses a string literal, returning its text with escapes replaced
+    std::string parse_string(Lines lines);
 
     void parse_name_list(Lines lines, std::vector<std::string>& dest);
 
@@ -1,21 +1,111 @@
 #include "player.h"
 #include "maze.h"
+#include "config.h"
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <cmath>
 
+// Stats without equipment
+constexpr CombatStats PLAYER_STATS{0, 1, 1, DIST_TYPES::MANHATTAN,
+                                   DIST_TYPES::MANHATTAN, 0, 0};
 
-Player::Player(int32_t x, int32_t y, Texture *tex) : pos(x, y), direction(vec2i_from_dir(DIR_LEFT)), texture(tex) {}
+Player::Player(World &world, int32_t x, int32_t y, const Sprite *sprite)
+    : world(&world),
+      entity(world.spawn(EntityKind::PLAYER, vec2i{x, y},
+                         Health{PLAYER_HP, PLAYER_HP},
+                         PLAYER_STATS, FACTIONS::ROBOTS)),
+      prev_pos(x, y), tick_pos(x, y), direction(vec2i_from_dir(DIR_LEFT)),
+      sprite(sprite) {}
 
-void Player::tick(Maze const &map, std::vector<std::unique_ptr<Enemy>> &enemies,
-                  vec2i move_vector, vec2i damage_vector) {
-    pos += move_vector;
+vec2i Player::pos() const {
+    return world->positions[world->index_of(entity)];
+}
+
+entity_t Player::get_entity() const { return entity; }
+
+void Player::tick(Maze const &map, Combat &combat, vec2i move_vector,
+                  vec2i damage_vector) {
+    vec2i p = pos();
+    p += move_vector;
+    world->move_entity(entity, p);
+    prev_pos = tick_pos;
+    tick_pos = pos();
+    if (damage_vector.x != 0 || damage_vector.y != 0) {
+        vec2i target = tick_pos;
+        target += damage_vector;
+        entity_t other = world->entity_at(target);
+        if (other != NULL_ENTITY) {
+            combat.queue_attack(entity, other);
+        }
+    }
+}
+
+std::shared_ptr<Equipment> &Player::equipped(EQUIPMENT_SLOTS slot) {
+    switch (slot) {
+    case WEAPON:
+        return weapon;
+    case HEAD:
+        return head;
+    case BODY:
+        return body;
+    case BOOTS:
+    default:
+        return feet;
+    }
+}
+
+bool Player::add_equipment(std::shared_ptr<Equipment> new_equipment) {
+    std::shared_ptr<Equipment> &item = equipped(new_equipment->slot);
+    if (item != nullptr) {
+        return false;
+    }
+    item = std::move(new_equipment);
+    update_stats();
+    return true;
+}
+
+bool Player::remove_equipment(EQUIPMENT_SLOTS slot) {
+    std::shared_ptr<Equipment> &item = equipped(slot);
+    if (item == nullptr) {
+        return false;
+    }
+    item.reset();
+    update_stats();
+    return true;
+}
+
+void Player::update_stats() {
+    CombatStats stats = PLAYER_STATS;
+    int32_t max_hp = PLAYER_HP;
+    if (auto *melee = dynamic_cast<const WeaponMelee *>(weapon.get())) {
+        stats.damage = melee->damage;
+        stats.attack_effects = attack_effects(melee->special);
+    } else if (auto *ranged =
+                   dynamic_cast<const WeaponRanged *>(weapon.get())) {
+        stats.damage = ranged->damage;
+        stats.range = ranged->range;
+        stats.attack_effects = attack_effects(ranged->special);
+    }
+    for (const Equipment *item : {head.get(), body.get(), feet.get()}) {
+        if (auto *armour = dynamic_cast<const Armour *>(item)) {
+            stats.armour += armour->armour;
+            stats.defence_effects |= defence_effects(armour->special);
+            max_hp += armour->hp;
+        }
+    }
+    std::size_t ix = world->index_of(entity);
+    world->combat[ix] = stats;
+    Health &health = world->health[ix];
+    health.max_hp = max_hp;
+    health.hp = std::min(health.hp, max_hp);
 }
 
 void Player::forward(Maze& map) {
     if (read_forward(map)) {
-        pos.x += direction.x;
-        pos.y += direction.y;
+        vec2i p = pos();
+        p += direction;
+        world->move_entity(entity, p);
     }
 }
 
@@ -44,13 +134,16 @@ void Player::rotate_right() {
 }
 
 bool Player::read_forward(Maze& map) {
-    return map.is_open(pos.x + direction.x, pos.y + direction.y);
+    vec2i p = pos();
+    p += direction;
+    return map.is_open(p.x, p.y) && !world->is_occupied(p);
 }
 void Player::move(Maze& map, int32_t dx, int32_t dy) {
     assert(std::abs(dx) <= 1 && std::abs(dy) <= 1);
-    if (map.is_open(pos.x + dx, pos.y + dy)) {
-        pos.x += dx;
-        pos.y += dy;
+    vec2i p = pos();
+    p += vec2i{dx, dy};
+    if (map.is_open(p.x, p.y) && !world->is_occupied(p)) {
+        world->move_entity(entity, p);
     }
 }
 
@@ -58,9 +151,10 @@ void Player::move(Maze& map, int32_t dx, int32_t dy) {
 #define M_PI_2 1.57079632679489661923
 #endif
 
-void Player::render(float offset_x, float offset_y) {
-    texture->render(offset_x + pos.x * TILE_SIZE + TILE_SIZE / 2, offset_y + pos.y * TILE_SIZE + TILE_SIZE / 2,
-                             direction.angle() + M_PI_2, SDL_FLIP_NONE
-                             );
-    //texture->render_corner(offset_x + pos.x * TILE_SIZE, offset_y + pos.y * TILE_SIZE);
+void Player::render(SpriteBatch& batch, float offset_x, float offset_y, float alpha) {
+    float x = prev_pos.x + (tick_pos.x - prev_pos.x) * alpha;
+    float y = prev_pos.y + (tick_pos.y - prev_pos.y) * alpha;
+    SDL_FRect dest = {offset_x + x * TILE_SIZE, offset_y + y * TILE_SIZE,
+                      TILE_SIZE, TILE_SIZE};
+    batch.draw(*sprite, dest, direction.angle() + M_PI_2, {0xff, 0xff, 0xff, 0xff}, 2);
 }
@@ -4,20 +4,37 @@
 #include "maze.h"
 #include <vector>
 #include <memory>
-#include "enemy.h"
-#include "engine/texture.h"
+#include "entities.h"
+#include "combat.h"
+#include "engine/atlas.h"
 
 
 
 class Player {
 public:
-    Player(int32_t x, int32_t y, Texture* tex);
+    /**
+     * Creates a player, spawning its entity in world.
+     */
+    Player(World& world, int32_t x, int32_t y, const Sprite* sprite);
     ~Player() = default;
 
-    void tick(Maze const& map, std::vector<std::unique_ptr<Enemy>>& enemies, vec2i move_vector, vec2i damage_vector);
+    /**
+     * Moves the player by move_vector, and queues an attack on the entity
+     * at damage_vector from the player, if any.
+     */
+    void tick(Maze const& map, Combat& combat, vec2i move_vector,
+              vec2i damage_vector);
 
-    void render(float offset_x, float offset_y);
+    /**
+     * Renders the player, interpolating alpha of the way from the position
+     * before the last tick to the current one.
+     */
+    void render(SpriteBatch& batch, float offset_x, float offset_y, float alpha);
 
+    /**
+     * Returns true if the tile in front of the player is open and not
+     * occupied by an entity.
+     */
     bool read_forward(Maze& map);
 
     void forward(Maze& map);
@@ -28,15 +45,34 @@ public:
 
     void move(Maze& map, int32_t dx, int32_t dy);
 
+    /**
+     * Equips new_equipment in its slot, returning false if the slot is
+     * taken. The combat stats of the player are rebuilt from the equipment.
+     */
     bool add_equipment(std::shared_ptr<Equipment> new_equipment);
 
+    /**
+     * Unequips the item in slot, returning false if it is empty.
+     */
     bool remove_equipment(EQUIPMENT_SLOTS slot);
 
+    [[nodiscard]] entity_t get_entity() const;
+
 private:
-    vec2i pos;
+    // Position and health are stored in world
+    vec2i pos() const;
+
+    std::shared_ptr<Equipment>& equipped(EQUIPMENT_SLOTS slot);
+
+    // Sets the combat stats and max hp from the base stats and equipment
+    void update_stats();
+
+    World* world;
+    entity_t entity;
+    // Position at the end of the last two ticks, for interpolation
+    vec2i prev_pos, tick_pos;
     vec2i direction;
-    int32_t max_hp, hp;
-    Texture* texture;
+    const Sprite* sprite;
 
     std::shared_ptr<Equipment> weapon, head, body, feet;
 };
\ No newline at end of file
@@ -98,7 +98,7 @@ class RefCounted {
     typename RefCountSet<T>::Node* node;
 
     void free() {
-        if (node->value.ref_count > 0) {
+        if (node != nullptr && node->value.ref_count > 0) {
             node->value.ref_count -= 1;
             if (node->value.ref_count == 0) {
                 node->unlink();
@@ -111,12 +111,19 @@ public:
         node = list.insert(RefCountNode<T>{std::unique_ptr<T>{ptr}, 1});
     }
 
+    // Refers to ptr without counting, ptr must outlive every copy
+    explicit RefCounted(T* ptr) : ptr{ptr}, node{nullptr} {}
+
     RefCounted(const RefCounted& other): ptr{other.ptr}, node{other.node} {
-        node->value.ref_count += 1;
+        if (node != nullptr) {
+            node->value.ref_count += 1;
+        }
     }
 
     RefCounted(RefCounted&& other): ptr{other.ptr}, node{other.node} {
-        node->value.ref_count += 1;
+        if (node != nullptr) {
+            node->value.ref_count += 1;
+        }
     }
 
     RefCounted& operator=(const RefCounted& other) {
@@ -124,7 +131,9 @@ public:
             free();
             node = other.node;
             ptr = other.ptr;
-            node->value.ref_count += 1;
+            if (node != nullptr) {
+                node->value.ref_count += 1;
+            }
         }
         return *this;
     }
@@ -155,5 +164,8 @@ public:
     const T* get() const {
         return ptr;
     }
+    bool counted() const {
+        return node != nullptr;
+    }
 };
 
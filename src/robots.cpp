@@ -0,0 +1,251 @@
+#include "robots.h"
+#include "config.h"
+#include "engine/random.h"
+
+
+entity_t Robots::spawn(World &world, vec2i pos,
+                       std::shared_ptr<const Code> code) {
+    entity_t entity = world.spawn(EntityKind::ROBOT, pos,
+                                  Health{PLAYER_HP, PLAYER_HP},
+                                  CombatStats{0, 1, 1, DIST_TYPES::MANHATTAN,
+                                              DIST_TYPES::MANHATTAN, 0, 0},
+                                  FACTIONS::ROBOTS);
+    uint32_t id = next_id++;
+    auto program = std::make_unique<Program>();
+    program->begin(std::move(code),
+                   engine::make_stream(RNG_STREAM_ROBOTS + id));
+    entities.push_back(entity);
+    ids.push_back(id);
+    directions.push_back(vec2i_from_dir(DIR_LEFT));
+    wait_times.push_back(0);
+    results.push_back(Program::RunStatus::YIELD);
+    programs.push_back(std::move(program));
+    return entity;
+}
+
+void Robots::remove(std::size_t ix) {
+    std::size_t last = entities.size() - 1;
+    entities[ix] = entities[last];
+    ids[ix] = ids[last];
+    directions[ix] = directions[last];
+    wait_times[ix] = wait_times[last];
+    results[ix] = results[last];
+    std::swap(programs[ix], programs[last]);
+    entities.pop_back();
+    ids.pop_back();
+    directions.pop_back();
+    wait_times.pop_back();
+    results.pop_back();
+    programs.pop_back();
+}
+
+void Robots::clear(World &world) {
+    for (entity_t entity : entities) {
+        world.despawn(entity);
+    }
+    entities.clear();
+    ids.clear();
+    directions.clear();
+    wait_times.clear();
+    results.clear();
+    programs.clear();
+    first = 0;
+}
+
+std::size_t Robots::size() const { return entities.size(); }
+
+Robots::Snapshot Robots::snapshot() const {
+    Snapshot snapshot{entities, ids, directions, wait_times, results,
+                      {},       next_id, first};
+    snapshot.programs.reserve(programs.size());
+    for (const std::unique_ptr<Program> &program : programs) {
+        snapshot.programs.push_back(program->snapshot());
+    }
+    return snapshot;
+}
+
+void Robots::restore(const Snapshot &snapshot) {
+    entities = snapshot.entities;
+    ids = snapshot.ids;
+    directions = snapshot.directions;
+    wait_times = snapshot.wait_times;
+    results = snapshot.results;
+    programs.clear();
+    programs.reserve(snapshot.programs.size());
+    for (const ProgramSnapshot &program : snapshot.programs) {
+        programs.push_back(std::make_unique<Program>());
+        programs.back()->restore(program);
+    }
+    next_id = snapshot.next_id;
+    first = snapshot.first;
+    output.clear();
+}
+
+const std::vector<std::string> &Robots::get_output() const { return output; }
+
+void Robots::run(std::size_t begin, std::size_t end) {
+    for (std::size_t i = begin; i < end; ++i) {
+        if (results[i] == Program::RunStatus::ERROR) {
+            continue;
+        }
+        if (wait_times[i] > 0) {
+            --wait_times[i];
+            results[i] = Program::RunStatus::YIELD;
+            continue;
+        }
+        uint32_t budget = ROBOT_STEP_BUDGET;
+        results[i] = programs[i]->run_slice(budget);
+    }
+}
+
+void Robots::commit(World &world, const Maze &maze) {
+    std::size_t count = entities.size();
+    for (std::size_t k = 0; k < count; ++k) {
+        std::size_t i = (first + k) % count;
+        Program &program = *programs[i];
+        if (results[i] == Program::RunStatus::ERROR) {
+            // Reported once, the robot stays idle afterwards
+            if (!program.error_buffer.empty()) {
+                output.push_back("Robot " + std::to_string(ids[i]) + ": " +
+                                 program.error_buffer);
+                program.error_buffer.clear();
+            }
+            continue;
+        }
+        if (results[i] != Program::RunStatus::ACTION) {
+            continue;
+        }
+        const ProgramAction &action = program.get_action();
+        vec2i pos = world.positions[world.index_of(entities[i])];
+        vec2i &dir = directions[i];
+        // Robots committed earlier this tick may already stand on the
+        // target tile. The robot then stays where it is, but still waits
+        // out the action.
+        auto move_to = [&](vec2i next) {
+            if (maze.is_open(next.x, next.y) && !world.is_occupied(next)) {
+                world.move_entity(entities[i], next);
+            }
+            wait_times[i] = ROBOT_ACTION_DELAY;
+        };
+        switch (action.type) {
+        case ProgramAction::NONE:
+            break;
+        case ProgramAction::PRINT:
+            output.push_back("Robot " + std::to_string(ids[i]) + ": " +
+                             (program.print_buffer.empty()
+                                  ? std::string{"\n"}
+                                  : program.print_buffer));
+            break;
+        case ProgramAction::MOVE:
+            move_to(vec2i{pos.x + action.dx, pos.y + action.dy});
+            break;
+        case ProgramAction::FORWARDS:
+            move_to(vec2i{pos.x + dir.x, pos.y + dir.y});
+            break;
+        case ProgramAction::ROTL:
+            dir = vec2i{dir.y, -dir.x};
+            wait_times[i] = ROBOT_ACTION_DELAY;
+            break;
+        case ProgramAction::ROTR:
+            dir = vec2i{-dir.y, dir.x};
+            wait_times[i] = ROBOT_ACTION_DELAY;
+            break;
+        case ProgramAction::READ_FRONT: {
+            vec2i next{pos.x + dir.x, pos.y + dir.y};
+            program.set_read_result(maze.is_open(next.x, next.y) &&
+                                    !world.is_occupied(next));
+            break;
+        }
+        }
+    }
+    first = count == 0 ? 0 : (first + 1) % count;
+}
+
+void Robots::tick(World &world, const Maze &maze, JobSystem &jobs) {
+    output.clear();
+    // Robots destroyed since the last tick
+    for (std::size_t i = entities.size(); i-- > 0;) {
+        if (!world.alive(entities[i])) {
+            remove(i);
+        }
+    }
+    jobs.parallel_for(entities.size(), ROBOT_JOB_SIZE,
+                      [this](std::size_t begin, std::size_t end) {
+                          run(begin, end);
+                      });
+    commit(world, maze);
+}
+
+#ifdef ROBOTS_BENCH
+#include "parser.h"
+#include "engine/engine.h"
+#include <chrono>
+#include <iostream>
+
+// Wanders the maze, with some work between actions
+static const std::vector<std::string> BENCH_PROGRAM = {
+    "i = 0",
+    "while True:",
+    "    i = i + 1",
+    "    s = 0",
+    "    for x in tuple(1, 2, 3, 4, 5, 6, 7, 8):",
+    "        s = s + x * i",
+    "    if read_front():",
+    "        forward()",
+    "    else:",
+    "        rotate_right()",
+};
+
+// Runs ticks robot ticks on count robots, returning a hash of the end
+// state.
+static uint64_t run(unsigned workers, int count, int ticks, bool report) {
+    engine::seed_world(1);
+    Parser parser{};
+    if (!parser.parse_lines(BENCH_PROGRAM)) {
+        std::cout << "Benchmark program does not parse" << std::endl;
+        return 0;
+    }
+    Program compiler;
+    compiler.load_program(std::move(parser.all_statements),
+                          std::move(parser.all_expressions),
+                          std::move(parser.all_functions), parser.entry);
+    parser.entry = nullptr;
+
+    Maze maze;
+    World world;
+    world.reserve(count);
+    Robots robots;
+    // The maze only has room for a few hundred, so robots share tiles
+    while (robots.size() < count) {
+        vec2i pos{engine::random(0, MAZE_WIDTH),
+                  engine::random(0, MAZE_HEIGHT)};
+        if (maze.is_open(pos.x, pos.y)) {
+            robots.spawn(world, pos, compiler.get_code());
+        }
+    }
+    JobSystem jobs{workers};
+    auto start = std::chrono::steady_clock::now();
+    for (int tick = 0; tick < ticks; ++tick) {
+        robots.tick(world, maze, jobs);
+    }
+    auto end = std::chrono::steady_clock::now();
+    if (report) {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                      end - start)
+                      .count();
+        std::cout << robots.size() << " robots, " << jobs.thread_count()
+                  << " threads: " << us / ticks << " us per tick, "
+                  << us * 1000 / (static_cast<long long>(ticks) *
+                                  static_cast<long long>(robots.size()))
+                  << " ns per robot step" << std::endl;
+    }
+    return world.hash();
+}
+
+int main() {
+    bool ok = JobSystem::same_on_any_threads(
+        [](unsigned workers) { return run(workers, 1000, 600, true); });
+    std::cout << (ok ? "ok" : "Result depends on thread count") << std::endl;
+    return ok ? 0 : 1;
+}
+#endif
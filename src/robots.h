@@ -0,0 +1,98 @@
+#pragma once
+#include "entities.h"
+#include "language.h"
+#include "maze.h"
+#include "engine/jobs.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+
+
+/**
+ * Robots in the maze other than the player, each running its own instance
+ * of a program. Programs run as green threads, without a thread of their
+ * own. Every tick, each robot not waiting on an action runs its program,
+ * in parallel, until it requests an action or has run ROBOT_STEP_BUDGET
+ * instructions, so a busy program can not hold up the others. The actions
+ * are then applied serially against the maze and the entities in it. The
+ * robot applied first moves on by one every tick, so no robot always wins
+ * a contested tile. A running program only touches its own robot, so which
+ * thread runs it never changes what it does.
+ */
+class Robots {
+public:
+    /**
+     * Copy of the robots and the states of their programs, see snapshot.
+     */
+    struct Snapshot {
+        std::vector<entity_t> entities;
+        std::vector<uint32_t> ids;
+        std::vector<vec2i> directions;
+        std::vector<int32_t> wait_times;
+        std::vector<Program::RunStatus> results;
+        std::vector<ProgramSnapshot> programs;
+        uint32_t next_id = 0;
+        std::size_t first = 0;
+    };
+
+    /**
+     * Spawns a robot at pos running code from the start. Returns its
+     * entity.
+     */
+    entity_t spawn(World &world, vec2i pos, std::shared_ptr<const Code> code);
+
+    void tick(World &world, const Maze &maze, JobSystem &jobs);
+
+    /**
+     * Despawns all robots.
+     */
+    void clear(World &world);
+
+    [[nodiscard]] std::size_t size() const;
+
+    /**
+     * Copies the robots, for restoring together with a copy of the world
+     * made at the same time.
+     */
+    [[nodiscard]] Snapshot snapshot() const;
+
+    /**
+     * Replaces the robots with those of snapshot. Their entities must be
+     * restored in the world as well.
+     */
+    void restore(const Snapshot &snapshot);
+
+    /**
+     * Returns the lines printed by robots during the last tick, in order.
+     */
+    [[nodiscard]] const std::vector<std::string> &get_output() const;
+
+private:
+    /**
+     * Runs the programs of robots [begin, end). Only touches the programs
+     * and run results of those robots.
+     */
+    void run(std::size_t begin, std::size_t end);
+
+    void commit(World &world, const Maze &maze);
+
+    /**
+     * Removes robot ix, moving the last one into its place.
+     */
+    void remove(std::size_t ix);
+
+    std::vector<entity_t> entities;
+    // Number of each robot, used in its output and for its rand stream
+    std::vector<uint32_t> ids;
+    std::vector<vec2i> directions;
+    // Ticks left before the program of a robot runs again
+    std::vector<int32_t> wait_times;
+    std::vector<Program::RunStatus> results;
+    std::vector<std::unique_ptr<Program>> programs;
+
+    std::vector<std::string> output;
+    uint32_t next_id = 0;
+    // Robot applied first in the next commit
+    std::size_t first = 0;
+};
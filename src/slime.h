@@ -1,18 +1,10 @@
+#pragma once
 #include "utils.h"
-#include <string>
-#include "enemy.h"
+#include "entities.h"
 
 
 
-class Slime : public Enemy {
-public:
-    Slime(int32_t x, int32_t y, int32_t level);
-    ~Slime();
-
-    void tick();
-
-    void render(float offset_x, float offset_y);
-
-private:
-    int32_t size, stun_time, wait_time;
-};
\ No newline at end of file
+/**
+ * Spawns a slime of the given level at (x, y).
+ */
+entity_t spawn_slime(World& world, int32_t x, int32_t y, int32_t level);
@@ -0,0 +1,110 @@
+#include "spatial.h"
+#include <algorithm>
+#include <cassert>
+
+
+SpatialIndex::SpatialIndex(int32_t width, int32_t height)
+    : width(width), height(height),
+      cells_x((width + SPATIAL_CELL_SIZE - 1) / SPATIAL_CELL_SIZE),
+      cells_y((height + SPATIAL_CELL_SIZE - 1) / SPATIAL_CELL_SIZE),
+      occupancy(static_cast<std::size_t>(width) * height, 0),
+      cells(static_cast<std::size_t>(cells_x) * cells_y) {}
+
+bool SpatialIndex::in_bounds(vec2i pos) const {
+    return pos.x >= 0 && pos.x < width && pos.y >= 0 && pos.y < height;
+}
+
+int32_t SpatialIndex::cell_x(int32_t x) const {
+    return std::clamp(x, 0, width - 1) / SPATIAL_CELL_SIZE;
+}
+
+int32_t SpatialIndex::cell_y(int32_t y) const {
+    return std::clamp(y, 0, height - 1) / SPATIAL_CELL_SIZE;
+}
+
+std::size_t SpatialIndex::cell_of(vec2i pos) const {
+    return static_cast<std::size_t>(cell_y(pos.y)) * cells_x + cell_x(pos.x);
+}
+
+void SpatialIndex::insert(slot_handle_t entity, vec2i pos) {
+    cells[cell_of(pos)].push_back({entity, pos});
+    if (in_bounds(pos)) {
+        ++occupancy[static_cast<std::size_t>(pos.y) * width + pos.x];
+    }
+}
+
+void SpatialIndex::remove(slot_handle_t entity, vec2i pos) {
+    std::vector<Entry> &cell = cells[cell_of(pos)];
+    auto it = std::find_if(cell.begin(), cell.end(), [entity](const Entry &e) {
+        return e.entity == entity;
+    });
+    assert(it != cell.end());
+    *it = cell.back();
+    cell.pop_back();
+    if (in_bounds(pos)) {
+        --occupancy[static_cast<std::size_t>(pos.y) * width + pos.x];
+    }
+}
+
+void SpatialIndex::move(slot_handle_t entity, vec2i from, vec2i to) {
+    if (cell_of(from) == cell_of(to)) {
+        for (Entry &e : cells[cell_of(from)]) {
+            if (e.entity == entity) {
+                e.pos = to;
+                break;
+            }
+        }
+        if (in_bounds(from)) {
+            --occupancy[static_cast<std::size_t>(from.y) * width + from.x];
+        }
+        if (in_bounds(to)) {
+            ++occupancy[static_cast<std::size_t>(to.y) * width + to.x];
+        }
+    } else {
+        remove(entity, from);
+        insert(entity, to);
+    }
+}
+
+void SpatialIndex::clear() {
+    std::fill(occupancy.begin(), occupancy.end(), 0);
+    for (auto &cell : cells) {
+        cell.clear();
+    }
+}
+
+bool SpatialIndex::is_occupied(vec2i pos) const {
+    return in_bounds(pos) &&
+           occupancy[static_cast<std::size_t>(pos.y) * width + pos.x] > 0;
+}
+
+slot_handle_t SpatialIndex::entity_at(vec2i pos) const {
+    if (!is_occupied(pos)) {
+        return NULL_SLOT;
+    }
+    for (const Entry &e : cells[cell_of(pos)]) {
+        if (e.pos.x == pos.x && e.pos.y == pos.y) {
+            return e.entity;
+        }
+    }
+    return NULL_SLOT;
+}
+
+void SpatialIndex::query_range(vec2i center, int32_t range, DIST_TYPES type,
+                               std::vector<slot_handle_t> &out) const {
+    if (range < 0) {
+        return;
+    }
+    int32_t min_x = cell_x(center.x - range), max_x = cell_x(center.x + range);
+    int32_t min_y = cell_y(center.y - range), max_y = cell_y(center.y + range);
+    for (int32_t cy = min_y; cy <= max_y; ++cy) {
+        for (int32_t cx = min_x; cx <= max_x; ++cx) {
+            for (const Entry &e :
+                 cells[static_cast<std::size_t>(cy) * cells_x + cx]) {
+                if (within_range(center, e.pos, range, type)) {
+                    out.push_back(e.entity);
+                }
+            }
+        }
+    }
+}
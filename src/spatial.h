@@ -0,0 +1,63 @@
+#pragma once
+#include "utils.h"
+#include "engine/slotmap.h"
+#include <vector>
+
+
+
+// Width and height in tiles of the cells of a SpatialIndex
+constexpr int32_t SPATIAL_CELL_SIZE = 4;
+
+/**
+ * Index of the positions of entities on a grid of tiles. Keeps the number
+ * of entities on every tile, and a uniform hash of cells of
+ * SPATIAL_CELL_SIZE tiles listing the entities in them. Entities outside
+ * the grid are kept in the closest cell, but never occupy any tile.
+ */
+class SpatialIndex {
+public:
+    SpatialIndex(int32_t width, int32_t height);
+
+    void insert(slot_handle_t entity, vec2i pos);
+
+    void remove(slot_handle_t entity, vec2i pos);
+
+    void move(slot_handle_t entity, vec2i from, vec2i to);
+
+    void clear();
+
+    /**
+     * Returns true if any entity is on the tile at pos.
+     */
+    [[nodiscard]] bool is_occupied(vec2i pos) const;
+
+    /**
+     * Returns an entity on the tile at pos, or NULL_SLOT if there is none.
+     */
+    [[nodiscard]] slot_handle_t entity_at(vec2i pos) const;
+
+    /**
+     * Appends all entities within range of center, measured as type, to out.
+     */
+    void query_range(vec2i center, int32_t range, DIST_TYPES type,
+                     std::vector<slot_handle_t> &out) const;
+
+private:
+    struct Entry {
+        slot_handle_t entity;
+        vec2i pos;
+    };
+
+    [[nodiscard]] bool in_bounds(vec2i pos) const;
+
+    [[nodiscard]] int32_t cell_x(int32_t x) const;
+
+    [[nodiscard]] int32_t cell_y(int32_t y) const;
+
+    [[nodiscard]] std::size_t cell_of(vec2i pos) const;
+
+    int32_t width, height;
+    int32_t cells_x, cells_y;
+    std::vector<uint16_t> occupancy;
+    std::vector<std::vector<Entry>> cells;
+};
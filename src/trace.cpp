@@ -0,0 +1,403 @@
+#include "trace.h"
+#include "parser.h"
+#include "engine/engine.h"
+#include "engine/log.h"
+#include <chrono>
+#include <cstring>
+
+
+// "RLTR", followed by the version
+constexpr uint8_t TRACE_MAGIC[] = {'R', 'L', 'T', 'R'};
+constexpr uint8_t TRACE_VERSION = 1;
+
+// Low bits of an action byte, the rest is the argument
+constexpr uint8_t OP_BITS = 3;
+constexpr uint8_t OP_MASK = (1 << OP_BITS) - 1;
+
+// Replays fail when the program runs this many instructions without an
+// action
+constexpr uint32_t REPLAY_STEP_LIMIT = 50000000;
+
+static void write_varint(std::vector<uint8_t> &out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static void write_u64(std::vector<uint8_t> &out, uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+static void write_string(std::vector<uint8_t> &out, std::string_view s) {
+    write_varint(out, s.size());
+    out.insert(out.end(), s.begin(), s.end());
+}
+
+namespace {
+/**
+ * Bounds checked reading of a trace, sets failed on reading past the end.
+ */
+struct Reader {
+    const uint8_t *data;
+    std::size_t size, pos;
+    bool failed;
+
+    uint8_t byte() {
+        if (pos >= size) {
+            failed = true;
+            return 0;
+        }
+        return data[pos++];
+    }
+
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64 && !failed; shift += 7) {
+            uint8_t b = byte();
+            value |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if (!(b & 0x80)) {
+                return value;
+            }
+        }
+        failed = true;
+        return 0;
+    }
+
+    uint64_t u64() {
+        uint64_t value = 0;
+        for (int i = 0; i < 8; ++i) {
+            value |= static_cast<uint64_t>(byte()) << (8 * i);
+        }
+        return value;
+    }
+
+    std::string_view string() {
+        uint64_t len = varint();
+        if (failed || len > size - pos) {
+            failed = true;
+            return {};
+        }
+        std::string_view s{reinterpret_cast<const char *>(data + pos),
+                           static_cast<std::size_t>(len)};
+        pos += len;
+        return s;
+    }
+};
+} // namespace
+
+uint64_t hash_source(const std::vector<std::string> &lines) {
+    // FNV-1a, with a newline after every line
+    uint64_t hash = 1469598103934665603ull;
+    for (const std::string &line : lines) {
+        for (char c : line) {
+            hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+        }
+        hash = (hash ^ '\n') * 1099511628211ull;
+    }
+    return hash;
+}
+
+void Trace::begin(uint64_t world_seed, const std::vector<std::string> &source) {
+    this->world_seed = world_seed;
+    this->source = source;
+    actions.clear();
+    count = 0;
+}
+
+void Trace::add_op(Op op, uint8_t arg) {
+    actions.push_back(static_cast<uint8_t>(op | (arg << OP_BITS)));
+    ++count;
+}
+
+void Trace::print(std::string_view text) {
+    add_op(PRINT, 0);
+    write_string(actions, text);
+}
+
+void Trace::move(int32_t dx, int32_t dy) {
+    add_op(MOVE, static_cast<uint8_t>((dx + 1) * 3 + (dy + 1)));
+}
+
+void Trace::rotate_left() { add_op(ROTATE_LEFT, 0); }
+
+void Trace::rotate_right() { add_op(ROTATE_RIGHT, 0); }
+
+void Trace::forwards() { add_op(FORWARDS, 0); }
+
+void Trace::read_tile(bool is_open) { add_op(READ_TILE, is_open); }
+
+Trace::Mark Trace::mark() const { return {actions.size(), count}; }
+
+void Trace::truncate(Mark mark) {
+    if (mark.bytes < actions.size()) {
+        actions.resize(mark.bytes);
+        count = mark.count;
+    }
+}
+
+bool Trace::empty() const { return count == 0; }
+
+std::size_t Trace::size() const { return count; }
+
+uint64_t Trace::get_world_seed() const { return world_seed; }
+
+const std::vector<std::string> &Trace::get_source() const { return source; }
+
+bool Trace::read(std::size_t &pos, Entry &entry) const {
+    if (pos >= actions.size()) {
+        return false;
+    }
+    uint8_t b = actions[pos++];
+    entry = {static_cast<Op>(b & OP_MASK), 0, 0, false, {}};
+    uint8_t arg = b >> OP_BITS;
+    switch (entry.op) {
+    case MOVE:
+        entry.dx = arg / 3 - 1;
+        entry.dy = arg % 3 - 1;
+        break;
+    case READ_TILE:
+        entry.is_open = arg != 0;
+        break;
+    case PRINT: {
+        // Validated by load
+        Reader r{actions.data(), actions.size(), pos, false};
+        entry.text = r.string();
+        pos = r.pos;
+        break;
+    }
+    default:
+        break;
+    }
+    return true;
+}
+
+bool Trace::save(const char *path) const {
+    std::vector<uint8_t> out{std::begin(TRACE_MAGIC), std::end(TRACE_MAGIC)};
+    out.push_back(TRACE_VERSION);
+    write_u64(out, world_seed);
+    write_u64(out, hash_source(source));
+    write_varint(out, source.size());
+    for (const std::string &line : source) {
+        write_string(out, line);
+    }
+    write_varint(out, count);
+    write_varint(out, actions.size());
+    out.insert(out.end(), actions.begin(), actions.end());
+
+    SDL_IOStream *file = SDL_IOFromFile(path, "wb");
+    if (file == nullptr) {
+        LOG_WARNING("Failed to open %s: %s", path, SDL_GetError());
+        return false;
+    }
+    bool ok = SDL_WriteIO(file, out.data(), out.size()) == out.size();
+    SDL_CloseIO(file);
+    return ok;
+}
+
+bool Trace::load(const char *path) {
+    SDL_IOStream *file = SDL_IOFromFile(path, "rb");
+    if (file == nullptr) {
+        LOG_WARNING("Failed to open %s: %s", path, SDL_GetError());
+        return false;
+    }
+    Sint64 size = SDL_GetIOSize(file);
+    std::vector<uint8_t> data(size > 0 ? static_cast<std::size_t>(size) : 0);
+    bool ok = SDL_ReadIO(file, data.data(), data.size()) == data.size();
+    SDL_CloseIO(file);
+    if (!ok || data.size() < sizeof(TRACE_MAGIC) + 1 ||
+        std::memcmp(data.data(), TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+        data[sizeof(TRACE_MAGIC)] != TRACE_VERSION) {
+        LOG_WARNING("%s is not a trace", path);
+        return false;
+    }
+
+    Reader r{data.data(), data.size(), sizeof(TRACE_MAGIC) + 1, false};
+    uint64_t seed = r.u64();
+    uint64_t hash = r.u64();
+    uint64_t line_count = r.varint();
+    // Every line takes at least one byte
+    if (r.failed || line_count > r.size - r.pos) {
+        LOG_WARNING("%s is truncated", path);
+        return false;
+    }
+    std::vector<std::string> lines(static_cast<std::size_t>(line_count));
+    for (std::string &line : lines) {
+        line = r.string();
+    }
+    uint64_t action_count = r.varint();
+    uint64_t action_size = r.varint();
+    if (r.failed || action_size != r.size - r.pos) {
+        LOG_WARNING("%s is truncated", path);
+        return false;
+    }
+    if (hash_source(lines) != hash) {
+        LOG_WARNING("Source of %s does not match its hash", path);
+        return false;
+    }
+    // Check that every action is complete, so read never has to
+    for (uint64_t i = 0; i < action_count; ++i) {
+        uint8_t b = r.byte();
+        if ((b & OP_MASK) > READ_TILE) {
+            r.failed = true;
+        } else if ((b & OP_MASK) == PRINT) {
+            r.string();
+        }
+    }
+    if (r.failed || r.pos != r.size) {
+        LOG_WARNING("%s has invalid actions", path);
+        return false;
+    }
+
+    world_seed = seed;
+    source = std::move(lines);
+    actions.assign(data.end() - static_cast<std::ptrdiff_t>(action_size),
+                   data.end());
+    count = static_cast<std::size_t>(action_count);
+    return true;
+}
+
+namespace {
+/**
+ * State of a replay, answering the actions of the program from the trace.
+ */
+struct Replay {
+    const Trace *trace;
+    std::size_t pos = 0;
+    std::size_t index = 0;
+    bool done = false;
+    std::string error{};
+
+    /**
+     * Reads the next recorded action, failing the replay if the program
+     * did something else.
+     */
+    bool expect(Trace::Op op, Trace::Entry &entry) {
+        if (done) {
+            return false;
+        }
+        if (!trace->read(pos, entry) || entry.op != op) {
+            fail("Unexpected action");
+            return false;
+        }
+        ++index;
+        if (index == trace->size()) {
+            done = true;
+        }
+        return true;
+    }
+
+    void fail(const char *cause) {
+        error = cause;
+        error += " at action " + std::to_string(index + 1);
+        done = true;
+    }
+
+    void print(std::string_view text) {
+        Trace::Entry entry;
+        if (expect(Trace::PRINT, entry) && entry.text != text) {
+            fail("Different print");
+        }
+    }
+
+    void action(Program &program) {
+        const ProgramAction &action = program.get_action();
+        Trace::Entry entry;
+        switch (action.type) {
+        case ProgramAction::NONE:
+            break;
+        case ProgramAction::PRINT:
+            // The game prints a newline for print without arguments
+            print(program.print_buffer.empty() ? "\n"
+                                               : program.print_buffer);
+            break;
+        case ProgramAction::MOVE:
+            if (expect(Trace::MOVE, entry) &&
+                (entry.dx != action.dx || entry.dy != action.dy)) {
+                fail("Different move");
+            }
+            break;
+        case ProgramAction::ROTL:
+            expect(Trace::ROTATE_LEFT, entry);
+            break;
+        case ProgramAction::ROTR:
+            expect(Trace::ROTATE_RIGHT, entry);
+            break;
+        case ProgramAction::FORWARDS:
+            expect(Trace::FORWARDS, entry);
+            break;
+        case ProgramAction::READ_FRONT:
+            if (expect(Trace::READ_TILE, entry)) {
+                program.set_read_result(entry.is_open);
+            }
+            break;
+        }
+    }
+};
+} // namespace
+
+bool replay_trace(const Trace &trace, std::string &error) {
+    Parser parser{};
+    if (!parser.parse_lines(trace.get_source())) {
+        error = "Program of trace does not parse";
+        return false;
+    }
+    if (trace.empty()) {
+        return true;
+    }
+
+    // The rand builtin is seeded from the world seed when started
+    engine::seed_world(trace.get_world_seed());
+    Program program;
+    program.load_program(std::move(parser.all_statements),
+                         std::move(parser.all_expressions),
+                         std::move(parser.all_functions), parser.entry);
+    parser.entry = nullptr;
+    program.start();
+
+    Replay replay{&trace};
+    uint32_t budget = REPLAY_STEP_LIMIT;
+    while (!replay.done) {
+        Program::RunStatus status = program.run_slice(budget);
+        if (status == Program::RunStatus::ACTION) {
+            replay.action(program);
+            budget = REPLAY_STEP_LIMIT;
+        } else if (status == Program::RunStatus::ERROR) {
+            // The game prints runtime errors, and stops the program
+            replay.print(program.error_buffer);
+            if (!replay.done) {
+                replay.fail("Program stopped");
+            }
+        } else if (budget == 0) {
+            replay.fail("No action");
+        }
+    }
+    error = replay.error;
+    return error.empty();
+}
+
+#ifdef TRACE_REPLAY
+#include <iostream>
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : "trace.bin";
+    Trace trace;
+    if (!trace.load(path)) {
+        return 1;
+    }
+    std::string error;
+    auto start = std::chrono::steady_clock::now();
+    bool ok = replay_trace(trace, error);
+    auto end = std::chrono::steady_clock::now();
+    std::cout << trace.size() << " actions replayed in "
+              << std::chrono::duration_cast<std::chrono::microseconds>(end -
+                                                                       start)
+                     .count()
+              << " us" << std::endl;
+    std::cout << (ok ? "ok" : error) << std::endl;
+    return ok ? 0 : 1;
+}
+#endif
@@ -0,0 +1,118 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+
+/**
+ * Record of one program run, for reproducing it without the game. Holds
+ * the world seed, which decides the maze and the rand builtin, the program
+ * source, and every action the program sent to the game together with the
+ * game's response, in order. Saved as a compact binary file.
+ */
+class Trace {
+public:
+    enum Op : uint8_t {
+        PRINT,
+        MOVE,
+        ROTATE_LEFT,
+        ROTATE_RIGHT,
+        FORWARDS,
+        READ_TILE,
+    };
+
+    struct Entry {
+        Op op;
+        // Direction of a MOVE
+        int32_t dx, dy;
+        // Result of a READ_TILE
+        bool is_open;
+        // Text of a PRINT, refers to the trace
+        std::string_view text;
+    };
+
+    // End of the recorded actions at some point of a run
+    struct Mark {
+        std::size_t bytes;
+        std::size_t count;
+    };
+
+    /**
+     * Clears the trace and starts recording a run of source.
+     */
+    void begin(uint64_t world_seed, const std::vector<std::string> &source);
+
+    void print(std::string_view text);
+
+    void move(int32_t dx, int32_t dy);
+
+    void rotate_left();
+
+    void rotate_right();
+
+    void forwards();
+
+    void read_tile(bool is_open);
+
+    /**
+     * Returns the current end of the trace, for truncate.
+     */
+    [[nodiscard]] Mark mark() const;
+
+    /**
+     * Drops the actions recorded after mark was taken, as when the run is
+     * rewound to that point.
+     */
+    void truncate(Mark mark);
+
+    /**
+     * Returns true if no actions have been recorded.
+     */
+    [[nodiscard]] bool empty() const;
+
+    /**
+     * Returns the number of recorded actions.
+     */
+    [[nodiscard]] std::size_t size() const;
+
+    [[nodiscard]] uint64_t get_world_seed() const;
+
+    [[nodiscard]] const std::vector<std::string> &get_source() const;
+
+    /**
+     * Reads the action at offset pos, starting from 0, and moves pos to
+     * the next one. Returns false at the end of the trace.
+     */
+    bool read(std::size_t &pos, Entry &entry) const;
+
+    bool save(const char *path) const;
+
+    /**
+     * Loads a trace saved with save. Returns false if the file can not be
+     * read, or is not a valid trace.
+     */
+    bool load(const char *path);
+
+private:
+    void add_op(Op op, uint8_t arg);
+
+    uint64_t world_seed = 0;
+    std::vector<std::string> source;
+    // Actions, one byte of op and argument, followed by the text for PRINT
+    std::vector<uint8_t> actions;
+    std::size_t count = 0;
+};
+
+/**
+ * Hashes the lines of a program, to identify the source of a trace.
+ */
+uint64_t hash_source(const std::vector<std::string> &lines);
+
+/**
+ * Runs the program of trace without the game, as fast as possible,
+ * answering its actions from the trace. Returns false and sets error if
+ * the program does not send the recorded actions.
+ */
+bool replay_trace(const Trace &trace, std::string &error);
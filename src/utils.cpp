@@ -1,5 +1,7 @@
 #include "utils.h"
+#include <algorithm>
 #include <cmath>
+#include <cstdlib>
 #include <utility>
 
 
@@ -37,6 +39,19 @@ int32_t vec2i::dist_manhattan_diag_to(vec2i const& other) {
     return std::max(std::abs(x - other.x), std::abs(y - other.y));
 }
 
+bool within_range(vec2i a, vec2i b, int32_t range, DIST_TYPES type) {
+    int32_t dx = std::abs(a.x - b.x), dy = std::abs(a.y - b.y);
+    switch (type) {
+    case DIST_TYPES::EUCLIDEAN:
+        return dx * dx + dy * dy <= range * range;
+    case DIST_TYPES::MANHATTAN:
+        return dx + dy <= range;
+    case DIST_TYPES::MANHATTAN_DIAG:
+    default:
+        return std::max(dx, dy) <= range;
+    }
+}
+
 vec2i vec2i_from_dir(DIR dir) {
     switch (dir) {
     case DIR::DIR_UP:
@@ -43,3 +43,8 @@ public:
 };
 
 vec2i vec2i_from_dir(DIR dir);
+
+/**
+ * Returns true if b is at most range away from a, measured as type.
+ */
+bool within_range(vec2i a, vec2i b, int32_t range, DIST_TYPES type);